@@ -0,0 +1,147 @@
+#include "benchmark.hpp"
+
+#include <filesystem>
+#include <random>
+
+#include <glm/geometric.hpp>
+#include <glm/ext/scalar_constants.hpp>
+
+#include "obj_parser.hpp"
+#include "bvh.hpp"
+
+namespace
+{
+
+    // Rays through the pixels of a square image looking at the mesh along -z, in 2x2 pixel blocks
+    // so that consecutive groups of four make coherent packets
+    std::vector<ray> camera_rays(glm::vec3 const & min, glm::vec3 const & max, int size)
+    {
+        glm::vec3 const center = (min + max) * 0.5f;
+        float const radius = glm::length(max - min) * 0.5f;
+        glm::vec3 const eye = center + glm::vec3(0.f, 0.f, 2.5f * radius);
+
+        std::vector<ray> rays;
+        rays.reserve(size * size);
+        for (int by = 0; by < size; by += 2)
+        {
+            for (int bx = 0; bx < size; bx += 2)
+            {
+                for (int i = 0; i < 4; ++i)
+                {
+                    float const x = ((bx + (i & 1) + 0.5f) / size * 2.f - 1.f) * radius;
+                    float const y = ((by + (i >> 1) + 0.5f) / size * 2.f - 1.f) * radius;
+                    rays.push_back({eye, glm::normalize(center + glm::vec3(x, y, 0.f) - eye)});
+                }
+            }
+        }
+        return rays;
+    }
+
+    // Short occlusion rays from the camera hits into the hemisphere around the normal, four per point,
+    // like the ambient occlusion baker shoots them
+    std::vector<ray> occlusion_rays(bvh const & tree, std::vector<glm::vec3> const & positions, std::vector<std::uint32_t> const & indices,
+        std::vector<ray> const & primary, float length)
+    {
+        std::default_random_engine rng;
+        std::normal_distribution<float> normal;
+
+        std::vector<ray> rays;
+        for (auto const & r : primary)
+        {
+            auto const hit = tree.intersect(r);
+            if (!hit)
+                continue;
+
+            glm::vec3 const v0 = positions[indices[3 * hit.triangle + 0]];
+            glm::vec3 const v1 = positions[indices[3 * hit.triangle + 1]];
+            glm::vec3 const v2 = positions[indices[3 * hit.triangle + 2]];
+            glm::vec3 n = glm::normalize(glm::cross(v1 - v0, v2 - v0));
+            if (glm::dot(n, r.direction) > 0.f)
+                n = -n;
+
+            glm::vec3 const origin = r.origin + r.direction * hit.t + n * (1e-4f * length);
+            for (int i = 0; i < 4; ++i)
+            {
+                glm::vec3 d = glm::normalize(glm::vec3(normal(rng), normal(rng), normal(rng)));
+                if (glm::dot(d, n) < 0.f)
+                    d = -d;
+                rays.push_back({origin, d, 0.f, length});
+            }
+        }
+        return rays;
+    }
+
+}
+
+int main(int argc, char ** argv)
+{
+    benchmark_runner runner(argc, argv);
+
+    std::filesystem::path const root = REPO_ROOT;
+
+    for (auto [name, path] : {
+        std::pair{"dragon", "practice6/dragon.obj"},
+        std::pair{"buddha", "practice8/buddha.obj"},
+        std::pair{"bunny", "practice9/bunny.obj"},
+    })
+    {
+        auto const data = parse_obj(root / path);
+
+        std::vector<glm::vec3> positions;
+        positions.reserve(data.vertices.size());
+        glm::vec3 min(std::numeric_limits<float>::infinity()), max(-std::numeric_limits<float>::infinity());
+        for (auto const & vertex : data.vertices)
+        {
+            positions.emplace_back(vertex.position[0], vertex.position[1], vertex.position[2]);
+            min = glm::min(min, positions.back());
+            max = glm::max(max, positions.back());
+        }
+
+        std::size_t const triangles = data.indices.size() / 3;
+
+        for (auto [builder_name, builder] : {std::pair{"sah", bvh::builder::sah}, std::pair{"lbvh", bvh::builder::lbvh}})
+        {
+            std::string const prefix = std::string("bvh/") + name + "/" + builder_name;
+
+            runner.run(prefix + "/build", [&]{
+                bvh tree(positions, data.indices, builder);
+                do_not_optimize(tree);
+            }, triangles, "triangles");
+
+            bvh const tree(positions, data.indices, builder);
+            std::cout << prefix << ": " << triangles << " triangles, " << tree.node_count() << " nodes, "
+                << tree.leaf_count() << " leaves, SAH cost " << tree.sah_cost() << std::endl;
+
+            auto const primary = camera_rays(min, max, 512);
+            auto const occlusion = occlusion_rays(tree, positions, data.indices, primary, glm::length(max - min) * 0.1f);
+
+            runner.run(prefix + "/primary_single", [&]{
+                for (auto const & r : primary)
+                    do_not_optimize(tree.intersect(r));
+            }, primary.size(), "rays");
+
+            runner.run(prefix + "/primary_packet", [&]{
+                for (std::size_t i = 0; i + 4 <= primary.size(); i += 4)
+                {
+                    ray_hit hits[4];
+                    tree.intersect(std::span<ray const, 4>(primary.data() + i, 4), hits);
+                    do_not_optimize(hits);
+                }
+            }, primary.size(), "rays");
+
+            runner.run(prefix + "/occlusion_single", [&]{
+                for (auto const & r : occlusion)
+                    do_not_optimize(tree.occluded(r));
+            }, occlusion.size(), "rays");
+
+            runner.run(prefix + "/occlusion_packet", [&]{
+                for (std::size_t i = 0; i + 4 <= occlusion.size(); i += 4)
+                {
+                    bool result[4];
+                    tree.occluded(std::span<ray const, 4>(occlusion.data() + i, 4), result);
+                    do_not_optimize(result);
+                }
+            }, occlusion.size(), "rays");
+        }
+    }
+}
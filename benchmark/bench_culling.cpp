@@ -0,0 +1,185 @@
+#include "benchmark.hpp"
+
+#include <random>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include <rapidjson/document.h>
+#include <rapidjson/writer.h>
+#include <rapidjson/stringbuffer.h>
+
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/scalar_constants.hpp>
+
+#include "gltf_loader.hpp"
+#include "aabb.hpp"
+#include "frustum.hpp"
+#include "intersect.hpp"
+#include "transform_hierarchy.hpp"
+
+int main(int argc, char ** argv)
+{
+    benchmark_runner runner(argc, argv);
+
+    std::string const root = REPO_ROOT;
+    std::string const bunny_path = root + "/practice14/bunny/bunny.gltf";
+
+    runner.run("load_gltf/bunny", [&]{
+        auto model = load_gltf(bunny_path);
+        do_not_optimize(model);
+    });
+
+    // The bunny LODs placed by a 1057-node scene graph, a row node per x with 32 bunnies as its children.
+    // Every mesh is listed twice, so the loader has to merge the copies and batch the nodes by mesh.
+    std::filesystem::path const scene_path = std::filesystem::temp_directory_path() / "bench_culling_scene.gltf";
+    {
+        rapidjson::Document document;
+        {
+            std::ifstream input(bunny_path);
+            std::string const contents{std::istreambuf_iterator<char>(input), std::istreambuf_iterator<char>()};
+            document.Parse(contents.c_str());
+        }
+        auto & allocator = document.GetAllocator();
+
+        std::string const buffer_path = root + "/practice14/bunny/" + document["buffers"][0]["uri"].GetString();
+        document["buffers"][0]["uri"].SetString(buffer_path.c_str(), allocator);
+
+        auto & meshes = document["meshes"];
+        unsigned int const mesh_count = meshes.Size();
+        for (unsigned int i = 0; i < mesh_count; ++i)
+        {
+            rapidjson::Value copy(meshes[i], allocator);
+            meshes.PushBack(copy, allocator);
+        }
+
+        auto translation = [&](float x, float z)
+        {
+            rapidjson::Value result(rapidjson::kArrayType);
+            result.PushBack(x, allocator).PushBack(0.f, allocator).PushBack(z, allocator);
+            return result;
+        };
+
+        rapidjson::Value nodes(rapidjson::kArrayType);
+        rapidjson::Value root_node(rapidjson::kObjectType);
+        rapidjson::Value root_children(rapidjson::kArrayType);
+        for (int i = 0; i < 32; ++i)
+            root_children.PushBack(1 + i * 33, allocator);
+        root_node.AddMember("children", root_children, allocator);
+        nodes.PushBack(root_node, allocator);
+
+        for (int i = 0; i < 32; ++i)
+        {
+            rapidjson::Value row(rapidjson::kObjectType);
+            rapidjson::Value children(rapidjson::kArrayType);
+            for (int j = 0; j < 32; ++j)
+                children.PushBack(2 + i * 33 + j, allocator);
+            row.AddMember("translation", translation(i - 16, 0.f), allocator);
+            row.AddMember("children", children, allocator);
+            nodes.PushBack(row, allocator);
+
+            for (int j = 0; j < 32; ++j)
+            {
+                rapidjson::Value bunny(rapidjson::kObjectType);
+                bunny.AddMember("mesh", (i + j) % (2 * mesh_count), allocator);
+                bunny.AddMember("translation", translation(0.f, j - 16), allocator);
+                nodes.PushBack(bunny, allocator);
+            }
+        }
+        document["nodes"] = nodes;
+
+        rapidjson::Value scene_nodes(rapidjson::kArrayType);
+        scene_nodes.PushBack(0, allocator);
+        document["scenes"][0]["nodes"] = scene_nodes;
+
+        rapidjson::StringBuffer output;
+        rapidjson::Writer<rapidjson::StringBuffer> writer(output);
+        document.Accept(writer);
+        std::ofstream(scene_path) << output.GetString();
+    }
+
+    runner.run("load_gltf/scene_1k_nodes", [&]{
+        auto model = load_gltf(scene_path);
+        do_not_optimize(model);
+    });
+
+    {
+        auto const scene_model = load_gltf(scene_path);
+
+        std::size_t originals = 0;
+        for (std::size_t i = 0; i < scene_model.meshes.size(); ++i)
+            originals += scene_model.meshes[i].original == i;
+
+        std::size_t instances = 0;
+        for (auto const & batch : scene_model.batches)
+            instances += batch.transforms.size();
+
+        std::size_t roots = 0;
+        for (auto const & node : scene_model.nodes)
+            roots += node.parent == -1;
+
+        std::cout << "load_gltf/scene_1k_nodes: " << scene_model.nodes.size() << " nodes (" << roots << " root), "
+            << scene_model.meshes.size() << " meshes (" << originals << " unique), "
+            << scene_model.batches.size() << " batches of " << instances << " instances" << std::endl;
+    }
+
+    // The practice14 scene: a 32x32 grid of bunnies seen from the default camera
+    auto const model = load_gltf(bunny_path);
+
+    auto const & lod0 = model.meshes[0].primitives[0];
+
+    std::vector<aabb> boxes;
+    for (int i = -16; i < 16; i++)
+        for (int j = -16; j < 16; j++)
+            boxes.emplace_back(lod0.min + glm::vec3(i, 0.f, j), lod0.max + glm::vec3(i, 0.f, j));
+
+    glm::mat4 view = glm::translate(glm::mat4(1.f), -glm::vec3(0.f, 1.5f, 3.f));
+    glm::mat4 projection = glm::perspective(glm::pi<float>() / 2.f, 16.f / 9.f, 0.1f, 100.f);
+    frustum const view_frustum(projection * view);
+
+    runner.run("intersect/aabb_frustum", [&]{
+        std::size_t visible = 0;
+        for (auto const & box : boxes)
+            visible += intersect(box, view_frustum);
+        do_not_optimize(visible);
+    }, boxes.size(), "boxes");
+
+    // 100k nodes: 1000 groups of 100 leaves
+    transform_hierarchy scene;
+    std::vector<std::uint32_t> groups;
+    {
+        auto const root_node = scene.add(transform_hierarchy::no_parent);
+        for (int i = 0; i < 1000; ++i)
+        {
+            groups.push_back(scene.add(root_node, glm::vec3(i, 0.f, 0.f)));
+            for (int j = 0; j < 99; ++j)
+                scene.add(groups.back(), glm::vec3(0.f, 0.f, j), glm::angleAxis(0.1f * j, glm::vec3(0.f, 1.f, 0.f)));
+        }
+        scene.update();
+    }
+
+    runner.run("transform_hierarchy/static_100k", [&]{
+        do_not_optimize(scene.update());
+    });
+
+    runner.run("transform_hierarchy/one_group_dirty_100k", [&, i = std::size_t(0)]() mutable {
+        auto const group = groups[i++ % groups.size()];
+        scene.set_translation(group, scene.translation(group) + glm::vec3(0.f, 1e-3f, 0.f));
+        do_not_optimize(scene.update());
+    });
+
+    runner.run("transform_hierarchy/all_dirty_100k", [&]{
+        scene.set_rotation(0, glm::angleAxis(0.01f, glm::vec3(0.f, 1.f, 0.f)) * scene.rotation(0));
+        do_not_optimize(scene.update());
+    }, scene.size(), "nodes");
+
+    // Every local transform changes, as in an animated crowd: the local matrices are built four at a time
+    runner.run("transform_hierarchy/all_local_dirty_100k", [&, angle = 0.f]() mutable {
+        angle += 0.01f;
+        glm::quat const rotation = glm::angleAxis(angle, glm::vec3(0.f, 1.f, 0.f));
+        for (std::uint32_t node = 0; node < scene.size(); ++node)
+            scene.set_rotation(node, rotation);
+        do_not_optimize(scene.update());
+    }, scene.size(), "nodes");
+}
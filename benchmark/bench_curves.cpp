@@ -0,0 +1,57 @@
+#include "benchmark.hpp"
+
+#include <random>
+
+#include "bezier.hpp"
+#include "spline.hpp"
+#include "arc_length.hpp"
+
+int main(int argc, char ** argv)
+{
+    benchmark_runner runner(argc, argv);
+
+    std::default_random_engine rng;
+    std::uniform_real_distribution<float> coordinate(0.f, 1000.f);
+
+    std::vector<vec2> control(16);
+    for (auto & p : control)
+        p = {coordinate(rng), coordinate(rng)};
+
+    bezier_evaluator evaluator;
+    std::vector<vec2> points;
+
+    runner.run("bezier/sample_uniform_16x1024", [&]{
+        evaluator.sample_uniform(control, 1024, points);
+        do_not_optimize(points);
+    }, 1024, "points");
+
+    runner.run("bezier/flatten_16", [&]{
+        evaluator.flatten(control, 0.25f, points);
+        do_not_optimize(points);
+    });
+
+    arc_length_table table;
+    evaluator.sample_uniform(control, 1024, points);
+    table.update(points);
+
+    runner.run("arc_length/point_1024", [&]{
+        float const step = table.length() / 1024;
+        for (int i = 0; i < 1024; ++i)
+        {
+            auto p = table.point(points, i * step);
+            do_not_optimize(p);
+        }
+    }, 1024, "points");
+
+    for (int count : {10000, 100000})
+    {
+        catmull_rom_spline spline(16);
+        for (int i = 0; i < count; ++i)
+            spline.push_back({coordinate(rng), coordinate(rng)});
+
+        runner.run("spline/move_point_" + std::to_string(count / 1000) + "k", [&, i = std::size_t(0)]() mutable {
+            auto range = spline.move(i++ % spline.points.size(), {coordinate(rng), coordinate(rng)});
+            do_not_optimize(range);
+        });
+    }
+}
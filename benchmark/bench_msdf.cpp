@@ -0,0 +1,39 @@
+#include "benchmark.hpp"
+
+#include <filesystem>
+
+#include "msdf_loader.hpp"
+#include "text_layout.hpp"
+
+int main(int argc, char ** argv)
+{
+    benchmark_runner runner(argc, argv);
+
+    std::string const root = REPO_ROOT;
+    std::string const font_path = root + "/practice15/font/font-msdf.json";
+
+    // The binary cache is written to a temporary directory, the one next to the font is left alone
+    auto const cache_path = (std::filesystem::temp_directory_path() / "benchmark-font-msdf.bin").string();
+
+    runner.run("msdf/load_json", [&]{
+        auto font = load_msdf_font_json(font_path);
+        do_not_optimize(font);
+    });
+
+    auto const font = load_msdf_font_json(font_path);
+    save_msdf_font_binary(font, cache_path);
+
+    runner.run("msdf/load_binary", [&]{
+        auto font = load_msdf_font_binary(cache_path);
+        do_not_optimize(font);
+    });
+
+    std::string const text = "The quick brown fox jumps over the lazy dog. Съешь же ещё этих мягких французских булок, да выпей чаю.";
+
+    runner.run("msdf/layout_run", [&]{
+        auto run = layout_run(font, text, font.size, {0, 0, 0, 255});
+        do_not_optimize(run);
+    }, text.size(), "bytes");
+
+    std::filesystem::remove(cache_path);
+}
@@ -0,0 +1,29 @@
+#include "benchmark.hpp"
+
+#include <filesystem>
+
+#include "obj_parser.hpp"
+
+int main(int argc, char ** argv)
+{
+    benchmark_runner runner(argc, argv);
+
+    std::filesystem::path const root = REPO_ROOT;
+
+    for (auto path : {
+        "practice4/bunny_lowres.obj",
+        "practice4/bunny.obj",
+        "practice5/cow.obj",
+        "practice6/dragon.obj",
+        "practice7/suzanne.obj",
+        "practice8/buddha.obj",
+        "practice9/bunny.obj",
+    })
+    {
+        auto const file = root / path;
+        runner.run(std::string("parse_obj/") + path, [&]{
+            auto data = parse_obj(file);
+            do_not_optimize(data);
+        }, std::filesystem::file_size(file), "bytes");
+    }
+}
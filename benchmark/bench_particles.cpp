@@ -0,0 +1,60 @@
+#include "benchmark.hpp"
+
+#include "particle_system.hpp"
+
+#include <random>
+
+int main(int argc, char ** argv)
+{
+    benchmark_runner runner(argc, argv);
+
+    float const dt = 1.f / 60.f;
+
+    for (std::size_t count : {256, 4096})
+    {
+        particle_system simulation;
+        simulation.max_particles = count;
+
+        // Fill the system up and let it settle into its steady state
+        simulation.particles.resize(count);
+        for (int i = 0; i < 120; ++i)
+            simulation.update(dt);
+
+        runner.run("particles/update_" + std::to_string(count), [&]{
+            simulation.update(dt);
+            do_not_optimize(simulation.particles);
+        }, count, "particles");
+    }
+
+    // The grid on its own at a million particles, spread over a box the size of the practice11 scene
+    // at about one particle per cell, so a query visits a handful of neighbours
+    {
+        std::size_t const count = 1 << 20;
+
+        std::mt19937 rng(42);
+        std::uniform_real_distribution<float> coordinate(-2.f, 2.f);
+        std::vector<glm::vec3> positions(count);
+        for (auto & p : positions)
+            p = glm::vec3(coordinate(rng), coordinate(rng) * 0.75f + 0.5f, coordinate(rng));
+
+        particle_grid grid(particle_system::interaction_radius);
+        auto const position = [&](std::size_t i) { return positions[i]; };
+
+        runner.run("particles/grid_build_1M", [&]{
+            grid.build(count, position);
+            do_not_optimize(grid.sorted_indices);
+        }, count, "particles");
+
+        // In grid order, as particle_system queries it
+        std::vector<std::uint32_t> neighbours(count);
+        runner.run("particles/grid_query_1M", [&]{
+            parallel_for(count, [&](std::size_t k)
+            {
+                std::uint32_t n = 0;
+                grid.for_each_neighbour(grid.sorted_positions[k], particle_system::interaction_radius, [&](std::uint32_t, glm::vec3 const &){ ++n; });
+                neighbours[grid.sorted_indices[k]] = n;
+            });
+            do_not_optimize(neighbours);
+        }, count, "particles");
+    }
+}
@@ -0,0 +1,84 @@
+#include "benchmark.hpp"
+
+#include <cstring>
+#include <random>
+
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/scalar_constants.hpp>
+
+#include "gltf_loader.hpp"
+#include "picking.hpp"
+
+int main(int argc, char ** argv)
+{
+    benchmark_runner runner(argc, argv);
+
+    std::string const root = REPO_ROOT;
+    auto const model = load_gltf(root + "/practice14/bunny/bunny.gltf");
+
+    ray_picker picker;
+    std::size_t triangles = 0;
+    for (auto const & lod : model.meshes)
+    {
+        auto const & mesh = lod.primitives[0];
+        auto const positions = reinterpret_cast<glm::vec3 const *>(model.buffer.data() + mesh.position.view.offset);
+
+        std::vector<std::uint32_t> indices(mesh.indices.count);
+        auto const data = model.buffer.data() + mesh.indices.view.offset;
+        for (std::size_t i = 0; i < indices.size(); ++i)
+        {
+            // GL_UNSIGNED_SHORT
+            if (mesh.indices.type == 5123)
+                indices[i] = reinterpret_cast<std::uint16_t const *>(data)[i];
+            else
+                indices[i] = reinterpret_cast<std::uint32_t const *>(data)[i];
+        }
+
+        picker.add_mesh({positions, mesh.position.count}, indices);
+        triangles += indices.size() / 3;
+    }
+
+    // The practice14 scene: a 32x32 grid of bunnies with the LOD picked by distance
+    glm::vec3 const camera_position(0.f, 1.5f, 3.f);
+    glm::mat4 const view = glm::translate(glm::mat4(1.f), -camera_position);
+    glm::mat4 const projection = glm::perspective(glm::pi<float>() / 2.f, 16.f / 9.f, 0.1f, 100.f);
+
+    std::vector<std::uint32_t> meshes;
+    std::vector<glm::mat4> transforms;
+    {
+        std::default_random_engine rng;
+        std::uniform_real_distribution<float> angle(0.f, 2.f * glm::pi<float>());
+
+        for (int i = -16; i < 16; i++)
+        {
+            for (int j = -16; j < 16; j++)
+            {
+                glm::vec3 const position(i, 0.f, j);
+                transforms.push_back(glm::rotate(glm::translate(glm::mat4(1.f), position), angle(rng), glm::vec3(0.f, 1.f, 0.f)));
+                meshes.push_back(std::min(5, (int)std::round(glm::distance(position, camera_position) / 5)));
+            }
+        }
+    }
+
+    runner.run("picking/set_instances", [&]{
+        picker.set_instances(meshes, transforms);
+    }, meshes.size(), "instances");
+
+    // Clicks spread over a 1920x1080 window
+    std::vector<ray> rays;
+    for (int y = 0; y < 1080; y += 30)
+        for (int x = 0; x < 1920; x += 30)
+            rays.push_back(cursor_ray(projection * view, x, y, 1920, 1080));
+
+    std::size_t hits = 0;
+    for (auto const & r : rays)
+        hits += picker.pick(r).has_value();
+    std::cout << "picking: " << meshes.size() << " instances of " << model.meshes.size() << " meshes with "
+        << triangles << " triangles, " << hits << " of " << rays.size() << " rays hit" << std::endl;
+
+    runner.run("picking/pick", [&]{
+        for (auto const & r : rays)
+            do_not_optimize(picker.pick(r));
+    }, rays.size(), "rays");
+}
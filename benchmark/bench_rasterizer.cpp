@@ -0,0 +1,158 @@
+#include "benchmark.hpp"
+
+#include <cstring>
+#include <random>
+
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+#include <glm/ext/scalar_constants.hpp>
+
+#include "gltf_loader.hpp"
+#include "software_rasterizer.hpp"
+#include "impostor.hpp"
+#include "stb_image.h"
+
+namespace
+{
+
+    struct mesh_data
+    {
+        std::vector<glm::vec3> positions;
+        std::vector<glm::vec3> normals;
+        std::vector<glm::vec2> texcoords;
+        std::vector<std::uint32_t> indices;
+    };
+
+    template <typename T>
+    std::vector<T> read_accessor(gltf_model const & model, gltf_model::accessor const & accessor)
+    {
+        std::vector<T> result(accessor.count);
+        std::memcpy(result.data(), model.buffer.data() + accessor.view.offset, accessor.count * sizeof(T));
+        return result;
+    }
+
+    mesh_data read_mesh(gltf_model const & model, gltf_model::primitive const & mesh)
+    {
+        mesh_data result;
+        result.positions = read_accessor<glm::vec3>(model, mesh.position);
+        result.normals = read_accessor<glm::vec3>(model, mesh.normal);
+        result.texcoords = read_accessor<glm::vec2>(model, mesh.texcoord);
+
+        // GL_UNSIGNED_SHORT
+        if (mesh.indices.type == 5123)
+        {
+            auto const indices = read_accessor<std::uint16_t>(model, mesh.indices);
+            result.indices.assign(indices.begin(), indices.end());
+        }
+        else
+            result.indices = read_accessor<std::uint32_t>(model, mesh.indices);
+
+        return result;
+    }
+
+    software_draw make_draw(mesh_data const & mesh, glm::mat4 const & model, glm::mat4 const & view_projection, software_texture const & texture)
+    {
+        software_draw draw;
+        draw.positions = mesh.positions;
+        draw.normals = mesh.normals;
+        draw.texcoords = mesh.texcoords;
+        draw.indices = mesh.indices;
+        draw.model = model;
+        draw.view_projection = view_projection;
+        draw.albedo = &texture;
+        draw.light_direction = glm::vec3(1.f, 2.f, 3.f);
+        return draw;
+    }
+
+}
+
+int main(int argc, char ** argv)
+{
+    benchmark_runner runner(argc, argv);
+
+    std::string const root = REPO_ROOT;
+    std::string const bunny_directory = root + "/practice14/bunny/";
+
+    auto const model = load_gltf(bunny_directory + "bunny.gltf");
+
+    std::vector<mesh_data> lods;
+    for (auto const & mesh : model.meshes)
+        lods.push_back(read_mesh(model, mesh.primitives[0]));
+
+    auto const texture = [&]
+    {
+        int width, height, channels;
+        auto data = stbi_load((bunny_directory + *model.meshes[0].primitives[0].material.texture_path).c_str(), &width, &height, &channels, 4);
+        software_texture result(width, height, reinterpret_cast<glm::u8vec4 const *>(data));
+        stbi_image_free(data);
+        return result;
+    }();
+
+    software_framebuffer framebuffer(1920, 1080);
+    software_rasterizer rasterizer;
+
+    glm::mat4 const projection = glm::perspective(glm::pi<float>() / 2.f, 16.f / 9.f, 0.1f, 100.f);
+
+    // Every scene is measured twice: the front end alone (transform, clipping, setup and binning)
+    // in triangles per second, and the whole frame in shaded pixels per second
+    auto run_scene = [&](std::string const & name, std::vector<software_draw> const & draws)
+    {
+        auto render = [&]{
+            framebuffer.clear(glm::vec4(0.8f, 0.8f, 1.f, 0.f));
+            rasterizer.begin_frame(framebuffer);
+            for (auto const & draw : draws)
+                rasterizer.draw(draw);
+            return rasterizer.end_frame();
+        };
+
+        auto const stats = render();
+        std::cout << name << ": " << stats.triangles << " triangles, " << stats.triangles_binned << " binned, "
+            << stats.pixels << " pixels, " << stats.blocks_occluded << " blocks occluded" << std::endl;
+
+        runner.run("rasterizer/" + name + "/front_end", [&]{
+            rasterizer.begin_frame(framebuffer);
+            for (auto const & draw : draws)
+                rasterizer.draw(draw);
+        }, stats.triangles, "triangles");
+
+        runner.run("rasterizer/" + name + "/frame", [&]{
+            do_not_optimize(render());
+        }, stats.pixels, "pixels");
+    };
+
+    // One bunny filling most of the screen
+    {
+        glm::mat4 const view = glm::lookAt(glm::vec3(0.1f, 0.15f, 0.6f), glm::vec3(0.1f, 0.15f, 0.f), glm::vec3(0.f, 1.f, 0.f));
+        run_scene("bunny_closeup", {make_draw(lods[0], glm::mat4(1.f), projection * view, texture)});
+    }
+
+    // The practice14 scene: a 32x32 grid of bunnies with the LOD picked by distance
+    {
+        glm::vec3 const camera_position(0.f, 1.5f, 3.f);
+        glm::mat4 const view = glm::translate(glm::mat4(1.f), -camera_position);
+
+        std::default_random_engine rng;
+        std::uniform_real_distribution<float> angle(0.f, 2.f * glm::pi<float>());
+
+        std::vector<software_draw> draws;
+        for (int i = -16; i < 16; i++)
+        {
+            for (int j = -16; j < 16; j++)
+            {
+                glm::vec3 const position(i, 0.f, j);
+                glm::mat4 const transform = glm::rotate(glm::translate(glm::mat4(1.f), position), angle(rng), glm::vec3(0.f, 1.f, 0.f));
+                int const lod = std::min(5, (int)std::round(glm::distance(position, camera_position) / 5));
+                draws.push_back(make_draw(lods[lod], transform, projection * view, texture));
+            }
+        }
+        run_scene("bunny_grid", draws);
+    }
+
+    // The practice14 startup bake: 16x16 views of 64x64 pixels, each drawn unlit and with normals
+    {
+        auto const draw = make_draw(lods[0], glm::mat4(1.f), glm::mat4(1.f), texture);
+        runner.run("rasterizer/impostor_bake", [&]{
+            do_not_optimize(bake_impostor(draw, 16, 64));
+        }, 16 * 16 * 64 * 64 * 2, "pixels");
+    }
+}
@@ -0,0 +1,65 @@
+#include "benchmark.hpp"
+
+#include <random>
+
+#include "gltf_loader.hpp"
+#include "skeleton.hpp"
+
+int main(int argc, char ** argv)
+{
+    benchmark_runner runner(argc, argv);
+
+    std::string const root = REPO_ROOT;
+    std::string const wolf_path = root + "/practice13/wolf/Wolf-Blender-2.82a.gltf";
+    std::string const dancing_path = root + "/practice13/dancing/dancing.gltf";
+
+    runner.run("load_gltf/wolf", [&]{
+        auto model = load_gltf(wolf_path);
+        do_not_optimize(model);
+    });
+
+    runner.run("load_gltf/dancing", [&]{
+        auto model = load_gltf(dancing_path);
+        do_not_optimize(model);
+    });
+
+    auto const model = load_gltf(dancing_path);
+    auto const & animation = model.animations.at("hip-hop");
+    auto const & other = model.animations.at("rumba");
+
+    // Random times, so that the binary search in the splines does not always hit the same keys
+    std::vector<float> times(1024);
+    {
+        std::default_random_engine rng;
+        std::uniform_real_distribution<float> time(0.f, animation.max_time);
+        for (auto & t : times)
+            t = time(rng);
+    }
+
+    runner.run("spline/sample_all_channels", [&, i = std::size_t(0)]() mutable {
+        float const t = times[i++ % times.size()];
+        for (auto const & bone : animation.bones)
+        {
+            auto translation = bone.translation(t);
+            auto rotation = bone.rotation(t);
+            auto scale = bone.scale(t);
+            do_not_optimize(translation);
+            do_not_optimize(rotation);
+            do_not_optimize(scale);
+        }
+    }, animation.bones.size() * 3.0, "samples");
+
+    std::vector<glm::mat4x3> bones(model.bones.size());
+
+    runner.run("skeleton/pose", [&, i = std::size_t(0)]() mutable {
+        float const t = times[i++ % times.size()];
+        compute_pose(model, animation, t, animation, t, 1.f, bones);
+        do_not_optimize(bones);
+    }, bones.size(), "bones");
+
+    runner.run("skeleton/pose_blended", [&, i = std::size_t(0)]() mutable {
+        float const t = times[i++ % times.size()];
+        compute_pose(model, other, std::fmod(t, other.max_time), animation, t, 0.5f, bones);
+        do_not_optimize(bones);
+    }, bones.size(), "bones");
+}
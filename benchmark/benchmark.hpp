@@ -0,0 +1,188 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Keeps the compiler from optimizing away a result that is otherwise unused
+template <typename T>
+void do_not_optimize(T const & value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r"(&value) : "memory");
+#else
+    static volatile char const * sink;
+    sink = reinterpret_cast<char const *>(&value);
+#endif
+}
+
+// Runs every benchmark for a few warmup calls, then collects timing samples and reports
+// percentiles of the time per call. Functions faster than min_sample_time are called in
+// batches, so that every sample is long enough for the clock to measure it reliably.
+//
+// Command line:
+//   --filter <text>    only run benchmarks whose name contains the text
+//   --samples <n>      minimal number of samples (30)
+//   --min-time <s>     minimal total measured time per benchmark in seconds (0.5)
+//   --json <path>      append one JSON object per benchmark to the file, '-' for stdout
+// Unknown options and options without a value print the usage and exit with a failure code.
+struct benchmark_runner
+{
+    benchmark_runner(int argc, char ** argv)
+    {
+        for (int i = 1; i < argc; i += 2)
+        {
+            std::string_view const option = argv[i];
+            if (option != "--filter" && option != "--samples" && option != "--min-time" && option != "--json")
+                usage_error(argv[0], "Unknown option ", option);
+            if (i + 1 == argc)
+                usage_error(argv[0], "Missing value for ", option);
+
+            char const * value = argv[i + 1];
+            if (option == "--filter")
+                filter_ = value;
+            else if (option == "--samples")
+                min_samples_ = std::max(1, std::atoi(value));
+            else if (option == "--min-time")
+                min_time_ = std::atof(value);
+            else
+                json_path_ = value;
+        }
+
+        if (!json_path_.empty() && json_path_ != "-")
+            json_file_.open(json_path_, std::ios::app);
+    }
+
+    // items is the amount of work per call (bytes, boxes, nodes...), reported as a throughput
+    template <typename F>
+    void run(std::string const & name, F && f, double items = 0.0, char const * unit = "items")
+    {
+        using clock = std::chrono::steady_clock;
+
+        if (!filter_.empty() && name.find(filter_) == std::string::npos)
+            return;
+
+        for (int i = 0; i < warmup_calls; ++i)
+            f();
+
+        // Double the batch until it takes long enough
+        std::size_t batch = 1;
+        while (true)
+        {
+            auto const start = clock::now();
+            for (std::size_t i = 0; i < batch; ++i)
+                f();
+            if (clock::now() - start >= min_sample_time || batch >= max_batch)
+                break;
+            batch *= 2;
+        }
+
+        std::vector<double> samples;
+        double total = 0.0;
+        while ((samples.size() < min_samples_ || total < min_time_) && samples.size() < max_samples)
+        {
+            auto const start = clock::now();
+            for (std::size_t i = 0; i < batch; ++i)
+                f();
+            double const seconds = std::chrono::duration<double>(clock::now() - start).count();
+            total += seconds;
+            samples.push_back(seconds * 1e9 / batch);
+        }
+
+        report(name, batch, samples, items, unit);
+    }
+
+private:
+    static constexpr int warmup_calls = 3;
+    static constexpr auto min_sample_time = std::chrono::microseconds(100);
+    static constexpr std::size_t max_batch = std::size_t(1) << 24;
+    static constexpr std::size_t max_samples = 100000;
+
+    void report(std::string const & name, std::size_t batch, std::vector<double> samples, double items, char const * unit)
+    {
+        std::sort(samples.begin(), samples.end());
+
+        // Nearest-rank percentile
+        auto percentile = [&](double p)
+        {
+            std::size_t const rank = std::ceil(p / 100.0 * samples.size());
+            return samples[std::clamp<std::size_t>(rank, 1, samples.size()) - 1];
+        };
+
+        double mean = 0.0;
+        for (double s : samples)
+            mean += s;
+        mean /= samples.size();
+
+        double variance = 0.0;
+        for (double s : samples)
+            variance += (s - mean) * (s - mean);
+        double const stddev = std::sqrt(variance / samples.size());
+
+        double const p50 = percentile(50.0);
+        double const items_per_second = items > 0.0 ? items / (p50 * 1e-9) : 0.0;
+
+        std::cout << std::left << std::setw(40) << name << std::right << std::fixed << std::setprecision(3)
+            << " p50 " << std::setw(12) << format_time(p50)
+            << " p90 " << std::setw(12) << format_time(percentile(90.0))
+            << " p99 " << std::setw(12) << format_time(percentile(99.0))
+            << " min " << std::setw(12) << format_time(samples.front());
+        if (items > 0.0)
+            std::cout << "  " << std::setprecision(2) << items_per_second / 1e6 << " M" << unit << "/s";
+        std::cout << std::endl;
+
+        if (json_path_.empty())
+            return;
+
+        std::ostream & json = (json_path_ == "-") ? std::cout : json_file_;
+        json << std::setprecision(1) << std::fixed
+            << "{\"benchmark\": \"" << name << "\""
+            << ", \"samples\": " << samples.size()
+            << ", \"calls_per_sample\": " << batch
+            << ", \"min_ns\": " << samples.front()
+            << ", \"p50_ns\": " << p50
+            << ", \"p90_ns\": " << percentile(90.0)
+            << ", \"p99_ns\": " << percentile(99.0)
+            << ", \"max_ns\": " << samples.back()
+            << ", \"mean_ns\": " << mean
+            << ", \"stddev_ns\": " << stddev;
+        if (items > 0.0)
+            json << ", \"" << unit << "_per_second\": " << items_per_second;
+        json << "}" << std::endl;
+    }
+
+    static std::string format_time(double ns)
+    {
+        char const * units[] = {"ns", "us", "ms", "s"};
+        int unit = 0;
+        while (ns >= 1000.0 && unit < 3)
+        {
+            ns /= 1000.0;
+            ++unit;
+        }
+
+        std::string result = std::to_string(ns);
+        result.resize(result.find('.') + 3);
+        return result + " " + units[unit];
+    }
+
+    [[noreturn]] static void usage_error(char const * program, char const * message, std::string_view option)
+    {
+        std::cerr << message << option << "\n"
+            << "Usage: " << program << " [--filter <text>] [--samples <n>] [--min-time <s>] [--json <path>]" << std::endl;
+        std::exit(EXIT_FAILURE);
+    }
+
+    std::string filter_;
+    std::size_t min_samples_ = 30;
+    double min_time_ = 0.5;
+    std::string json_path_;
+    std::ofstream json_file_;
+};
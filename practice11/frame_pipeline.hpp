@@ -0,0 +1,129 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+// Runs a fixed-timestep simulation on a worker thread while the calling thread renders.
+// The renderer lets the simulation run ahead to some time and meanwhile draws the two latest
+// published snapshots, interpolated to its own clock. Snapshots are handed over by rotating
+// four buffers under a mutex, so neither thread waits for the other to finish a frame.
+template <typename Snapshot>
+struct frame_pipeline
+{
+    // step(dt, snapshot) advances the simulation by dt and writes its state into the snapshot.
+    // It is only ever called on the worker thread, and the buffer it gets may hold any older snapshot.
+    frame_pipeline(float time_step, std::function<void(float, Snapshot &)> step)
+        : time_step_(time_step)
+        , step_(std::move(step))
+        , worker_([this]{ run(); })
+    {}
+
+    ~frame_pipeline()
+    {
+        {
+            std::lock_guard lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_one();
+        worker_.join();
+    }
+
+    frame_pipeline(frame_pipeline const &) = delete;
+    frame_pipeline & operator = (frame_pipeline const &) = delete;
+
+    float time_step() const { return time_step_; }
+
+    // Lets the simulation run until its time reaches the given one
+    void advance_to(float time)
+    {
+        {
+            std::lock_guard lock(mutex_);
+            target_time_ = std::max(target_time_, time);
+        }
+        wake_.notify_one();
+    }
+
+    // Picks up the latest published snapshot, returns whether there was a new one
+    bool acquire()
+    {
+        std::lock_guard lock(mutex_);
+        if (!fresh_)
+            return false;
+
+        std::swap(previous_, front_);
+        std::swap(front_, ready_);
+        fresh_ = false;
+        return true;
+    }
+
+    // The two latest snapshots seen by acquire(), stable until the next call to it
+    Snapshot const & previous() const { return previous_->snapshot; }
+    Snapshot const & current() const { return front_->snapshot; }
+
+    // How far the given time is from the previous snapshot to the current one, in [0, 1]
+    float alpha(float time) const
+    {
+        float const span = front_->time - previous_->time;
+        if (span <= 0.f)
+            return 1.f;
+        return std::clamp((time - previous_->time) / span, 0.f, 1.f);
+    }
+
+private:
+    struct slot
+    {
+        Snapshot snapshot;
+        float time = 0.f;
+    };
+
+    // After a long stall (a breakpoint, a dragged window) the missed time is dropped instead of simulated
+    static constexpr int max_catch_up_steps = 4;
+
+    void run()
+    {
+        std::unique_lock lock(mutex_);
+        while (true)
+        {
+            wake_.wait(lock, [this]{ return stop_ || simulation_time_ < target_time_; });
+            if (stop_)
+                return;
+
+            simulation_time_ = std::max(simulation_time_, target_time_ - max_catch_up_steps * time_step_);
+
+            // Only this thread touches back_, the lock is needed just to publish it
+            lock.unlock();
+            step_(time_step_, back_->snapshot);
+            lock.lock();
+
+            simulation_time_ += time_step_;
+            back_->time = simulation_time_;
+            std::swap(back_, ready_);
+            fresh_ = true;
+        }
+    }
+
+    float time_step_;
+    std::function<void(float, Snapshot &)> step_;
+
+    // back_ is written by the worker, ready_ is the latest published snapshot,
+    // front_ and previous_ are read by the renderer
+    slot slots_[4];
+    slot * back_ = &slots_[0];
+    slot * ready_ = &slots_[1];
+    slot * front_ = &slots_[2];
+    slot * previous_ = &slots_[3];
+    bool fresh_ = false;
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    float target_time_ = 0.f;
+    float simulation_time_ = 0.f;
+    bool stop_ = false;
+
+    // Started last, once everything it uses is initialized
+    std::thread worker_;
+};
@@ -28,6 +28,8 @@
 
 #include "obj_parser.hpp"
 #include "stb_image.h"
+#include "particle_system.hpp"
+#include "frame_pipeline.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -165,29 +167,6 @@ GLuint create_program(Shaders ... shaders)
     return result;
 }
 
-std::random_device rd;
-std::mt19937 seed(rd());
-
-std::uniform_real_distribution<float> position_generator(-0.05f, 0.05f);
-std::uniform_real_distribution<float> size_generator(0.2f, 0.4f);
-std::uniform_real_distribution<float> velocity_generator(-0.2f, 0.2f);
-std::uniform_real_distribution<float> angular_velocity_generator(-M_PI, M_PI);
-struct particle
-{
-    glm::vec3 position;
-    float size;
-    glm::vec3 velocity;
-    float rotation;
-    float angular_velocity;
-
-    particle() {
-        position = glm::vec3(position_generator(seed), position_generator(seed), position_generator(seed));
-        size = 0.3f * size_generator(seed);
-        velocity = glm::vec3(velocity_generator(seed), 0.5f + velocity_generator(seed), velocity_generator(seed));
-        angular_velocity = angular_velocity_generator(seed);
-    }
-};
-
 int main() try
 {
     if (SDL_Init(SDL_INIT_VIDEO) != 0)
@@ -238,6 +217,17 @@ int main() try
     GLuint particle_texture_location = glGetUniformLocation(program, "particle_texture");
     GLuint color_texture_location = glGetUniformLocation(program, "color_texture");
 
+    // The simulation runs on the pipeline worker from here on, the render thread only sees its snapshots
+    particle_system simulation;
+    frame_pipeline<std::vector<particle>> pipeline(1.f / 60.f, [&simulation](float dt, std::vector<particle> & snapshot)
+    {
+        simulation.update(dt);
+        snapshot = simulation.particles;
+    });
+
+    // Simulation time the frame is rendered at, a step behind the newest snapshot
+    float render_time = 0.f;
+    bool interpolate_steps = true;
     std::vector<particle> particles;
 
     GLuint vao, vbo;
@@ -323,6 +313,8 @@ int main() try
             button_down[event.key.keysym.sym] = true;
             if (event.key.keysym.sym == SDLK_SPACE)
                 paused = !paused;
+            if (event.key.keysym.sym == SDLK_i)
+                interpolate_steps = !interpolate_steps;
             break;
         case SDL_KEYUP:
             button_down[event.key.keysym.sym] = false;
@@ -347,25 +339,16 @@ int main() try
         if (button_down[SDLK_RIGHT])
             camera_rotation += 3.f * dt;
 
-        const float A = 0.1;
-        const float C = 0.1;
-        const float D = 0.3;
-        if (!paused) {
-            if (particles.size() < 256)
-                particles.emplace_back();
-
-            for (auto& particle: particles) {
-                particle.velocity.y += dt * A;
-                particle.position += particle.velocity * dt;
-                particle.velocity *= exp(- C * dt);
-                particle.size *= exp(- D * dt);
-
-                particle.rotation += dt * particle.angular_velocity;
+        // The worker computes the step after this one while this frame is drawn
+        if (!paused)
+            render_time += dt;
+        pipeline.advance_to(render_time + pipeline.time_step());
 
-                if (particle.position.y >= 1.6 || particle.size < 0.02)
-                    particle = {};
-            }
-        }
+        pipeline.acquire();
+        if (interpolate_steps)
+            interpolate(pipeline.previous(), pipeline.current(), pipeline.alpha(render_time), particles);
+        else
+            particles = pipeline.current();
 
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
         glEnable(GL_BLEND);
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <cstddef>
+
+inline std::size_t worker_count()
+{
+    return std::max<std::size_t>(1, std::thread::hardware_concurrency());
+}
+
+// Splits [0, count) into one contiguous chunk per worker and calls
+// f(chunk_index, begin, end) for each of them, the last chunk on the calling thread
+template <typename F>
+void parallel_chunks(std::size_t count, std::size_t chunks, F && f)
+{
+    if (chunks <= 1 || count < chunks)
+    {
+        f(std::size_t(0), std::size_t(0), count);
+        return;
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(chunks - 1);
+
+    auto chunk_begin = [&](std::size_t chunk) { return count * chunk / chunks; };
+
+    for (std::size_t chunk = 0; chunk + 1 < chunks; ++chunk)
+        threads.emplace_back([&f, chunk, begin = chunk_begin(chunk), end = chunk_begin(chunk + 1)]{ f(chunk, begin, end); });
+
+    f(chunks - 1, chunk_begin(chunks - 1), count);
+
+    for (auto & thread : threads)
+        thread.join();
+}
+
+template <typename F>
+void parallel_for(std::size_t count, F && f)
+{
+    // Spawning threads is not free, small workloads are better done in place
+    static constexpr std::size_t min_items_per_worker = 4096;
+
+    std::size_t const chunks = std::min(worker_count(), std::max<std::size_t>(1, count / min_items_per_worker));
+
+    parallel_chunks(count, chunks, [&](std::size_t, std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i = begin; i < end; ++i)
+            f(i);
+    });
+}
@@ -0,0 +1,82 @@
+#include "particle_grid.hpp"
+
+#include <glm/common.hpp>
+
+#include <bit>
+
+particle_grid::particle_grid(float cell_size)
+    : cell_size(cell_size)
+{
+    bucket_start.assign(2 * brick_cells + 1, 0);
+}
+
+glm::ivec3 particle_grid::cell_coords(glm::vec3 const & p) const
+{
+    return glm::ivec3(glm::floor(p / cell_size));
+}
+
+std::uint64_t particle_grid::cell_key(glm::ivec3 const & c)
+{
+    constexpr std::uint64_t mask = (1u << 21) - 1;
+    return (std::uint64_t(c.x) & mask) | ((std::uint64_t(c.y) & mask) << 21) | ((std::uint64_t(c.z) & mask) << 42);
+}
+
+std::uint32_t particle_grid::brick_bucket(glm::ivec3 const & brick) const
+{
+    // Fibonacci hashing, the top bits of the product are the best mixed
+    return std::uint32_t((cell_key(brick) * 0x9e3779b97f4a7c15ull) >> brick_hash_shift_) * brick_cells;
+}
+
+std::uint32_t particle_grid::local_bucket(glm::ivec3 const & c)
+{
+    glm::ivec3 const local = c & (brick_size - 1);
+    return (((local.z << brick_shift) | local.y) << brick_shift) | local.x;
+}
+
+std::uint32_t particle_grid::bucket(glm::ivec3 const & c) const
+{
+    return brick_bucket(c >> brick_shift) + local_bucket(c);
+}
+
+void particle_grid::sort(std::size_t count)
+{
+    // Twice as many buckets as particles keeps the collisions rare
+    std::size_t const buckets = std::bit_ceil(std::max<std::size_t>(2 * brick_cells, 2 * count));
+    brick_hash_shift_ = 64 - std::countr_zero(buckets / brick_cells);
+    bucket_start.resize(buckets + 1);
+
+    chunks_ = std::min(worker_count(), std::max<std::size_t>(1, count / 65536));
+    chunk_counts_.assign(chunks_ * buckets, 0);
+    sorted_indices.resize(count);
+
+    // Every chunk of particles counts its own histogram, so no atomics are needed
+    parallel_chunks(count, chunks_, [&](std::size_t chunk, std::size_t begin, std::size_t end)
+    {
+        std::uint32_t * counts = chunk_counts_.data() + chunk * buckets;
+        for (std::size_t i = begin; i < end; ++i)
+            ++counts[bucket(particle_cell_[i])];
+    });
+
+    // Turn the histograms into per-chunk write offsets: for a fixed bucket, chunks
+    // write one after another, so the sort is stable and deterministic
+    std::uint32_t offset = 0;
+    for (std::size_t b = 0; b < buckets; ++b)
+    {
+        bucket_start[b] = offset;
+        for (std::size_t chunk = 0; chunk < chunks_; ++chunk)
+        {
+            std::uint32_t & n = chunk_counts_[chunk * buckets + b];
+            std::uint32_t const chunk_offset = offset;
+            offset += n;
+            n = chunk_offset;
+        }
+    }
+    bucket_start[buckets] = offset;
+
+    parallel_chunks(count, chunks_, [&](std::size_t chunk, std::size_t begin, std::size_t end)
+    {
+        std::uint32_t * offsets = chunk_counts_.data() + chunk * buckets;
+        for (std::size_t i = begin; i < end; ++i)
+            sorted_indices[offsets[bucket(particle_cell_[i])]++] = i;
+    });
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <glm/geometric.hpp>
+#include <glm/common.hpp>
+
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+#include "parallel.hpp"
+
+// Hashed uniform grid, rebuilt from scratch every frame with a parallel counting sort. Cells are unbounded and
+// grouped into bricks of brick_size^3 cells; a brick is hashed to brick_cells consecutive buckets, one per cell,
+// in a table sized to the particle count, so a build is linear in the number of particles no matter how large
+// the space they fly around in. Inside a brick the cells are laid out like a dense grid, so a query hashes one
+// to eight bricks and reads every row of cells as a single range of buckets. Cells colliding in the table share
+// a bucket; every particle keeps its cell key, so queries skip the particles of the other cells.
+struct particle_grid
+{
+    explicit particle_grid(float cell_size);
+
+    // position(i) must return the position of the i-th particle
+    template <typename Position>
+    void build(std::size_t count, Position && position);
+
+    // Calls f(index, position) for every particle closer than radius to p, including p itself if it is a particle
+    template <typename F>
+    void for_each_neighbour(glm::vec3 const & p, float radius, F && f) const;
+
+    static constexpr int brick_shift = 2;
+    static constexpr int brick_size = 1 << brick_shift;
+    static constexpr std::size_t brick_cells = brick_size * brick_size * brick_size;
+
+    glm::ivec3 cell_coords(glm::vec3 const & p) const;
+    // 21 bits per coordinate, cells further than a million cells from the origin wrap around
+    static std::uint64_t cell_key(glm::ivec3 const & c);
+    // The cells of a brick own brick_cells consecutive buckets starting at brick_bucket(c >> brick_shift),
+    // ordered like a dense grid with x the fastest
+    std::uint32_t brick_bucket(glm::ivec3 const & brick) const;
+    static std::uint32_t local_bucket(glm::ivec3 const & c);
+    std::uint32_t bucket(glm::ivec3 const & c) const;
+
+    float cell_size;
+
+    // Particles of bucket b are sorted_indices[bucket_start[b] .. bucket_start[b + 1])
+    std::vector<std::uint32_t> bucket_start;
+    std::vector<std::uint32_t> sorted_indices;
+    std::vector<std::uint64_t> sorted_keys;
+    std::vector<glm::vec3> sorted_positions;
+
+private:
+    void sort(std::size_t count);
+
+    int brick_hash_shift_ = 63;
+    std::vector<glm::ivec3> particle_cell_;
+    std::vector<std::uint32_t> chunk_counts_;
+    std::size_t chunks_ = 1;
+};
+
+template <typename Position>
+void particle_grid::build(std::size_t count, Position && position)
+{
+    particle_cell_.resize(count);
+    sorted_keys.resize(count);
+    sorted_positions.resize(count);
+
+    parallel_for(count, [&](std::size_t i)
+    {
+        particle_cell_[i] = cell_coords(position(i));
+    });
+
+    sort(count);
+
+    parallel_for(count, [&](std::size_t i)
+    {
+        sorted_keys[i] = cell_key(particle_cell_[sorted_indices[i]]);
+        sorted_positions[i] = position(sorted_indices[i]);
+    });
+}
+
+template <typename F>
+void particle_grid::for_each_neighbour(glm::vec3 const & p, float radius, F && f) const
+{
+    glm::ivec3 const lo = cell_coords(p - glm::vec3(radius));
+    glm::ivec3 const hi = cell_coords(p + glm::vec3(radius));
+    float const radius2 = radius * radius;
+
+    // Hash every brick the query box touches once, its rows of cells are then ranges of consecutive buckets
+    glm::ivec3 const brick_lo = lo >> brick_shift;
+    glm::ivec3 const brick_hi = hi >> brick_shift;
+    for (int bz = brick_lo.z; bz <= brick_hi.z; ++bz)
+    {
+        for (int by = brick_lo.y; by <= brick_hi.y; ++by)
+        {
+            for (int bx = brick_lo.x; bx <= brick_hi.x; ++bx)
+            {
+                glm::ivec3 const brick(bx, by, bz);
+                glm::ivec3 const first = glm::max(lo, brick << brick_shift);
+                glm::ivec3 const last = glm::min(hi, (brick << brick_shift) + (brick_size - 1));
+                std::uint32_t const base = brick_bucket(brick);
+
+                for (int z = first.z; z <= last.z; ++z)
+                {
+                    for (int y = first.y; y <= last.y; ++y)
+                    {
+                        std::uint64_t const first_key = cell_key({first.x, y, z});
+                        std::uint64_t const last_key = cell_key({last.x, y, z});
+                        std::uint32_t const begin = bucket_start[base + local_bucket({first.x, y, z})];
+                        std::uint32_t const end = bucket_start[base + local_bucket({last.x, y, z}) + 1];
+
+                        for (std::uint32_t i = begin; i < end; ++i)
+                        {
+                            // Skips the particles of other bricks hashed to the same buckets
+                            if (sorted_keys[i] < first_key || sorted_keys[i] > last_key)
+                                continue;
+
+                            glm::vec3 const d = sorted_positions[i] - p;
+                            if (glm::dot(d, d) <= radius2)
+                                f(sorted_indices[i], sorted_positions[i]);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
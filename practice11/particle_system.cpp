@@ -0,0 +1,138 @@
+#include "particle_system.hpp"
+
+#include <glm/geometric.hpp>
+#include <glm/common.hpp>
+#include <glm/ext/scalar_constants.hpp>
+
+#include <random>
+#include <cmath>
+#include <algorithm>
+
+#include "parallel.hpp"
+
+namespace
+{
+
+    std::random_device rd;
+    std::mt19937 seed(rd());
+
+    std::uniform_real_distribution<float> position_generator(-0.05f, 0.05f);
+    std::uniform_real_distribution<float> size_generator(0.2f, 0.4f);
+    std::uniform_real_distribution<float> velocity_generator(-0.2f, 0.2f);
+    std::uniform_real_distribution<float> angular_velocity_generator(-glm::pi<float>(), glm::pi<float>());
+
+}
+
+particle::particle()
+{
+    position = glm::vec3(position_generator(seed), position_generator(seed), position_generator(seed));
+    size = 0.3f * size_generator(seed);
+    velocity = glm::vec3(velocity_generator(seed), 0.5f + velocity_generator(seed), velocity_generator(seed));
+    rotation = 0.f;
+    angular_velocity = angular_velocity_generator(seed);
+}
+
+void interpolate(std::vector<particle> const & previous, std::vector<particle> const & current, float alpha, std::vector<particle> & result)
+{
+    result = current;
+
+    std::size_t const count = std::min(previous.size(), current.size());
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        auto const & a = previous[i];
+        auto & b = result[i];
+        if (b.spawn != a.spawn)
+            continue;
+
+        b.position = glm::mix(a.position, b.position, alpha);
+        b.size = glm::mix(a.size, b.size, alpha);
+        b.rotation = glm::mix(a.rotation, b.rotation, alpha);
+    }
+}
+
+obj_data make_sphere(glm::vec3 const & center, float radius, int slices, int stacks)
+{
+    obj_data result;
+
+    for (int i = 0; i <= stacks; ++i)
+    {
+        float const theta = glm::pi<float>() * i / stacks;
+        for (int j = 0; j <= slices; ++j)
+        {
+            float const phi = 2.f * glm::pi<float>() * j / slices;
+            glm::vec3 const n(std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi));
+            glm::vec3 const p = center + radius * n;
+
+            auto & v = result.vertices.emplace_back();
+            v.position = {p.x, p.y, p.z};
+            v.normal = {n.x, n.y, n.z};
+            v.texcoord = {1.f * j / slices, 1.f * i / stacks};
+        }
+    }
+
+    for (int i = 0; i < stacks; ++i)
+    {
+        for (int j = 0; j < slices; ++j)
+        {
+            std::uint32_t const a = i * (slices + 1) + j;
+            std::uint32_t const b = a + slices + 1;
+            result.indices.insert(result.indices.end(), {a, a + 1, b, b, a + 1, b + 1});
+        }
+    }
+
+    return result;
+}
+
+particle_system::particle_system()
+    : grid_(interaction_radius)
+    , obstacle_(make_sphere({0.f, 0.8f, 0.f}, 0.2f, 32, 16), 0.02f, 0.1f)
+{}
+
+void particle_system::update(float dt)
+{
+    const float A = 0.1;
+    const float C = 0.1;
+    const float D = 0.3;
+
+    if (particles.size() < max_particles)
+        particles.emplace_back();
+
+    grid_.build(particles.size(), [&](std::size_t i) { return particles[i].position; });
+
+    // Soft repulsion between close particles, a minimal SPH-like pressure term. Particles are visited
+    // in grid order, so consecutive queries read the same buckets.
+    separation_.assign(particles.size(), glm::vec3(0.f));
+    parallel_for(particles.size(), [&](std::size_t k)
+    {
+        std::uint32_t const i = grid_.sorted_indices[k];
+        glm::vec3 const p = grid_.sorted_positions[k];
+        grid_.for_each_neighbour(p, interaction_radius, [&](std::uint32_t j, glm::vec3 const & q)
+        {
+            if (j == i)
+                return;
+            glm::vec3 const d = p - q;
+            float const distance = glm::length(d);
+            if (distance > 1e-6f)
+                separation_[i] += d / distance * (1.f - distance / interaction_radius);
+        });
+    });
+
+    for (std::size_t i = 0; i < particles.size(); ++i) {
+        auto & particle = particles[i];
+        particle.velocity += separation_[i] * dt;
+        particle.velocity.y += dt * A;
+        particle.position += particle.velocity * dt;
+        particle.velocity *= std::exp(- C * dt);
+        particle.size *= std::exp(- D * dt);
+
+        particle.rotation += dt * particle.angular_velocity;
+
+        obstacle_.collide(particle.position, particle.velocity, 0.f, 0.2f, 0.1f);
+
+        if (particle.position.y >= 1.6 || particle.size < 0.02) {
+            std::uint32_t const spawn = particle.spawn;
+            particle = {};
+            particle.spawn = spawn + 1;
+        }
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+#include "obj_parser.hpp"
+#include "particle_grid.hpp"
+#include "sdf_volume.hpp"
+
+struct particle
+{
+    glm::vec3 position;
+    float size;
+    glm::vec3 velocity;
+    float rotation;
+    float angular_velocity;
+    // How many times the slot was re-emitted, so that a fresh particle is never blended with the one it replaced
+    std::uint32_t spawn = 0;
+
+    // A fresh particle with random position, size and velocity near the emitter
+    particle();
+};
+
+// Blends two consecutive simulation steps for rendering between them. A particle re-emitted
+// between the steps (its spawn counter changed) is taken from the current step as is.
+void interpolate(std::vector<particle> const & previous, std::vector<particle> const & current, float alpha, std::vector<particle> & result);
+
+// Closed UV sphere, used as an obstacle for the particles
+obj_data make_sphere(glm::vec3 const & center, float radius, int slices, int stacks);
+
+// Particles rising from the origin, pushing each other apart and bouncing off a sphere
+struct particle_system
+{
+    particle_system();
+
+    // Emits a particle if there is room for it and advances the simulation by dt
+    void update(float dt);
+
+    std::vector<particle> particles;
+    std::size_t max_particles = 256;
+
+    // Particles interact with each other within this radius
+    static constexpr float interaction_radius = 0.05f;
+
+private:
+    particle_grid grid_;
+    std::vector<glm::vec3> separation_;
+    sdf_volume obstacle_;
+};
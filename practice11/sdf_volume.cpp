@@ -0,0 +1,282 @@
+#include "sdf_volume.hpp"
+#include "parallel.hpp"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+namespace
+{
+
+    // Part of a triangle a closest point lies on, it picks the pseudo-normal that gives the sign
+    enum feature
+    {
+        face,
+        vertex_a,
+        vertex_b,
+        vertex_c,
+        edge_ab,
+        edge_bc,
+        edge_ca,
+        feature_count,
+    };
+
+    struct closest
+    {
+        glm::vec3 point;
+        feature on;
+    };
+
+    // Closest point on a triangle, "Real-Time Collision Detection" 5.1.5
+    closest closest_point(glm::vec3 const & p, glm::vec3 const & a, glm::vec3 const & b, glm::vec3 const & c)
+    {
+        glm::vec3 const ab = b - a;
+        glm::vec3 const ac = c - a;
+        glm::vec3 const ap = p - a;
+
+        float const d1 = glm::dot(ab, ap);
+        float const d2 = glm::dot(ac, ap);
+        if (d1 <= 0.f && d2 <= 0.f) return {a, vertex_a};
+
+        glm::vec3 const bp = p - b;
+        float const d3 = glm::dot(ab, bp);
+        float const d4 = glm::dot(ac, bp);
+        if (d3 >= 0.f && d4 <= d3) return {b, vertex_b};
+
+        float const vc = d1 * d4 - d3 * d2;
+        if (vc <= 0.f && d1 >= 0.f && d3 <= 0.f)
+            return {a + ab * (d1 / (d1 - d3)), edge_ab};
+
+        glm::vec3 const cp = p - c;
+        float const d5 = glm::dot(ab, cp);
+        float const d6 = glm::dot(ac, cp);
+        if (d6 >= 0.f && d5 <= d6) return {c, vertex_c};
+
+        float const vb = d5 * d2 - d1 * d6;
+        if (vb <= 0.f && d2 >= 0.f && d6 <= 0.f)
+            return {a + ac * (d2 / (d2 - d6)), edge_ca};
+
+        float const va = d3 * d6 - d5 * d4;
+        if (va <= 0.f && (d4 - d3) >= 0.f && (d5 - d6) >= 0.f)
+            return {b + (c - b) * ((d4 - d3) / ((d4 - d3) + (d5 - d6))), edge_bc};
+
+        float const denom = 1.f / (va + vb + vc);
+        return {a + ab * (vb * denom) + ac * (vc * denom), face};
+    }
+
+    // Angle-weighted pseudo-normals, Baerentzen and Aanaes 2005: the sign of dot(p - q, n) is right for
+    // whichever feature q lies on, unlike with the face normal, which flips near edges and vertices.
+    // Vertices closer than a tiny tolerance are welded first, so that the seams and poles of UV-mapped
+    // meshes, whose copies of a vertex differ in the last bits, are not open edges.
+    std::vector<std::array<glm::vec3, feature_count>> pseudo_normals(std::vector<glm::vec3> const & positions, std::vector<std::uint32_t> const & indices)
+    {
+        glm::vec3 min(std::numeric_limits<float>::infinity());
+        glm::vec3 max(-std::numeric_limits<float>::infinity());
+        for (auto const & p : positions)
+        {
+            min = glm::min(min, p);
+            max = glm::max(max, p);
+        }
+        float const tolerance = std::max(1e-6f * glm::distance(min, max), std::numeric_limits<float>::min());
+
+        auto cell_hash = [](glm::ivec3 const & c)
+        {
+            return std::hash<std::uint64_t>()((std::uint64_t(std::uint32_t(c.x)) * 73856093u) ^ (std::uint64_t(std::uint32_t(c.y)) * 19349663u) ^ (std::uint64_t(std::uint32_t(c.z)) * 83492791u));
+        };
+
+        std::unordered_map<glm::ivec3, std::uint32_t, decltype(cell_hash)> welded(positions.size(), cell_hash);
+        std::vector<std::uint32_t> vertex(positions.size());
+        for (std::size_t i = 0; i < positions.size(); ++i)
+            vertex[i] = welded.try_emplace(glm::ivec3(glm::round((positions[i] - min) / tolerance)), welded.size()).first->second;
+
+        auto edge_key = [&](std::uint32_t i, std::uint32_t j)
+        {
+            i = vertex[i];
+            j = vertex[j];
+            return (std::uint64_t(std::min(i, j)) << 32) | std::max(i, j);
+        };
+
+        std::size_t const triangles = indices.size() / 3;
+        std::vector<glm::vec3> face_normals(triangles, glm::vec3(0.f));
+        std::vector<glm::vec3> vertex_normals(welded.size(), glm::vec3(0.f));
+        std::unordered_map<std::uint64_t, glm::vec3> edge_normals;
+
+        for (std::size_t t = 0; t < triangles; ++t)
+        {
+            std::uint32_t const * v = indices.data() + 3 * t;
+            // Degenerate triangles, like the ones at the poles of a UV sphere, have no direction to add;
+            // their normal would be rounding noise, and they are left out of the distance field too
+            if (vertex[v[0]] == vertex[v[1]] || vertex[v[1]] == vertex[v[2]] || vertex[v[2]] == vertex[v[0]])
+                continue;
+
+            glm::vec3 const n = glm::cross(positions[v[1]] - positions[v[0]], positions[v[2]] - positions[v[0]]);
+            float const length = glm::length(n);
+            if (length == 0.f)
+                continue;
+            face_normals[t] = n / length;
+
+            for (int k = 0; k < 3; ++k)
+            {
+                glm::vec3 const & p = positions[v[k]];
+                glm::vec3 const e0 = positions[v[(k + 1) % 3]] - p;
+                glm::vec3 const e1 = positions[v[(k + 2) % 3]] - p;
+                float const angle = std::acos(std::clamp(glm::dot(e0, e1) / (glm::length(e0) * glm::length(e1)), -1.f, 1.f));
+                vertex_normals[vertex[v[k]]] += angle * face_normals[t];
+                edge_normals[edge_key(v[k], v[(k + 1) % 3])] += face_normals[t];
+            }
+        }
+
+        std::vector<std::array<glm::vec3, feature_count>> result(triangles);
+        for (std::size_t t = 0; t < triangles; ++t)
+        {
+            std::uint32_t const * v = indices.data() + 3 * t;
+            result[t] = {
+                face_normals[t],
+                vertex_normals[vertex[v[0]]],
+                vertex_normals[vertex[v[1]]],
+                vertex_normals[vertex[v[2]]],
+                edge_normals[edge_key(v[0], v[1])],
+                edge_normals[edge_key(v[1], v[2])],
+                edge_normals[edge_key(v[2], v[0])],
+            };
+        }
+        return result;
+    }
+
+    std::vector<glm::vec3> positions_of(obj_data const & mesh)
+    {
+        std::vector<glm::vec3> result;
+        result.reserve(mesh.vertices.size());
+        for (auto const & v : mesh.vertices)
+            result.emplace_back(v.position[0], v.position[1], v.position[2]);
+        return result;
+    }
+
+}
+
+sdf_volume::sdf_volume(std::vector<glm::vec3> const & positions, std::vector<std::uint32_t> const & indices, float voxel_size, float band)
+    : voxel_size(voxel_size)
+    , band(band)
+{
+    min = glm::vec3(std::numeric_limits<float>::infinity());
+    max = -min;
+    for (auto const & p : positions)
+    {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+    min -= glm::vec3(band + voxel_size);
+    max += glm::vec3(band + voxel_size);
+
+    size = glm::ivec3(glm::ceil((max - min) / voxel_size)) + 1;
+    values.assign(std::size_t(size.x) * size.y * size.z, band);
+
+    std::vector<float> unsigned_distance(values.size(), band);
+    auto const normals = pseudo_normals(positions, indices);
+
+    // Every slice along z is owned by exactly one worker, so triangles can be splatted without locking
+    parallel_chunks(size.z, std::min<std::size_t>(worker_count(), size.z), [&](std::size_t, std::size_t z_begin, std::size_t z_end)
+    {
+        for (std::size_t t = 0; t + 2 < indices.size(); t += 3)
+        {
+            glm::vec3 const a = positions[indices[t + 0]];
+            glm::vec3 const b = positions[indices[t + 1]];
+            glm::vec3 const c = positions[indices[t + 2]];
+            auto const & n = normals[t / 3];
+            if (n[face] == glm::vec3(0.f))
+                continue;
+
+            glm::ivec3 lo = glm::ivec3(glm::floor((glm::min(a, glm::min(b, c)) - band - min) / voxel_size));
+            glm::ivec3 hi = glm::ivec3(glm::ceil((glm::max(a, glm::max(b, c)) + band - min) / voxel_size));
+            lo = glm::max(lo, glm::ivec3(0, 0, z_begin));
+            hi = glm::min(hi, glm::ivec3(size.x - 1, size.y - 1, int(z_end) - 1));
+
+            for (int z = lo.z; z <= hi.z; ++z)
+            for (int y = lo.y; y <= hi.y; ++y)
+            for (int x = lo.x; x <= hi.x; ++x)
+            {
+                glm::vec3 const p = min + glm::vec3(x, y, z) * voxel_size;
+                auto const q = closest_point(p, a, b, c);
+                float const d = glm::distance(p, q.point);
+
+                std::size_t const i = x + size.x * (y + std::size_t(size.y) * z);
+                if (d < unsigned_distance[i])
+                {
+                    unsigned_distance[i] = d;
+                    values[i] = (glm::dot(p - q.point, n[q.on]) < 0.f) ? -d : d;
+                }
+            }
+        }
+    });
+}
+
+sdf_volume::sdf_volume(obj_data const & mesh, float voxel_size, float band)
+    : sdf_volume(positions_of(mesh), mesh.indices, voxel_size, band)
+{}
+
+float sdf_volume::value(int x, int y, int z) const
+{
+    x = std::clamp(x, 0, size.x - 1);
+    y = std::clamp(y, 0, size.y - 1);
+    z = std::clamp(z, 0, size.z - 1);
+    return values[x + size.x * (y + std::size_t(size.y) * z)];
+}
+
+float sdf_volume::distance(glm::vec3 const & p) const
+{
+    glm::vec3 const g = (p - min) / voxel_size;
+    glm::vec3 const f = glm::floor(g);
+    glm::vec3 const t = g - f;
+    glm::ivec3 const i(f);
+
+    if (glm::any(glm::lessThan(i, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(i + 1, size)))
+        return band;
+
+    auto lerp = [](float a, float b, float t){ return a + (b - a) * t; };
+
+    float const v00 = lerp(value(i.x, i.y    , i.z    ), value(i.x + 1, i.y    , i.z    ), t.x);
+    float const v10 = lerp(value(i.x, i.y + 1, i.z    ), value(i.x + 1, i.y + 1, i.z    ), t.x);
+    float const v01 = lerp(value(i.x, i.y    , i.z + 1), value(i.x + 1, i.y    , i.z + 1), t.x);
+    float const v11 = lerp(value(i.x, i.y + 1, i.z + 1), value(i.x + 1, i.y + 1, i.z + 1), t.x);
+
+    return lerp(lerp(v00, v10, t.y), lerp(v01, v11, t.y), t.z);
+}
+
+glm::vec3 sdf_volume::gradient(glm::vec3 const & p) const
+{
+    float const h = voxel_size * 0.5f;
+    return glm::vec3(
+        distance(p + glm::vec3(h, 0.f, 0.f)) - distance(p - glm::vec3(h, 0.f, 0.f)),
+        distance(p + glm::vec3(0.f, h, 0.f)) - distance(p - glm::vec3(0.f, h, 0.f)),
+        distance(p + glm::vec3(0.f, 0.f, h)) - distance(p - glm::vec3(0.f, 0.f, h))
+    ) / (2.f * h);
+}
+
+bool sdf_volume::collide(glm::vec3 & position, glm::vec3 & velocity, float radius, float restitution, float friction) const
+{
+    float const d = distance(position) - radius;
+    if (d >= 0.f)
+        return false;
+
+    glm::vec3 n = gradient(position);
+    float const length = glm::length(n);
+    if (length < 1e-6f)
+        return false;
+    n /= length;
+
+    position -= n * d;
+
+    float const vn = glm::dot(velocity, n);
+    if (vn < 0.f)
+    {
+        glm::vec3 const tangent = velocity - vn * n;
+        velocity = tangent * (1.f - friction) - restitution * vn * n;
+    }
+
+    return true;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include <vector>
+#include <cstdint>
+
+#include "obj_parser.hpp"
+
+// Narrow-band signed distance field of a triangle mesh sampled on a regular grid.
+// Voxels farther than band from the surface store +band, so only collisions
+// with the surface itself are resolved, not with the deep interior.
+struct sdf_volume
+{
+    sdf_volume(std::vector<glm::vec3> const & positions, std::vector<std::uint32_t> const & indices, float voxel_size, float band);
+    sdf_volume(obj_data const & mesh, float voxel_size, float band);
+
+    float distance(glm::vec3 const & p) const;
+    glm::vec3 gradient(glm::vec3 const & p) const;
+
+    // Pushes a sphere out of the surface and reflects its velocity; returns whether a collision happened
+    bool collide(glm::vec3 & position, glm::vec3 & velocity, float radius, float restitution, float friction) const;
+
+    glm::vec3 min;
+    glm::vec3 max;
+    float voxel_size;
+    float band;
+    glm::ivec3 size;
+    std::vector<float> values;
+
+private:
+    float value(int x, int y, int z) const;
+};
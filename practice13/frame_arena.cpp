@@ -0,0 +1,157 @@
+#include "frame_arena.hpp"
+
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+#include <stdexcept>
+
+namespace
+{
+
+    thread_local frame_arena * current_arena = nullptr;
+
+#ifndef NDEBUG
+    thread_local bool count_heap_allocations = false;
+    thread_local std::size_t heap_allocations = 0;
+#endif
+
+    std::size_t align_up(std::size_t value, std::size_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+
+}
+
+#ifndef NDEBUG
+
+// Counts every general-heap allocation made by a thread inside its frame
+
+void * operator new(std::size_t size)
+{
+    if (count_heap_allocations)
+        ++heap_allocations;
+
+    if (void * result = std::malloc(size ? size : 1))
+        return result;
+    throw std::bad_alloc();
+}
+
+void operator delete(void * pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void * pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+#endif
+
+struct frame_arena::overflow_chunk
+{
+    overflow_chunk * next;
+};
+
+frame_arena::frame_arena(std::size_t capacity)
+{
+    for (auto & b : blocks_)
+    {
+        b.data.reset(new std::byte[capacity]);
+        b.capacity = capacity;
+    }
+}
+
+frame_arena::~frame_arena()
+{
+    for (auto & b : blocks_)
+        release_overflow(b);
+
+    if (current_arena == this)
+        current_arena = nullptr;
+}
+
+frame_arena & frame_arena::current()
+{
+    if (!current_arena)
+        throw std::logic_error("No frame_arena has begun a frame on this thread");
+    return *current_arena;
+}
+
+void frame_arena::release_overflow(block & b)
+{
+    while (b.overflow)
+    {
+        auto next = b.overflow->next;
+        std::free(b.overflow);
+        b.overflow = next;
+    }
+}
+
+void frame_arena::begin_frame()
+{
+    current_ ^= 1;
+    auto & b = blocks_[current_];
+
+    // Overflowing means the frames got bigger, grow the block to fit everything next time
+    if (b.overflow)
+    {
+        release_overflow(b);
+        b.capacity = align_up(b.offset + b.overflow_size, 4096);
+        b.data.reset(new std::byte[b.capacity]);
+    }
+
+    b.offset = 0;
+    b.overflow_size = 0;
+    used_ = 0;
+
+    current_arena = this;
+
+#ifndef NDEBUG
+    heap_allocations = 0;
+    count_heap_allocations = true;
+#endif
+}
+
+std::size_t frame_arena::end_frame()
+{
+    ++frames_;
+#ifndef NDEBUG
+    count_heap_allocations = false;
+    if (heap_allocations > 0)
+    {
+        ++allocating_frames_;
+        total_heap_allocations_ += heap_allocations;
+    }
+    return heap_allocations;
+#else
+    return 0;
+#endif
+}
+
+void * frame_arena::allocate(std::size_t size, std::size_t alignment)
+{
+    auto & b = blocks_[current_];
+    used_ += size;
+
+    auto const base = reinterpret_cast<std::uintptr_t>(b.data.get());
+    std::size_t const offset = align_up(base + b.offset, alignment) - base;
+    if (offset + size <= b.capacity)
+    {
+        b.offset = offset + size;
+        return b.data.get() + offset;
+    }
+
+    // Rare: serve from the C heap (so the debug counter only sees general-purpose allocations)
+    std::size_t const header = align_up(sizeof(overflow_chunk), alignment);
+    auto chunk = static_cast<overflow_chunk *>(std::malloc(header + size + alignment));
+    if (!chunk)
+        throw std::bad_alloc();
+
+    chunk->next = b.overflow;
+    b.overflow = chunk;
+    b.overflow_size += size + alignment;
+
+    auto const start = reinterpret_cast<std::uintptr_t>(chunk) + header;
+    return reinterpret_cast<void *>(align_up(start, alignment));
+}
@@ -3,7 +3,10 @@
 #include <rapidjson/document.h>
 #include <rapidjson/istreamwrapper.h>
 
+#include <array>
+#include <cstring>
 #include <fstream>
+#include <map>
 #include <stdexcept>
 
 static unsigned int attribute_type_to_size(std::string const & type)
@@ -16,6 +19,21 @@ static unsigned int attribute_type_to_size(std::string const & type)
     throw std::runtime_error("Unknown attribute type: " + type);
 }
 
+static unsigned int component_type_to_size(unsigned int type)
+{
+    switch (type)
+    {
+    case 0x1400: // GL_BYTE
+    case 0x1401: // GL_UNSIGNED_BYTE
+        return 1;
+    case 0x1402: // GL_SHORT
+    case 0x1403: // GL_UNSIGNED_SHORT
+        return 2;
+    default:
+        return 4;
+    }
+}
+
 gltf_model load_gltf(std::filesystem::path const & path)
 {
     rapidjson::Document document;
@@ -44,14 +62,21 @@ gltf_model load_gltf(std::filesystem::path const & path)
     auto parse_buffer_view = [&](int index) -> gltf_model::buffer_view
     {
         auto view = document["bufferViews"].GetArray()[index].GetObject();
-        return {view["byteOffset"].GetUint(), view["byteLength"].GetUint()};
+        return {
+            view.HasMember("byteOffset") ? view["byteOffset"].GetUint() : 0u,
+            view["byteLength"].GetUint(),
+            view.HasMember("byteStride") ? view["byteStride"].GetUint() : 0u,
+        };
     };
 
     auto parse_accessor = [&](int index) -> gltf_model::accessor
     {
         auto accessor = document["accessors"].GetArray()[index].GetObject();
+        auto view = parse_buffer_view(accessor["bufferView"].GetInt());
+        if (accessor.HasMember("byteOffset"))
+            view.offset += accessor["byteOffset"].GetUint();
         return {
-            parse_buffer_view(accessor["bufferView"].GetInt()),
+            view,
             accessor["componentType"].GetUint(),
             attribute_type_to_size(accessor["type"].GetString()),
             accessor["count"].GetUint(),
@@ -117,7 +142,7 @@ gltf_model load_gltf(std::filesystem::path const & path)
             vector.assign(begin, begin + accessor.count);
         };
 
-        auto fix_rotations = [](std::vector<glm::quat> & rotations)
+        auto fix_rotations = [](auto & rotations)
         {
             for (auto & r : rotations)
                 r = glm::quat(r.z, r.w, r.x, r.y);
@@ -131,7 +156,7 @@ gltf_model load_gltf(std::filesystem::path const & path)
         result.bones.resize(joints.Size());
 
         std::unordered_map<int, int> bone_node_to_index;
-        for (int i = 0; i < joints.Size(); ++i)
+        for (int i = 0; i < int(joints.Size()); ++i)
         {
             int const node_id = joints[i].GetInt();
             bone_node_to_index[node_id] = i;
@@ -141,7 +166,7 @@ gltf_model load_gltf(std::filesystem::path const & path)
 
         auto nodes = document["nodes"].GetArray();
 
-        for (int i = 0; i < nodes.Size(); ++i)
+        for (int i = 0; i < int(nodes.Size()); ++i)
         {
             if (!bone_node_to_index.contains(i)) continue;
 
@@ -157,7 +182,7 @@ gltf_model load_gltf(std::filesystem::path const & path)
             }
         }
 
-        for (int i = 0; i < result.bones.size(); ++i)
+        for (int i = 0; i < int(result.bones.size()); ++i)
             assert(result.bones[i].parent == -1 || result.bones[i].parent < i);
 
         for (auto const & animation : document["animations"].GetArray())
@@ -201,7 +226,7 @@ gltf_model load_gltf(std::filesystem::path const & path)
                 }
             }
 
-            auto update_max_time = [&](std::vector<float> const & timestamps)
+            auto update_max_time = [&](auto const & timestamps)
             {
                 for (float t : timestamps)
                     result_animation.max_time = std::max(result_animation.max_time, t);
@@ -220,3 +245,68 @@ gltf_model load_gltf(std::filesystem::path const & path)
 
     return result;
 }
+
+packed_vertices pack_vertices(gltf_model const & model)
+{
+    packed_vertices result;
+
+    // GL wants every attribute aligned to its component size, 4 bytes covers them all
+    auto align = [](std::size_t offset) { return (offset + 3) / 4 * 4; };
+
+    // Primitives drawing the same data share it in the packed buffer too
+    std::map<std::pair<unsigned int, unsigned int>, gltf_model::primitive> packed;
+
+    for (auto const & mesh : model.meshes)
+    {
+        auto & result_mesh = result.meshes.emplace_back();
+        for (auto const & primitive : mesh.primitives)
+        {
+            auto [it, inserted] = packed.try_emplace({primitive.position.view.offset, primitive.indices.view.offset}, primitive);
+            if (inserted)
+            {
+                auto & result_primitive = it->second;
+                auto const attributes = std::array{&primitive.position, &primitive.normal, &primitive.texcoord, &primitive.joints, &primitive.weights};
+
+                unsigned int stride = 0;
+                std::array<unsigned int, attributes.size()> offsets;
+                unsigned int const count = primitive.position.count;
+                for (std::size_t i = 0; i < attributes.size(); ++i)
+                {
+                    if (attributes[i]->count != count)
+                        throw std::runtime_error("Vertex attributes of a primitive have different counts");
+
+                    offsets[i] = stride;
+                    stride += align(attributes[i]->size * component_type_to_size(attributes[i]->type));
+                }
+
+                unsigned int const vertices = align(result.buffer.size());
+                result.buffer.resize(vertices + std::size_t(count) * stride);
+
+                for (std::size_t i = 0; i < attributes.size(); ++i)
+                {
+                    auto const & source = *attributes[i];
+
+                    unsigned int const element_size = source.size * component_type_to_size(source.type);
+                    unsigned int const source_stride = source.view.stride ? source.view.stride : element_size;
+                    for (unsigned int v = 0; v < count; ++v)
+                        std::memcpy(result.buffer.data() + vertices + std::size_t(v) * stride + offsets[i],
+                            model.buffer.data() + source.view.offset + std::size_t(v) * source_stride, element_size);
+                }
+
+                auto packed_attributes = std::array{&result_primitive.position, &result_primitive.normal, &result_primitive.texcoord, &result_primitive.joints, &result_primitive.weights};
+                for (std::size_t i = 0; i < attributes.size(); ++i)
+                    packed_attributes[i]->view = {vertices + offsets[i], count * stride, stride};
+
+                unsigned int const index_size = primitive.indices.count * component_type_to_size(primitive.indices.type);
+                unsigned int const indices = align(result.buffer.size());
+                result.buffer.resize(indices + index_size);
+                std::memcpy(result.buffer.data() + indices, model.buffer.data() + primitive.indices.view.offset, index_size);
+                result_primitive.indices.view = {indices, index_size};
+            }
+
+            result_mesh.push_back(it->second);
+        }
+    }
+
+    return result;
+}
@@ -14,12 +14,16 @@
 #include <glm/gtx/quaternion.hpp>
 #include <glm/gtx/compatibility.hpp>
 
+#include "memory_tracker.hpp"
+
 struct gltf_model
 {
     struct buffer_view
     {
         unsigned int offset;
         unsigned int size;
+        // Bytes between consecutive elements, 0 if they are tightly packed
+        unsigned int stride = 0;
     };
 
     struct accessor
@@ -40,7 +44,8 @@ struct gltf_model
 
     struct bone
     {
-        unsigned int parent = -1;
+        // -1 for the root bones
+        int parent = -1;
         std::string name;
         glm::mat4 inverse_bind_matrix;
     };
@@ -48,8 +53,8 @@ struct gltf_model
     template <typename T>
     struct spline
     {
-        std::vector<float> timestamps;
-        std::vector<T> values;
+        tracked_vector<float, memory_tag::animation> timestamps;
+        tracked_vector<T, memory_tag::animation> values;
 
         T operator()(float time) const;
     };
@@ -87,7 +92,7 @@ struct gltf_model
         std::vector<primitive> primitives;
     };
 
-    std::vector<char> buffer;
+    tracked_vector<char, memory_tag::mesh> buffer;
     std::vector<mesh> meshes;
     std::vector<bone> bones;
     std::unordered_map<std::string, animation> animations;
@@ -95,6 +100,18 @@ struct gltf_model
 
 gltf_model load_gltf(std::filesystem::path const & path);
 
+// The vertex and index data of the primitives, repacked for the GPU. The attributes of a vertex are
+// interleaved into one record, so that fetching a vertex touches one cache line instead of one per
+// attribute, and whatever the draws don't read (animations, skins, unused views) is left out.
+struct packed_vertices
+{
+    std::vector<char> buffer;
+    // Primitive j of mesh i, with the accessors pointing into buffer
+    std::vector<std::vector<gltf_model::primitive>> meshes;
+};
+
+packed_vertices pack_vertices(gltf_model const & model);
+
 template <>
 inline glm::vec3 gltf_model::spline<glm::vec3>::operator()(float time) const
 {
@@ -0,0 +1,169 @@
+#include "input_recording.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+#include <string_view>
+
+namespace
+{
+
+    constexpr char magic[4] = {'I', 'N', 'P', 'T'};
+    constexpr std::uint32_t version = 1;
+
+    // Events are stored as raw SDL_Event-s, so a recording only replays with the same SDL layout
+    struct file_header
+    {
+        char magic[4];
+        std::uint32_t version;
+        std::uint32_t event_size;
+    };
+
+    template <typename T>
+    void write(std::ostream & output, T const & value)
+    {
+        output.write(reinterpret_cast<char const *>(&value), sizeof(value));
+    }
+
+    template <typename T>
+    bool read(std::istream & input, T & value)
+    {
+        return static_cast<bool>(input.read(reinterpret_cast<char *>(&value), sizeof(value)));
+    }
+
+}
+
+input_recording::input_recording(int argc, char ** argv)
+{
+    for (int i = 1; i + 1 < argc; ++i)
+    {
+        std::string_view const option = argv[i];
+        std::string const path = argv[i + 1];
+
+        if (option == "--record")
+        {
+            output_.open(path, std::ios::binary);
+            if (!output_)
+                throw std::runtime_error("Failed to create input recording " + path);
+
+            write(output_, file_header{{magic[0], magic[1], magic[2], magic[3]}, version, sizeof(SDL_Event)});
+            mode_ = mode::record;
+        }
+        else if (option == "--time-step")
+            fixed_time_step_ = std::stof(path);
+        else if (option == "--replay")
+        {
+            std::ifstream input(path, std::ios::binary);
+            if (!input)
+                throw std::runtime_error("Failed to open input recording " + path);
+
+            file_header header;
+            if (!read(input, header) || std::memcmp(header.magic, magic, sizeof(magic)) != 0 || header.version != version)
+                throw std::runtime_error(path + " is not an input recording");
+            if (header.event_size != sizeof(SDL_Event))
+                throw std::runtime_error(path + " was recorded with a different SDL version");
+
+            frame f;
+            std::uint32_t event_count;
+            while (read(input, f.dt) && read(input, event_count))
+            {
+                f.events.resize(event_count);
+                if (!input.read(reinterpret_cast<char *>(f.events.data()), event_count * sizeof(SDL_Event)))
+                    throw std::runtime_error(path + " is truncated");
+                frames_.push_back(std::move(f));
+            }
+
+            mode_ = mode::replay;
+            replay_start_ = std::chrono::steady_clock::now();
+        }
+    }
+}
+
+input_recording::~input_recording()
+{
+    if (mode_ != mode::replay)
+        return;
+
+    float const seconds = std::chrono::duration<float>(std::chrono::steady_clock::now() - replay_start_).count();
+    std::cout << "Replayed " << frame_ << " frames in " << seconds << " s, "
+        << (frame_ > 0 ? 1000.f * seconds / frame_ : 0.f) << " ms per frame" << std::endl;
+}
+
+bool input_recording::recorded(SDL_Event const & event)
+{
+    switch (event.type)
+    {
+    case SDL_QUIT:
+    case SDL_WINDOWEVENT:
+    case SDL_KEYDOWN:
+    case SDL_KEYUP:
+    case SDL_TEXTINPUT:
+    case SDL_MOUSEMOTION:
+    case SDL_MOUSEBUTTONDOWN:
+    case SDL_MOUSEBUTTONUP:
+    case SDL_MOUSEWHEEL:
+        return true;
+    default:
+        return false;
+    }
+}
+
+bool input_recording::poll_event(SDL_Event & event)
+{
+    if (mode_ != mode::replay)
+    {
+        if (!SDL_PollEvent(&event))
+            return false;
+
+        if (mode_ == mode::record && recorded(event))
+            current_.events.push_back(event);
+        return true;
+    }
+
+    // Live input would make the frames differ, but the window can still be closed
+    while (SDL_PollEvent(&event))
+        if (event.type == SDL_QUIT)
+            return true;
+
+    if (finished() || event_ == frames_[frame_].events.size())
+        return false;
+
+    event = frames_[frame_].events[event_++];
+    return true;
+}
+
+float input_recording::time_step(float measured)
+{
+    if (fixed_time_step_ > 0.f)
+        measured = fixed_time_step_;
+
+    switch (mode_)
+    {
+    case mode::record:
+        current_.dt = measured;
+        return measured;
+    case mode::replay:
+        return finished() ? 0.f : frames_[frame_].dt;
+    default:
+        return measured;
+    }
+}
+
+void input_recording::end_frame()
+{
+    if (mode_ == mode::record)
+    {
+        write(output_, current_.dt);
+        write(output_, static_cast<std::uint32_t>(current_.events.size()));
+        output_.write(reinterpret_cast<char const *>(current_.events.data()), current_.events.size() * sizeof(SDL_Event));
+
+        current_.dt = 0.f;
+        current_.events.clear();
+    }
+    else if (mode_ == mode::replay && !finished())
+    {
+        ++frame_;
+        event_ = 0;
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#ifdef WIN32
+#include <SDL.h>
+#else
+#include <SDL2/SDL.h>
+#endif
+
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Records the input events and the time step of every frame to a file, or plays a recording back,
+// so that two runs (e.g. of two builds being compared) render exactly the same frames.
+//
+//   --record <file>  runs normally and saves the input and the frame time steps
+//   --replay <file>  ignores live input (except closing the window), uses the recorded
+//                    events and time steps instead of wall-clock time, and ends the
+//                    program when the recording is over, printing the replay time
+//   --time-step <s>  advances time by a fixed step every frame instead of the measured one,
+//                    so that the recorded time steps do not depend on the machine either
+struct input_recording
+{
+    input_recording(int argc, char ** argv);
+    ~input_recording();
+
+    // Drop-in replacement for SDL_PollEvent
+    bool poll_event(SDL_Event & event);
+
+    // Time step of the current frame: the measured (or fixed) one, or the recorded one when replaying
+    float time_step(float measured);
+
+    // Saves the frame when recording, moves to the next recorded frame when replaying
+    void end_frame();
+
+    bool replaying() const { return mode_ == mode::replay; }
+
+    // The last recorded frame has been played
+    bool finished() const { return replaying() && frame_ >= frames_.size(); }
+
+private:
+    enum class mode
+    {
+        off,
+        record,
+        replay,
+    };
+
+    struct frame
+    {
+        float dt = 0.f;
+        std::vector<SDL_Event> events;
+    };
+
+    static bool recorded(SDL_Event const & event);
+
+    mode mode_ = mode::off;
+    float fixed_time_step_ = 0.f;
+    std::ofstream output_;
+
+    // Frame being recorded, or all the frames of the recording being played
+    frame current_;
+    std::vector<frame> frames_;
+    std::size_t frame_ = 0;
+    std::size_t event_ = 0;
+
+    std::chrono::steady_clock::time_point replay_start_;
+};
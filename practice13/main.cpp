@@ -28,6 +28,10 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "gltf_loader.hpp"
+#include "frame_arena.hpp"
+#include "memory_tracker.hpp"
+#include "skeleton.hpp"
+#include "input_recording.hpp"
 #include "stb_image.h"
 
 std::string to_string(std::string_view str)
@@ -127,6 +131,21 @@ GLuint create_shader(GLenum type, const char * source)
     return result;
 }
 
+// glBufferData and glTexImage2D that keep the GPU memory statistics up to date
+void buffer_data(GLenum target, GLuint buffer, GLsizeiptr size, void const * data, GLenum usage)
+{
+    glBufferData(target, size, data, usage);
+    track_resource(memory_tag::gpu_buffer, buffer, size);
+}
+
+void texture_image_rgba8(GLuint texture, GLsizei width, GLsizei height, void const * data, bool mipmaps)
+{
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+    std::size_t const bytes = std::size_t(width) * height * 4;
+    // A full mipmap chain adds a third
+    track_resource(memory_tag::gpu_texture, texture, mipmaps ? bytes * 4 / 3 : bytes);
+}
+
 template <typename ... Shaders>
 GLuint create_program(Shaders ... shaders)
 {
@@ -148,8 +167,10 @@ GLuint create_program(Shaders ... shaders)
     return result;
 }
 
-int main() try
+int main(int argc, char ** argv) try
 {
+    input_recording recording(argc, argv);
+
     if (SDL_Init(SDL_INIT_VIDEO) != 0)
         sdl2_fail("SDL_Init: ");
 
@@ -203,10 +224,13 @@ int main() try
     const std::string model_path = project_root + "/dancing/dancing.gltf";
 
     auto const input_model = load_gltf(model_path);
+    auto const vertices = pack_vertices(input_model);
+    std::cout << "Vertex buffer: " << input_model.buffer.size() << " bytes in the file, " << vertices.buffer.size() << " bytes packed" << std::endl;
+
     GLuint vbo;
     glGenBuffers(1, &vbo);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, input_model.buffer.size(), input_model.buffer.data(), GL_STATIC_DRAW);
+    buffer_data(GL_ARRAY_BUFFER, vbo, vertices.buffer.size(), vertices.buffer.data(), GL_STATIC_DRAW);
 
     struct mesh
     {
@@ -219,15 +243,15 @@ int main() try
     {
         glEnableVertexAttribArray(index);
         if (integer)
-            glVertexAttribIPointer(index, accessor.size, accessor.type, 0, reinterpret_cast<void *>(accessor.view.offset));
+            glVertexAttribIPointer(index, accessor.size, accessor.type, accessor.view.stride, reinterpret_cast<void *>(accessor.view.offset));
         else
-            glVertexAttribPointer(index, accessor.size, accessor.type, GL_FALSE, 0, reinterpret_cast<void *>(accessor.view.offset));
+            glVertexAttribPointer(index, accessor.size, accessor.type, GL_FALSE, accessor.view.stride, reinterpret_cast<void *>(accessor.view.offset));
     };
 
     std::vector<mesh> meshes;
-    for (auto const & mesh : input_model.meshes)
+    for (auto const & mesh : vertices.meshes)
     {
-        for (auto const & primitive : mesh.primitives)
+        for (auto const & primitive : mesh)
         {
             auto & result = meshes.emplace_back();
             glGenVertexArrays(1, &result.vao);
@@ -257,16 +281,18 @@ int main() try
         int width, height, channels;
         auto data = stbi_load(path.c_str(), &width, &height, &channels, 4);
         assert(data);
+        track_allocation(memory_tag::texture, std::size_t(width) * height * 4);
 
         GLuint texture;
         glGenTextures(1, &texture);
         glBindTexture(GL_TEXTURE_2D, texture);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+        texture_image_rgba8(texture, width, height, data, true);
         glGenerateMipmap(GL_TEXTURE_2D);
 
         stbi_image_free(data);
+        track_deallocation(memory_tag::texture, std::size_t(width) * height * 4);
 
         textures[*mesh.material.texture_path] = texture;
     }
@@ -289,10 +315,12 @@ int main() try
 
     bool paused = false;
 
+    frame_arena arena;
+
     bool running = true;
     while (running)
     {
-        for (SDL_Event event; SDL_PollEvent(&event);) switch (event.type)
+        for (SDL_Event event; recording.poll_event(event);) switch (event.type)
         {
         case SDL_QUIT:
             running = false;
@@ -310,6 +338,13 @@ int main() try
             button_down[event.key.keysym.sym] = true;
             if (event.key.keysym.sym == SDLK_SPACE)
                 paused = !paused;
+            else if (event.key.keysym.sym == SDLK_m)
+                print_memory_report(std::cout);
+            else if (event.key.keysym.sym == SDLK_j)
+            {
+                std::ofstream report("memory_report.json");
+                write_memory_report_json(report);
+            }
             break;
         case SDL_KEYUP:
             button_down[event.key.keysym.sym] = false;
@@ -320,7 +355,7 @@ int main() try
             break;
 
         auto now = std::chrono::high_resolution_clock::now();
-        float dt = std::chrono::duration_cast<std::chrono::duration<float>>(now - last_frame_start).count();
+        float dt = recording.time_step(std::chrono::duration_cast<std::chrono::duration<float>>(now - last_frame_start).count());
         last_frame_start = now;
 
         if (!paused)
@@ -375,50 +410,18 @@ int main() try
         view = glm::rotate(view, camera_rotation, {0.f, 1.f, 0.f});
         view = glm::translate(view, {0.f, -camera_height, 0.f});
 
-        auto previous_animation = input_model.animations.at(previous_animation_name);
-        auto current_animation = input_model.animations.at(current_animation_name);
+        arena.begin_frame();
+
+        auto const & previous_animation = input_model.animations.at(previous_animation_name);
+        auto const & current_animation = input_model.animations.at(current_animation_name);
 
         float scale = 0.75f + cos(time) * 0.25f;
-        std::vector<glm::mat4x3> bones(input_model.bones.size(), glm::mat4x3(scale));
+        frame_vector<glm::mat4x3> bones(input_model.bones.size(), glm::mat4x3(scale));
 
         float previous_t = std::fmod(time, previous_animation.max_time);
         float current_t = std::fmod(time, current_animation.max_time);
         float interpolation_coef = std::min(time - animation_change_time, 1.f);
-        for (int i = 0; i < input_model.bones.size(); i++) {
-//            auto bone_animation = current_animation.bones[i];
-//            auto translation = glm::translate(glm::mat4(1.f), bone_animation.translation(current_t));
-//            auto scaling = glm::scale(glm::mat4(1.f), bone_animation.scale(current_t));
-//            auto rotation = glm::toMat4(bone_animation.rotation(current_t));
-
-            auto translation_interpolated = glm::lerp(
-                previous_animation.bones[i].translation(previous_t),
-                current_animation.bones[i].translation(current_t),
-                interpolation_coef
-            );
-            auto scaling_interpolated = glm::lerp(
-                    previous_animation.bones[i].scale(previous_t),
-                    current_animation.bones[i].scale(current_t),
-                    interpolation_coef
-            );
-            auto rotation_interpolated = glm::slerp(
-                    previous_animation.bones[i].rotation(previous_t),
-                    current_animation.bones[i].rotation(current_t),
-                    interpolation_coef
-            );
-
-            auto translation = glm::translate(glm::mat4(1.f), translation_interpolated);
-            auto scaling = glm::scale(glm::mat4(1.f), scaling_interpolated);
-            auto rotation = glm::toMat4(rotation_interpolated);
-
-            auto transform = translation * rotation * scaling;
-
-            if (input_model.bones[i].parent != -1)
-                transform = bones[input_model.bones[i].parent] * transform;
-            bones[i] = transform;
-        }
-
-        for (int i = 0; i < bones.size(); i++)
-            bones[i] = bones[i] * input_model.bones[i].inverse_bind_matrix;
+        compute_pose(input_model, previous_animation, previous_t, current_animation, current_t, interpolation_coef, bones);
 
         glm::mat4 projection = glm::perspective(glm::pi<float>() / 2.f, (1.f * width) / height, near, far);
 
@@ -474,10 +477,20 @@ int main() try
         glDepthMask(GL_TRUE);
 
         SDL_GL_SwapWindow(window);
+
+        track_frame(arena.used(), arena.end_frame());
+
+        recording.end_frame();
+        if (recording.finished())
+            running = false;
     }
 
     SDL_GL_DeleteContext(gl_context);
     SDL_DestroyWindow(window);
+
+    if (arena.allocating_frames() > 0)
+        std::cerr << arena.total_heap_allocations() << " heap allocations in " << arena.allocating_frames()
+            << " of " << arena.frames() << " frames of the frame loop" << std::endl;
 }
 catch (std::exception const & e)
 {
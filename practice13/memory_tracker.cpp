@@ -0,0 +1,170 @@
+#include "memory_tracker.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+
+namespace
+{
+
+    constexpr std::size_t tag_count = static_cast<std::size_t>(memory_tag::count);
+
+    struct tag_counters
+    {
+        std::atomic<std::size_t> bytes{0};
+        std::atomic<std::size_t> peak_bytes{0};
+        std::atomic<std::size_t> allocations{0};
+        std::atomic<std::size_t> deallocations{0};
+    };
+
+    tag_counters counters[tag_count];
+
+    // Sizes of the live GPU objects of every tag
+    std::mutex resources_mutex;
+    std::unordered_map<std::uint32_t, std::size_t> resources[tag_count];
+
+    frame_memory_usage frame_usage;
+
+    tag_counters & counters_of(memory_tag tag)
+    {
+        return counters[static_cast<std::size_t>(tag)];
+    }
+
+    void add_bytes(tag_counters & c, std::size_t bytes)
+    {
+        std::size_t const total = c.bytes += bytes;
+        std::size_t peak = c.peak_bytes.load();
+        while (total > peak && !c.peak_bytes.compare_exchange_weak(peak, total))
+            ;
+    }
+
+}
+
+char const * memory_tag_name(memory_tag tag)
+{
+    switch (tag)
+    {
+    case memory_tag::mesh: return "mesh";
+    case memory_tag::animation: return "animation";
+    case memory_tag::texture: return "texture";
+    case memory_tag::gpu_buffer: return "gpu_buffer";
+    case memory_tag::gpu_texture: return "gpu_texture";
+    default: return "unknown";
+    }
+}
+
+void track_allocation(memory_tag tag, std::size_t bytes)
+{
+    auto & c = counters_of(tag);
+    add_bytes(c, bytes);
+    ++c.allocations;
+}
+
+void track_deallocation(memory_tag tag, std::size_t bytes)
+{
+    auto & c = counters_of(tag);
+    c.bytes -= bytes;
+    ++c.deallocations;
+}
+
+void track_resource(memory_tag tag, std::uint32_t id, std::size_t bytes)
+{
+    std::lock_guard lock(resources_mutex);
+
+    auto & sizes = resources[static_cast<std::size_t>(tag)];
+    if (auto it = sizes.find(id); it != sizes.end())
+    {
+        track_deallocation(tag, it->second);
+        it->second = bytes;
+    }
+    else
+        sizes.emplace(id, bytes);
+
+    track_allocation(tag, bytes);
+}
+
+void untrack_resource(memory_tag tag, std::uint32_t id)
+{
+    std::lock_guard lock(resources_mutex);
+
+    auto & sizes = resources[static_cast<std::size_t>(tag)];
+    if (auto it = sizes.find(id); it != sizes.end())
+    {
+        track_deallocation(tag, it->second);
+        sizes.erase(it);
+    }
+}
+
+void track_frame(std::size_t arena_bytes, std::size_t heap_allocations)
+{
+    ++frame_usage.frames;
+    frame_usage.arena_bytes = arena_bytes;
+    frame_usage.peak_arena_bytes = std::max(frame_usage.peak_arena_bytes, arena_bytes);
+    frame_usage.heap_allocations = heap_allocations;
+    frame_usage.total_heap_allocations += heap_allocations;
+}
+
+memory_usage get_memory_usage(memory_tag tag)
+{
+    auto const & c = counters_of(tag);
+
+    memory_usage result;
+    result.bytes = c.bytes;
+    result.peak_bytes = c.peak_bytes;
+    result.allocations = c.allocations;
+    result.deallocations = c.deallocations;
+    return result;
+}
+
+frame_memory_usage get_frame_memory_usage()
+{
+    return frame_usage;
+}
+
+void print_memory_report(std::ostream & output)
+{
+    output << std::left << std::setw(14) << "tag" << std::right
+        << std::setw(14) << "bytes" << std::setw(14) << "peak"
+        << std::setw(12) << "allocs" << std::setw(12) << "frees" << '\n';
+
+    for (std::size_t i = 0; i < tag_count; ++i)
+    {
+        auto const tag = static_cast<memory_tag>(i);
+        auto const usage = get_memory_usage(tag);
+        output << std::left << std::setw(14) << memory_tag_name(tag) << std::right
+            << std::setw(14) << usage.bytes << std::setw(14) << usage.peak_bytes
+            << std::setw(12) << usage.allocations << std::setw(12) << usage.deallocations << '\n';
+    }
+
+    auto const frame = get_frame_memory_usage();
+    output << "frame: " << frame.arena_bytes << " arena bytes (peak " << frame.peak_arena_bytes << "), "
+        << frame.heap_allocations << " heap allocations in the last frame, "
+        << frame.total_heap_allocations << " in " << frame.frames << " frames" << std::endl;
+}
+
+void write_memory_report_json(std::ostream & output)
+{
+    output << "{\n";
+    for (std::size_t i = 0; i < tag_count; ++i)
+    {
+        auto const tag = static_cast<memory_tag>(i);
+        auto const usage = get_memory_usage(tag);
+        output << "  \"" << memory_tag_name(tag) << "\": {"
+            << "\"bytes\": " << usage.bytes
+            << ", \"peak_bytes\": " << usage.peak_bytes
+            << ", \"allocations\": " << usage.allocations
+            << ", \"deallocations\": " << usage.deallocations << "},\n";
+    }
+
+    auto const frame = get_frame_memory_usage();
+    output << "  \"frame\": {"
+        << "\"frames\": " << frame.frames
+        << ", \"arena_bytes\": " << frame.arena_bytes
+        << ", \"peak_arena_bytes\": " << frame.peak_arena_bytes
+        << ", \"heap_allocations\": " << frame.heap_allocations
+        << ", \"total_heap_allocations\": " << frame.total_heap_allocations << "}\n";
+    output << "}\n";
+}
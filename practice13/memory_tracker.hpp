@@ -0,0 +1,91 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <vector>
+
+// What the memory is used for. CPU-side tags are counted by tracked_allocator,
+// GPU tags by the buffer and texture creation wrappers through track_resource.
+enum class memory_tag
+{
+    mesh,
+    animation,
+    texture,
+    gpu_buffer,
+    gpu_texture,
+    count,
+};
+
+char const * memory_tag_name(memory_tag tag);
+
+struct memory_usage
+{
+    std::size_t bytes = 0;
+    std::size_t peak_bytes = 0;
+    std::size_t allocations = 0;
+    std::size_t deallocations = 0;
+};
+
+// Transient per-frame memory: frame arena usage and general-heap allocations inside the frame loop
+struct frame_memory_usage
+{
+    std::size_t frames = 0;
+    std::size_t arena_bytes = 0;
+    std::size_t peak_arena_bytes = 0;
+    std::size_t heap_allocations = 0;
+    std::size_t total_heap_allocations = 0;
+};
+
+void track_allocation(memory_tag tag, std::size_t bytes);
+void track_deallocation(memory_tag tag, std::size_t bytes);
+
+// GPU objects are re-specified in place (glBufferData on an existing buffer),
+// so they are tracked by name: the new size replaces the old one
+void track_resource(memory_tag tag, std::uint32_t id, std::size_t bytes);
+void untrack_resource(memory_tag tag, std::uint32_t id);
+
+void track_frame(std::size_t arena_bytes, std::size_t heap_allocations);
+
+memory_usage get_memory_usage(memory_tag tag);
+frame_memory_usage get_frame_memory_usage();
+
+// Human-readable table and a JSON object with the same numbers, for comparing runs
+void print_memory_report(std::ostream & output);
+void write_memory_report_json(std::ostream & output);
+
+template <typename T, memory_tag Tag>
+struct tracked_allocator
+{
+    using value_type = T;
+
+    template <typename U>
+    struct rebind
+    {
+        using other = tracked_allocator<U, Tag>;
+    };
+
+    tracked_allocator() = default;
+
+    template <typename U>
+    tracked_allocator(tracked_allocator<U, Tag> const &) {}
+
+    T * allocate(std::size_t n)
+    {
+        track_allocation(Tag, n * sizeof(T));
+        return std::allocator<T>().allocate(n);
+    }
+
+    void deallocate(T * p, std::size_t n)
+    {
+        track_deallocation(Tag, n * sizeof(T));
+        std::allocator<T>().deallocate(p, n);
+    }
+
+    template <typename U>
+    bool operator == (tracked_allocator<U, Tag> const &) const { return true; }
+};
+
+template <typename T, memory_tag Tag>
+using tracked_vector = std::vector<T, tracked_allocator<T, Tag>>;
@@ -0,0 +1,41 @@
+#include "skeleton.hpp"
+
+#include <glm/ext/matrix_transform.hpp>
+
+void compute_pose(gltf_model const & model,
+    gltf_model::animation const & from, float from_time,
+    gltf_model::animation const & to, float to_time,
+    float blend, std::span<glm::mat4x3> bones)
+{
+    for (std::size_t i = 0; i < model.bones.size(); i++) {
+        auto translation_interpolated = glm::lerp(
+            from.bones[i].translation(from_time),
+            to.bones[i].translation(to_time),
+            blend
+        );
+        auto scaling_interpolated = glm::lerp(
+                from.bones[i].scale(from_time),
+                to.bones[i].scale(to_time),
+                blend
+        );
+        auto rotation_interpolated = glm::slerp(
+                from.bones[i].rotation(from_time),
+                to.bones[i].rotation(to_time),
+                blend
+        );
+
+        auto translation = glm::translate(glm::mat4(1.f), translation_interpolated);
+        auto scaling = glm::scale(glm::mat4(1.f), scaling_interpolated);
+        auto rotation = glm::toMat4(rotation_interpolated);
+
+        auto transform = translation * rotation * scaling;
+
+        // Parents come before their children, so their global transforms are ready
+        if (model.bones[i].parent != -1)
+            transform = bones[model.bones[i].parent] * transform;
+        bones[i] = transform;
+    }
+
+    for (std::size_t i = 0; i < model.bones.size(); i++)
+        bones[i] = bones[i] * model.bones[i].inverse_bind_matrix;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <span>
+
+#include <glm/mat4x3.hpp>
+
+#include "gltf_loader.hpp"
+
+// Skinning matrices of every bone for a blend of two animations:
+// blend = 0 is the from pose at from_time, blend = 1 is the to pose at to_time
+void compute_pose(gltf_model const & model,
+    gltf_model::animation const & from, float from_time,
+    gltf_model::animation const & to, float to_time,
+    float blend, std::span<glm::mat4x3> bones);
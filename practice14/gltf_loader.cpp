@@ -3,8 +3,16 @@
 #include <rapidjson/document.h>
 #include <rapidjson/istreamwrapper.h>
 
+#include <array>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
+#include <functional>
+#include <map>
 #include <stdexcept>
+#include <string_view>
+
+#include <glm/ext/matrix_transform.hpp>
 
 static unsigned int attribute_type_to_size(std::string const & type)
 {
@@ -15,6 +23,35 @@ static unsigned int attribute_type_to_size(std::string const & type)
     return 0;
 }
 
+static unsigned int component_type_to_size(unsigned int type)
+{
+    switch (type)
+    {
+    case 0x1400: // GL_BYTE
+    case 0x1401: // GL_UNSIGNED_BYTE
+        return 1;
+    case 0x1402: // GL_SHORT
+    case 0x1403: // GL_UNSIGNED_SHORT
+        return 2;
+    default:
+        return 4;
+    }
+}
+
+// FNV-1a
+static std::uint64_t hash(void const * data, std::size_t size, std::uint64_t h = 14695981039346656037ull)
+{
+    auto bytes = static_cast<unsigned char const *>(data);
+    for (std::size_t i = 0; i < size; ++i)
+        h = (h ^ bytes[i]) * 1099511628211ull;
+    return h;
+}
+
+static glm::mat4 translate_rotate_scale(glm::vec3 const & translation, glm::quat const & rotation, glm::vec3 const & scale)
+{
+    return glm::translate(glm::mat4(1.f), translation) * glm::toMat4(rotation) * glm::scale(glm::mat4(1.f), scale);
+}
+
 gltf_model load_gltf(std::filesystem::path const & path)
 {
     rapidjson::Document document;
@@ -43,18 +80,31 @@ gltf_model load_gltf(std::filesystem::path const & path)
     auto parse_buffer_view = [&](int index) -> gltf_model::buffer_view
     {
         auto view = document["bufferViews"].GetArray()[index].GetObject();
-        return {view["byteOffset"].GetUint(), view["byteLength"].GetUint()};
+        return {
+            view.HasMember("byteOffset") ? view["byteOffset"].GetUint() : 0u,
+            view["byteLength"].GetUint(),
+            view.HasMember("byteStride") ? view["byteStride"].GetUint() : 0u,
+        };
     };
 
     auto parse_accessor = [&](int index) -> gltf_model::accessor
     {
         auto accessor = document["accessors"].GetArray()[index].GetObject();
-        return {
-            parse_buffer_view(accessor["bufferView"].GetInt()),
+        auto view = parse_buffer_view(accessor["bufferView"].GetInt());
+        if (accessor.HasMember("byteOffset"))
+            view.offset += accessor["byteOffset"].GetUint();
+        gltf_model::accessor parsed{
+            view,
             accessor["componentType"].GetUint(),
             attribute_type_to_size(accessor["type"].GetString()),
             accessor["count"].GetUint(),
         };
+
+        std::size_t const element_size = parsed.size * component_type_to_size(parsed.type);
+        std::size_t const stride = view.stride ? view.stride : element_size;
+        if (parsed.count > 0 && view.offset + (parsed.count - 1) * stride + element_size > result.buffer.size())
+            throw std::runtime_error("Accessor out of the buffer bounds");
+        return parsed;
     };
 
     auto parse_texture = [&](int index) -> std::string
@@ -95,29 +145,322 @@ gltf_model load_gltf(std::filesystem::path const & path)
     {
         auto & result_mesh = result.meshes.emplace_back();
         result_mesh.name = mesh["name"].GetString();
+        result_mesh.original = result.meshes.size() - 1;
+
+        for (auto const & primitive : mesh["primitives"].GetArray())
+        {
+            auto & result_primitive = result_mesh.primitives.emplace_back();
+
+            auto const & attributes = primitive["attributes"];
+
+            result_primitive.indices = parse_accessor(primitive["indices"].GetInt());
+            result_primitive.position = parse_accessor(attributes["POSITION"].GetInt());
+            result_primitive.normal = parse_accessor(attributes["NORMAL"].GetInt());
+            result_primitive.texcoord = parse_accessor(attributes["TEXCOORD_0"].GetInt());
+
+            std::tie(result_primitive.min, result_primitive.max) = parse_bounds(attributes["POSITION"].GetInt());
+
+            auto const & material = document["materials"].GetArray()[primitive["material"].GetInt()];
+
+            result_primitive.material.two_sided = material.HasMember("doubleSided") && material["doubleSided"].GetBool();
+            result_primitive.material.transparent = material.HasMember("alphaMode") && (material["alphaMode"].GetString() == std::string("BLEND"));
+
+            auto const & pbr = material["pbrMetallicRoughness"];
+            if (pbr.HasMember("baseColorTexture"))
+                result_primitive.material.texture_path = parse_texture(pbr["baseColorTexture"]["index"].GetInt());
+            else if (pbr.HasMember("baseColorFactor"))
+                result_primitive.material.color = parse_color(pbr["baseColorFactor"].GetArray());
+        }
+    }
+
+    // Exporters write a copy of the mesh for every object even when the objects are copies of each other.
+    // Meshes are compared by a hash of their contents first and byte by byte only when the hashes match.
+    {
+        // Calls f(bytes) for every run of consecutive elements of the accessor: once for a tightly
+        // packed view, once per element for an interleaved one
+        auto for_each_run = [&](gltf_model::accessor const & accessor, auto && f)
+        {
+            std::size_t const element_size = accessor.size * component_type_to_size(accessor.type);
+            char const * data = result.buffer.data() + accessor.view.offset;
+            if (accessor.view.stride == 0 || accessor.view.stride == element_size)
+            {
+                f(std::string_view(data, accessor.count * element_size));
+                return;
+            }
+
+            for (unsigned int i = 0; i < accessor.count; ++i)
+                f(std::string_view(data + std::size_t(i) * accessor.view.stride, element_size));
+        };
+
+        // FNV-1a hashes bytes one by one, so hashing the runs of for_each_run in order gives the same hash for
+        // interleaved and packed copies of the same data, and same_data compares them equal too
+        auto same_data = [&](gltf_model::accessor const & a, gltf_model::accessor const & b)
+        {
+            if (a.type != b.type || a.size != b.size || a.count != b.count)
+                return false;
+
+            std::size_t const element_size = a.size * component_type_to_size(a.type);
+            std::size_t const stride_a = a.view.stride ? a.view.stride : element_size;
+            std::size_t const stride_b = b.view.stride ? b.view.stride : element_size;
+            for (unsigned int i = 0; i < a.count; ++i)
+            {
+                char const * element_a = result.buffer.data() + a.view.offset + i * stride_a;
+                char const * element_b = result.buffer.data() + b.view.offset + i * stride_b;
+                if (std::memcmp(element_a, element_b, element_size) != 0)
+                    return false;
+            }
+            return true;
+        };
+
+        auto primitive_accessors = [](gltf_model::primitive const & primitive)
+        {
+            return std::array{&primitive.indices, &primitive.position, &primitive.normal, &primitive.texcoord};
+        };
+
+        auto same_material = [](gltf_model::material const & a, gltf_model::material const & b)
+        {
+            return a.two_sided == b.two_sided && a.transparent == b.transparent && a.texture_path == b.texture_path && a.color == b.color;
+        };
+
+        auto same_mesh = [&](gltf_model::mesh const & a, gltf_model::mesh const & b)
+        {
+            if (a.primitives.size() != b.primitives.size())
+                return false;
+
+            for (std::size_t i = 0; i < a.primitives.size(); ++i)
+            {
+                if (!same_material(a.primitives[i].material, b.primitives[i].material))
+                    return false;
+
+                auto const accessors_a = primitive_accessors(a.primitives[i]);
+                auto const accessors_b = primitive_accessors(b.primitives[i]);
+                for (std::size_t j = 0; j < accessors_a.size(); ++j)
+                {
+                    if (!same_data(*accessors_a[j], *accessors_b[j]))
+                        return false;
+                }
+            }
+
+            return true;
+        };
+
+        std::unordered_multimap<std::uint64_t, unsigned int> originals;
+        for (unsigned int i = 0; i < result.meshes.size(); ++i)
+        {
+            auto & mesh = result.meshes[i];
+
+            std::uint64_t h = hash(nullptr, 0);
+            for (auto const & primitive : mesh.primitives)
+            {
+                for (auto accessor : primitive_accessors(primitive))
+                    for_each_run(*accessor, [&](std::string_view bytes){ h = hash(bytes.data(), bytes.size(), h); });
+            }
+
+            auto [begin, end] = originals.equal_range(h);
+            auto original = std::find_if(begin, end, [&](auto const & candidate){ return same_mesh(result.meshes[candidate.second], mesh); });
+            if (original == end)
+            {
+                originals.emplace(h, i);
+                continue;
+            }
+
+            mesh.original = original->second;
+            mesh.primitives = result.meshes[mesh.original].primitives;
+        }
+    }
+
+    auto parse_float_accessor = [&]<typename T>(int index, std::vector<T> & values)
+    {
+        auto const accessor = parse_accessor(index);
+        if (accessor.type != 0x1406) // GL_FLOAT
+            throw std::runtime_error("Only float instance transforms are supported");
+
+        // Interleaved views are read element by element
+        std::size_t const stride = accessor.view.stride ? accessor.view.stride : sizeof(T);
+        values.resize(accessor.count);
+        for (std::size_t i = 0; i < values.size(); ++i)
+            std::memcpy(&values[i], result.buffer.data() + accessor.view.offset + i * stride, sizeof(T));
+    };
+
+    if (document.HasMember("nodes"))
+    {
+        auto const nodes = document["nodes"].GetArray();
+        for (auto const & node : nodes)
+        {
+            auto & result_node = result.nodes.emplace_back();
+            if (node.HasMember("name"))
+                result_node.name = node["name"].GetString();
+            if (node.HasMember("mesh"))
+                result_node.mesh = node["mesh"].GetUint();
+
+            if (node.HasMember("matrix"))
+            {
+                auto const matrix = node["matrix"].GetArray();
+                for (int i = 0; i < 16; ++i)
+                    result_node.local[i / 4][i % 4] = matrix[i].GetFloat();
+            }
+            else
+            {
+                glm::vec3 translation(0.f);
+                glm::quat rotation(1.f, 0.f, 0.f, 0.f);
+                glm::vec3 scale(1.f);
+
+                if (node.HasMember("translation"))
+                    translation = parse_vector(node["translation"]);
+                if (node.HasMember("rotation"))
+                {
+                    auto const & r = node["rotation"];
+                    rotation = glm::quat(r[3].GetFloat(), r[0].GetFloat(), r[1].GetFloat(), r[2].GetFloat());
+                }
+                if (node.HasMember("scale"))
+                    scale = parse_vector(node["scale"]);
+
+                result_node.local = translate_rotate_scale(translation, rotation, scale);
+            }
+
+            result_node.world = glm::mat4(0.f);
+        }
+
+        for (unsigned int i = 0; i < nodes.Size(); ++i)
+        {
+            if (nodes[i].HasMember("children"))
+                for (auto const & child : nodes[i]["children"].GetArray())
+                    result.nodes[child.GetUint()].parent = i;
+        }
+
+        // The default scene, or every root node if the file has no scenes
+        std::vector<unsigned int> roots;
+        if (document.HasMember("scenes"))
+        {
+            auto const scene = document.HasMember("scene") ? document["scene"].GetUint() : 0u;
+            for (auto const & root : document["scenes"].GetArray()[scene]["nodes"].GetArray())
+                roots.push_back(root.GetUint());
+        }
+        else
+        {
+            for (unsigned int i = 0; i < result.nodes.size(); ++i)
+                if (result.nodes[i].parent == -1)
+                    roots.push_back(i);
+        }
+
+        std::unordered_map<unsigned int, std::size_t> mesh_batches;
+
+        std::function<void(unsigned int, glm::mat4 const &)> visit = [&](unsigned int index, glm::mat4 const & parent_world)
+        {
+            auto & result_node = result.nodes[index];
+            result_node.world = parent_world * result_node.local;
+
+            auto const & node = nodes[index];
+            if (node.HasMember("extensions") && node["extensions"].HasMember("EXT_mesh_gpu_instancing"))
+            {
+                auto const & attributes = node["extensions"]["EXT_mesh_gpu_instancing"]["attributes"];
+
+                std::vector<glm::vec3> translations;
+                std::vector<glm::vec4> rotations;
+                std::vector<glm::vec3> scales;
+                if (attributes.HasMember("TRANSLATION"))
+                    parse_float_accessor(attributes["TRANSLATION"].GetInt(), translations);
+                if (attributes.HasMember("ROTATION"))
+                    parse_float_accessor(attributes["ROTATION"].GetInt(), rotations);
+                if (attributes.HasMember("SCALE"))
+                    parse_float_accessor(attributes["SCALE"].GetInt(), scales);
+
+                std::size_t const count = std::max({translations.size(), rotations.size(), scales.size()});
+                for (std::size_t i = 0; i < count; ++i)
+                {
+                    glm::vec3 const translation = i < translations.size() ? translations[i] : glm::vec3(0.f);
+                    glm::vec4 const r = i < rotations.size() ? rotations[i] : glm::vec4(0.f, 0.f, 0.f, 1.f);
+                    glm::vec3 const scale = i < scales.size() ? scales[i] : glm::vec3(1.f);
+                    result_node.instances.push_back(result_node.world * translate_rotate_scale(translation, glm::quat(r.w, r.x, r.y, r.z), scale));
+                }
+            }
+
+            if (result_node.mesh)
+            {
+                unsigned int const mesh = result.meshes[*result_node.mesh].original;
+                auto [it, inserted] = mesh_batches.try_emplace(mesh, result.batches.size());
+                if (inserted)
+                    result.batches.push_back({mesh, {}});
+
+                auto & transforms = result.batches[it->second].transforms;
+                if (result_node.instances.empty())
+                    transforms.push_back(result_node.world);
+                else
+                    transforms.insert(transforms.end(), result_node.instances.begin(), result_node.instances.end());
+            }
+
+            if (node.HasMember("children"))
+                for (auto const & child : node["children"].GetArray())
+                    visit(child.GetUint(), result_node.world);
+        };
+
+        for (auto root : roots)
+            visit(root, glm::mat4(1.f));
+    }
+
+    return result;
+}
+
+packed_vertices pack_vertices(gltf_model const & model)
+{
+    packed_vertices result;
+
+    // GL wants every attribute aligned to its component size, 4 bytes covers them all
+    auto align = [](std::size_t offset) { return (offset + 3) / 4 * 4; };
+
+    // Primitives drawing the same data share it in the packed buffer too
+    std::map<std::pair<unsigned int, unsigned int>, gltf_model::primitive> packed;
+
+    for (auto const & mesh : model.meshes)
+    {
+        auto & result_mesh = result.meshes.emplace_back();
+        for (auto const & primitive : mesh.primitives)
+        {
+            auto [it, inserted] = packed.try_emplace({primitive.position.view.offset, primitive.indices.view.offset}, primitive);
+            if (inserted)
+            {
+                auto & result_primitive = it->second;
+                auto const attributes = std::array{&primitive.position, &primitive.normal, &primitive.texcoord};
+
+                unsigned int stride = 0;
+                std::array<unsigned int, attributes.size()> offsets;
+                unsigned int const count = primitive.position.count;
+                for (std::size_t i = 0; i < attributes.size(); ++i)
+                {
+                    if (attributes[i]->count != count)
+                        throw std::runtime_error("Vertex attributes of a primitive have different counts");
 
-        auto primitives = mesh["primitives"].GetArray();
-        assert(primitives.Size() == 1);
+                    offsets[i] = stride;
+                    stride += align(attributes[i]->size * component_type_to_size(attributes[i]->type));
+                }
 
-        auto const & attributes = primitives[0]["attributes"];
+                unsigned int const vertices = align(result.buffer.size());
+                result.buffer.resize(vertices + std::size_t(count) * stride);
 
-        result_mesh.indices = parse_accessor(primitives[0]["indices"].GetInt());
-        result_mesh.position = parse_accessor(attributes["POSITION"].GetInt());
-        result_mesh.normal = parse_accessor(attributes["NORMAL"].GetInt());
-        result_mesh.texcoord = parse_accessor(attributes["TEXCOORD_0"].GetInt());
+                for (std::size_t i = 0; i < attributes.size(); ++i)
+                {
+                    auto const & source = *attributes[i];
 
-        std::tie(result_mesh.min, result_mesh.max) = parse_bounds(attributes["POSITION"].GetInt());
+                    unsigned int const element_size = source.size * component_type_to_size(source.type);
+                    unsigned int const source_stride = source.view.stride ? source.view.stride : element_size;
+                    for (unsigned int v = 0; v < count; ++v)
+                        std::memcpy(result.buffer.data() + vertices + std::size_t(v) * stride + offsets[i],
+                            model.buffer.data() + source.view.offset + std::size_t(v) * source_stride, element_size);
+                }
 
-        auto const & material = document["materials"].GetArray()[primitives[0]["material"].GetInt()];
+                auto packed_attributes = std::array{&result_primitive.position, &result_primitive.normal, &result_primitive.texcoord};
+                for (std::size_t i = 0; i < attributes.size(); ++i)
+                    packed_attributes[i]->view = {vertices + offsets[i], count * stride, stride};
 
-        result_mesh.material.two_sided = material.HasMember("doubleSided") && material["doubleSided"].GetBool();
-        result_mesh.material.transparent = material.HasMember("alphaMode") && (material["alphaMode"].GetString() == std::string("BLEND"));
+                unsigned int const index_size = primitive.indices.count * component_type_to_size(primitive.indices.type);
+                unsigned int const indices = align(result.buffer.size());
+                result.buffer.resize(indices + index_size);
+                std::memcpy(result.buffer.data() + indices, model.buffer.data() + primitive.indices.view.offset, index_size);
+                result_primitive.indices.view = {indices, index_size};
+            }
 
-        auto const & pbr = material["pbrMetallicRoughness"];
-        if (pbr.HasMember("baseColorTexture"))
-            result_mesh.material.texture_path = parse_texture(pbr["baseColorTexture"]["index"].GetInt());
-        else if (pbr.HasMember("baseColorFactor"))
-            result_mesh.material.color = parse_color(pbr["baseColorFactor"].GetArray());
+            result_mesh.push_back(it->second);
+        }
     }
 
     return result;
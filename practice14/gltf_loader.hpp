@@ -18,6 +18,8 @@ struct gltf_model
     {
         unsigned int offset;
         unsigned int size;
+        // Bytes between consecutive elements, 0 if they are tightly packed
+        unsigned int stride = 0;
     };
 
     struct accessor
@@ -36,9 +38,8 @@ struct gltf_model
         std::optional<glm::vec4> color;
     };
 
-    struct mesh
+    struct primitive
     {
-        std::string name;
         struct material material;
 
         accessor indices;
@@ -51,8 +52,53 @@ struct gltf_model
         glm::vec3 max;
     };
 
+    struct mesh
+    {
+        std::string name;
+        std::vector<primitive> primitives;
+        // Index of the first mesh with byte-identical geometry and materials, the mesh itself if there is none.
+        // The primitives of a duplicate point at the data of that mesh, so it is uploaded and drawn once.
+        unsigned int original;
+    };
+
+    struct node
+    {
+        std::string name;
+        // -1 for the root nodes
+        int parent = -1;
+        std::optional<unsigned int> mesh;
+
+        glm::mat4 local;
+        // Zero for the nodes outside of the scene
+        glm::mat4 world;
+
+        // EXT_mesh_gpu_instancing: the node draws its mesh once per transform, given in world space
+        std::vector<glm::mat4> instances;
+    };
+
+    // All the nodes of the scene that draw the same mesh, merged into one instanced draw
+    struct batch
+    {
+        unsigned int mesh;
+        std::vector<glm::mat4> transforms;
+    };
+
     std::vector<char> buffer;
     std::vector<mesh> meshes;
+    std::vector<node> nodes;
+    std::vector<batch> batches;
 };
 
 gltf_model load_gltf(std::filesystem::path const & path);
+
+// The vertex and index data of the primitives, repacked for the GPU. The attributes of a vertex are
+// interleaved into one record, so that fetching a vertex touches one cache line instead of one per
+// attribute, and whatever the draws don't read (animations, skins, unused views) is left out.
+struct packed_vertices
+{
+    std::vector<char> buffer;
+    // Primitive j of mesh i, with the accessors pointing into buffer
+    std::vector<std::vector<gltf_model::primitive>> meshes;
+};
+
+packed_vertices pack_vertices(gltf_model const & model);
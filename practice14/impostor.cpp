@@ -0,0 +1,165 @@
+#include "impostor.hpp"
+#include "parallel.hpp"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/ext/matrix_transform.hpp>
+#include <glm/ext/matrix_clip_space.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+
+namespace
+{
+
+    float sign_not_zero(float x)
+    {
+        return x >= 0.f ? 1.f : -1.f;
+    }
+
+    // Empty texels take the average of their covered neighbours, so that bilinear
+    // filtering and mipmaps don't darken the silhouette
+    void dilate(std::vector<glm::u8vec4> & pixels, std::vector<float> const & depth, int size)
+    {
+        std::vector<glm::u8vec4> const source = pixels;
+        for (int y = 0; y < size; ++y)
+        {
+            for (int x = 0; x < size; ++x)
+            {
+                if (depth[y * size + x] < 1.f)
+                    continue;
+
+                glm::uvec3 sum(0);
+                unsigned count = 0;
+                for (auto [dx, dy] : {std::pair{-1, 0}, {1, 0}, {0, -1}, {0, 1}})
+                {
+                    int const nx = x + dx;
+                    int const ny = y + dy;
+                    if (nx < 0 || ny < 0 || nx >= size || ny >= size || depth[ny * size + nx] >= 1.f)
+                        continue;
+                    sum += glm::uvec3(source[ny * size + nx]);
+                    ++count;
+                }
+
+                if (count > 0)
+                    pixels[y * size + x] = glm::u8vec4(glm::u8vec3(sum / count), pixels[y * size + x].a);
+            }
+        }
+    }
+
+}
+
+glm::vec3 octahedral_decode(glm::vec2 p)
+{
+    glm::vec3 d(p.x, 1.f - std::abs(p.x) - std::abs(p.y), p.y);
+    if (d.y < 0.f)
+    {
+        float const x = d.x;
+        d.x = (1.f - std::abs(d.z)) * sign_not_zero(x);
+        d.z = (1.f - std::abs(x)) * sign_not_zero(d.z);
+    }
+    return glm::normalize(d);
+}
+
+glm::vec2 octahedral_encode(glm::vec3 d)
+{
+    d /= std::abs(d.x) + std::abs(d.y) + std::abs(d.z);
+    glm::vec2 p(d.x, d.z);
+    if (d.y < 0.f)
+        p = glm::vec2((1.f - std::abs(p.y)) * sign_not_zero(p.x), (1.f - std::abs(p.x)) * sign_not_zero(p.y));
+    return p;
+}
+
+impostor bake_impostor(software_draw const & mesh, int frames, int frame_size)
+{
+    impostor result;
+    result.frames = frames;
+    result.frame_size = frame_size;
+
+    glm::vec3 min(std::numeric_limits<float>::infinity());
+    glm::vec3 max(-std::numeric_limits<float>::infinity());
+    for (auto const & p : mesh.positions)
+    {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+
+    result.center = (min + max) * 0.5f;
+    result.radius = 0.f;
+    for (auto const & p : mesh.positions)
+        result.radius = std::max(result.radius, glm::distance(p, result.center));
+
+    int const size = result.atlas_size();
+    result.albedo.assign(size * size, glm::u8vec4(0));
+    result.normal_depth.assign(size * size, glm::u8vec4(0));
+
+    float const r = result.radius;
+    // The eye is 2r away from the center, so depth 0 is r in front of it and 1 is r behind it
+    glm::mat4 const projection = glm::ortho(-r, r, -r, r, r, 3.f * r);
+
+    // Frames are small, a tile or a few for the rasterizer, so the frames themselves are spread
+    // over the cores and every worker rasterizes its frames on its own thread
+    parallel_chunks(frames * frames, worker_count(), [&](std::size_t, std::size_t begin, std::size_t end)
+    {
+        software_framebuffer framebuffer(frame_size, frame_size);
+        software_rasterizer rasterizer;
+        rasterizer.max_workers = 1;
+
+        software_draw draw = mesh;
+        draw.model = glm::mat4(1.f);
+
+        std::vector<glm::u8vec4> albedo(frame_size * frame_size);
+        std::vector<glm::u8vec4> normal_depth(frame_size * frame_size);
+        std::vector<float> depth(frame_size * frame_size);
+
+        auto render = [&](software_shading shading, std::vector<glm::u8vec4> & target)
+        {
+            framebuffer.clear(glm::vec4(0.f));
+            draw.shading = shading;
+            rasterizer.begin_frame(framebuffer);
+            rasterizer.draw(draw);
+            rasterizer.end_frame();
+
+            for (int y = 0; y < frame_size; ++y)
+            {
+                for (int x = 0; x < frame_size; ++x)
+                {
+                    target[y * frame_size + x] = framebuffer.pixel(x, y);
+                    depth[y * frame_size + x] = framebuffer.depth[y * framebuffer.stride + x];
+                }
+            }
+        };
+
+        for (std::size_t frame = begin; frame < end; ++frame)
+        {
+            int const i = frame % frames;
+            int const j = frame / frames;
+            glm::vec3 const direction = octahedral_decode((glm::vec2(i, j) + 0.5f) / float(frames) * 2.f - 1.f);
+
+            // The same basis has to be rebuilt by the billboard shader to place the quad
+            glm::vec3 const up = std::abs(direction.y) > 0.999f ? glm::vec3(0.f, 0.f, 1.f) : glm::vec3(0.f, 1.f, 0.f);
+            draw.view_projection = projection * glm::lookAt(result.center + direction * (2.f * r), result.center, up);
+
+            render(software_shading::unlit, albedo);
+            render(software_shading::normal, normal_depth);
+
+            for (int k = 0; k < frame_size * frame_size; ++k)
+                normal_depth[k].a = static_cast<std::uint8_t>(std::lround(std::clamp(depth[k], 0.f, 1.f) * 255.f));
+
+            dilate(albedo, depth, frame_size);
+            dilate(normal_depth, depth, frame_size);
+
+            // Framebuffer rows go down, atlas rows go up
+            for (int y = 0; y < frame_size; ++y)
+            {
+                std::size_t const row = std::size_t(j * frame_size + frame_size - 1 - y) * size + i * frame_size;
+                std::copy_n(albedo.begin() + y * frame_size, frame_size, result.albedo.begin() + row);
+                std::copy_n(normal_depth.begin() + y * frame_size, frame_size, result.normal_depth.begin() + row);
+            }
+        }
+    });
+
+    return result;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "software_rasterizer.hpp"
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/ext/vector_uint4_sized.hpp>
+
+#include <vector>
+
+// Octahedral impostor: a mesh rendered orthographically from frames x frames directions spread over
+// the whole sphere by the octahedral mapping, every view into its own square of the atlases. Far away
+// the mesh is replaced by a single quad showing the view closest to the actual view direction.
+struct impostor
+{
+    int frames;
+    int frame_size;
+
+    // Bounding sphere of the mesh, every view covers its projection
+    glm::vec3 center;
+    float radius;
+
+    int atlas_size() const { return frames * frame_size; }
+
+    // Rows from the bottom up, as glTexImage2D takes them. Frame (i, j) shows the direction
+    // octahedral_decode(((i, j) + 0.5) / frames * 2 - 1) and starts at texel (i, j) * frame_size.
+    // Albedo alpha is the coverage; normal_depth is the object-space normal mapped to [0, 1] and
+    // the depth from radius in front of the center (0) to radius behind it (1).
+    std::vector<glm::u8vec4> albedo;
+    std::vector<glm::u8vec4> normal_depth;
+};
+
+// Maps [-1, 1]^2 onto the unit sphere with +y in the middle and -y in the corners, and back
+glm::vec3 octahedral_decode(glm::vec2 p);
+glm::vec2 octahedral_encode(glm::vec3 d);
+
+// Renders the mesh of the draw on the CPU, without a GPU. The model matrix and shading of the draw
+// are ignored: the views are taken in object space, once unlit and once with normals.
+impostor bake_impostor(software_draw const & mesh, int frames, int frame_size);
@@ -16,6 +16,11 @@
 #include <random>
 #include <map>
 #include <cmath>
+#include <limits>
+#include <cstdio>
+#include <optional>
+#include <bit>
+#include <span>
 
 #include <glm/vec3.hpp>
 #include <glm/mat4x4.hpp>
@@ -30,6 +35,12 @@
 #include "aabb.hpp"
 #include "frustum.hpp"
 #include "intersect.hpp"
+#include "transform_hierarchy.hpp"
+#include "frame_arena.hpp"
+#include "input_recording.hpp"
+#include "frame_stats.hpp"
+#include "picking.hpp"
+#include "impostor.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -52,20 +63,23 @@ R"(#version 330 core
 uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
+uniform int highlighted_instance;
 
 layout (location = 0) in vec3 in_position;
 layout (location = 1) in vec3 in_normal;
 layout (location = 2) in vec2 in_texcoord;
-layout (location = 3) in vec3 in_instance;
+layout (location = 3) in mat4 in_instance;
 
 out vec3 normal;
 out vec2 texcoord;
+flat out int highlighted;
 
 void main()
 {
-    gl_Position = projection * view * model * vec4(in_position + in_instance, 1.0);
-    normal = mat3(model) * in_normal;
+    gl_Position = projection * view * model * in_instance * vec4(in_position, 1.0);
+    normal = mat3(model) * mat3(in_instance) * in_normal;
     texcoord = in_texcoord;
+    highlighted = (gl_InstanceID == highlighted_instance) ? 1 : 0;
 }
 )";
 
@@ -80,10 +94,13 @@ layout (location = 0) out vec4 out_color;
 
 in vec3 normal;
 in vec2 texcoord;
+flat in int highlighted;
 
 void main()
 {
     vec3 albedo_color = texture(albedo, texcoord).rgb;
+    if (highlighted != 0)
+        albedo_color = mix(albedo_color, vec3(1.0, 0.5, 0.0), 0.6);
 
     float ambient = 0.4;
     float diffuse = max(0.0, dot(normalize(normal), light_direction));
@@ -92,6 +109,123 @@ void main()
 }
 )";
 
+// One camera-facing quad per far bunny, showing the impostor view closest to the direction
+// the bunny is seen from. The frame is picked per instance, so all vertices of a quad agree.
+const char impostor_vertex_shader_source[] =
+R"(#version 330 core
+
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+uniform vec3 camera_position;
+uniform vec3 light_direction;
+uniform int highlighted_instance;
+
+uniform int frames;
+uniform vec3 impostor_center;
+uniform float impostor_radius;
+
+layout (location = 3) in mat4 in_instance;
+
+out vec2 texcoord;
+out vec3 position;
+flat out vec3 frame_direction;
+flat out vec3 object_light_direction;
+flat out int highlighted;
+
+const vec2 corners[6] = vec2[6](vec2(-1.0, -1.0), vec2(1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, -1.0), vec2(1.0, 1.0), vec2(-1.0, 1.0));
+
+vec2 sign_not_zero(vec2 v)
+{
+    return vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// Same mapping as octahedral_encode/decode in impostor.cpp
+vec2 octahedral_encode(vec3 d)
+{
+    d /= abs(d.x) + abs(d.y) + abs(d.z);
+    vec2 p = d.xz;
+    if (d.y < 0.0)
+        p = (1.0 - abs(p.yx)) * sign_not_zero(p);
+    return p;
+}
+
+vec3 octahedral_decode(vec2 p)
+{
+    vec3 d = vec3(p.x, 1.0 - abs(p.x) - abs(p.y), p.y);
+    if (d.y < 0.0)
+        d.xz = (1.0 - abs(d.zx)) * sign_not_zero(d.xz);
+    return normalize(d);
+}
+
+void main()
+{
+    // The instances are rotations and translations, so the transpose inverts the rotation
+    mat4 transform = model * in_instance;
+    mat3 rotation = mat3(transform);
+    vec3 center = (transform * vec4(impostor_center, 1.0)).xyz;
+
+    vec3 direction = normalize(transpose(rotation) * (camera_position - center));
+    ivec2 frame = clamp(ivec2((octahedral_encode(direction) * 0.5 + 0.5) * float(frames)), ivec2(0), ivec2(frames - 1));
+    vec3 view_direction = octahedral_decode((vec2(frame) + 0.5) / float(frames) * 2.0 - 1.0);
+
+    // The basis the frame was baked with, see bake_impostor()
+    vec3 up = abs(view_direction.y) > 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(0.0, 1.0, 0.0);
+    vec3 right = normalize(cross(up, view_direction));
+    up = cross(view_direction, right);
+
+    vec2 corner = corners[gl_VertexID];
+    position = center + rotation * ((right * corner.x + up * corner.y) * impostor_radius);
+    gl_Position = projection * view * vec4(position, 1.0);
+
+    texcoord = (vec2(frame) + corner * 0.5 + 0.5) / float(frames);
+    frame_direction = rotation * view_direction;
+    object_light_direction = transpose(rotation) * light_direction;
+    highlighted = (gl_InstanceID == highlighted_instance) ? 1 : 0;
+}
+)";
+
+const char impostor_fragment_shader_source[] =
+R"(#version 330 core
+
+uniform mat4 view;
+uniform mat4 projection;
+uniform float impostor_radius;
+
+uniform sampler2D impostor_albedo;
+uniform sampler2D impostor_normal_depth;
+
+layout (location = 0) out vec4 out_color;
+
+in vec2 texcoord;
+in vec3 position;
+flat in vec3 frame_direction;
+flat in vec3 object_light_direction;
+flat in int highlighted;
+
+void main()
+{
+    vec4 albedo = texture(impostor_albedo, texcoord);
+    if (albedo.a < 0.5)
+        discard;
+
+    vec4 normal_depth = texture(impostor_normal_depth, texcoord);
+
+    vec3 albedo_color = albedo.rgb;
+    if (highlighted != 0)
+        albedo_color = mix(albedo_color, vec3(1.0, 0.5, 0.0), 0.6);
+
+    float ambient = 0.4;
+    float diffuse = max(0.0, dot(normalize(normal_depth.xyz * 2.0 - 1.0), object_light_direction));
+
+    out_color = vec4(albedo_color * (ambient + diffuse), 1.0);
+
+    // Depth of the baked surface rather than of the quad, so that neighbouring impostors intersect properly
+    vec4 surface = projection * view * vec4(position - frame_direction * (2.0 * normal_depth.a - 1.0) * impostor_radius, 1.0);
+    gl_FragDepth = surface.z / surface.w * 0.5 + 0.5;
+}
+)";
+
 GLuint create_shader(GLenum type, const char * source)
 {
     GLuint result = glCreateShader(type);
@@ -131,8 +265,19 @@ GLuint create_program(Shaders ... shaders)
     return result;
 }
 
-int main() try
+// Vertex attribute of the loaded buffer, viewed in place, so it has to be tightly packed
+template <typename T>
+std::span<T const> accessor_data(gltf_model const & model, gltf_model::accessor const & accessor)
+{
+    if (accessor.view.stride != 0 && accessor.view.stride != sizeof(T))
+        throw std::runtime_error("Interleaved vertex attributes are not supported");
+    return {reinterpret_cast<T const *>(model.buffer.data() + accessor.view.offset), accessor.count};
+}
+
+int main(int argc, char ** argv) try
 {
+    input_recording recording(argc, argv);
+
     if (SDL_Init(SDL_INIT_VIDEO) != 0)
         sdl2_fail("SDL_Init: ");
 
@@ -181,20 +326,92 @@ int main() try
     GLuint use_texture_location = glGetUniformLocation(program, "use_texture");
     GLuint light_direction_location = glGetUniformLocation(program, "light_direction");
     GLuint bones_location = glGetUniformLocation(program, "bones");
+    GLuint highlighted_instance_location = glGetUniformLocation(program, "highlighted_instance");
+
+    auto impostor_vertex_shader = create_shader(GL_VERTEX_SHADER, impostor_vertex_shader_source);
+    auto impostor_fragment_shader = create_shader(GL_FRAGMENT_SHADER, impostor_fragment_shader_source);
+    auto impostor_program = create_program(impostor_vertex_shader, impostor_fragment_shader);
+
+    GLuint impostor_model_location = glGetUniformLocation(impostor_program, "model");
+    GLuint impostor_view_location = glGetUniformLocation(impostor_program, "view");
+    GLuint impostor_projection_location = glGetUniformLocation(impostor_program, "projection");
+    GLuint impostor_camera_position_location = glGetUniformLocation(impostor_program, "camera_position");
+    GLuint impostor_light_direction_location = glGetUniformLocation(impostor_program, "light_direction");
+    GLuint impostor_highlighted_instance_location = glGetUniformLocation(impostor_program, "highlighted_instance");
+    GLuint impostor_frames_location = glGetUniformLocation(impostor_program, "frames");
+    GLuint impostor_center_location = glGetUniformLocation(impostor_program, "impostor_center");
+    GLuint impostor_radius_location = glGetUniformLocation(impostor_program, "impostor_radius");
+    GLuint impostor_albedo_location = glGetUniformLocation(impostor_program, "impostor_albedo");
+    GLuint impostor_normal_depth_location = glGetUniformLocation(impostor_program, "impostor_normal_depth");
 
     const std::string project_root = PROJECT_ROOT;
     const std::string model_path = project_root + "/bunny/bunny.gltf";
 
     auto const input_model = load_gltf(model_path);
+    auto const vertices = pack_vertices(input_model);
+    std::cout << "Vertex buffer: " << input_model.buffer.size() << " bytes in the file, " << vertices.buffer.size() << " bytes packed" << std::endl;
+
     GLuint vbo;
     glGenBuffers(1, &vbo);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
-    glBufferData(GL_ARRAY_BUFFER, input_model.buffer.size(), input_model.buffer.data(), GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, vertices.buffer.size(), vertices.buffer.data(), GL_STATIC_DRAW);
+
+    // The CPU-side picking and impostor baking take 32-bit indices
+    auto read_indices = [&](gltf_model::primitive const & primitive)
+    {
+        std::vector<std::uint32_t> indices(primitive.indices.count);
+        auto const index_data = input_model.buffer.data() + primitive.indices.view.offset;
+        for (std::size_t i = 0; i < indices.size(); ++i)
+        {
+            if (primitive.indices.type == GL_UNSIGNED_SHORT)
+                indices[i] = reinterpret_cast<std::uint16_t const *>(index_data)[i];
+            else
+                indices[i] = reinterpret_cast<std::uint32_t const *>(index_data)[i];
+        }
+        return indices;
+    };
 
-    std::vector<glm::vec3> offsets;
-    for (int i = -16; i < 16; i++)
-        for (int j = -16; j < 16; j++)
-            offsets.emplace_back(i, 0.f, j);
+    // Every LOD is a mesh of a single primitive
+    auto lod_primitive = [&](int lod) -> gltf_model::primitive const &
+    {
+        return input_model.meshes[lod].primitives[0];
+    };
+
+    // Clicks are traced against the same LOD meshes that are drawn
+    ray_picker picker;
+    for (int i = 0; i < input_model.meshes.size(); ++i)
+        picker.add_mesh(accessor_data<glm::vec3>(input_model, lod_primitive(i).position), read_indices(lod_primitive(i)));
+
+    // A row node per x coordinate with the bunnies of the row as its children
+    transform_hierarchy scene;
+    std::vector<std::uint32_t> rows;
+    std::vector<std::uint32_t> objects;
+    {
+        std::default_random_engine rng;
+        std::uniform_real_distribution<float> angle(0.f, 2.f * glm::pi<float>());
+
+        auto const root = scene.add(transform_hierarchy::no_parent);
+        for (int i = -16; i < 16; i++)
+        {
+            rows.push_back(scene.add(root, glm::vec3(i, 0.f, 0.f)));
+            for (int j = -16; j < 16; j++)
+                objects.push_back(scene.add(rows.back(), glm::vec3(0.f, 0.f, j), glm::angleAxis(angle(rng), glm::vec3(0.f, 1.f, 0.f))));
+        }
+    }
+
+    // Object-space bounds of the highest LOD, transformed into world space for culling
+    auto world_bounds = [&](glm::mat4 const & transform)
+    {
+        glm::vec3 min(std::numeric_limits<float>::infinity());
+        glm::vec3 max(-std::numeric_limits<float>::infinity());
+        for (auto const & v : aabb(lod_primitive(0).min, lod_primitive(0).max).vertices)
+        {
+            glm::vec3 const p = (transform * glm::vec4(v, 1.f)).xyz();
+            min = glm::min(min, p);
+            max = glm::max(max, p);
+        }
+        return aabb(min, max);
+    };
 
     GLuint instance_vbo;
     glGenBuffers(1, &instance_vbo);
@@ -211,25 +428,31 @@ int main() try
         auto setup_attribute = [](int index, gltf_model::accessor const & accessor)
         {
             glEnableVertexAttribArray(index);
-            glVertexAttribPointer(index, accessor.size, accessor.type, GL_FALSE, 0, reinterpret_cast<void *>(accessor.view.offset));
+            glVertexAttribPointer(index, accessor.size, accessor.type, GL_FALSE, accessor.view.stride, reinterpret_cast<void *>(accessor.view.offset));
         };
 
         glBindBuffer(GL_ARRAY_BUFFER, vbo);
-        setup_attribute(0, input_model.meshes[i].position);
-        setup_attribute(1, input_model.meshes[i].normal);
-        setup_attribute(2, input_model.meshes[i].texcoord);
+        // The GPU draws from the packed copy, the CPU-side code reads the file layout
+        auto const & primitive = vertices.meshes[i][0];
+        setup_attribute(0, primitive.position);
+        setup_attribute(1, primitive.normal);
+        setup_attribute(2, primitive.texcoord);
 
         glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
-        glEnableVertexAttribArray(3);
-        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 0, nullptr);
-        glVertexAttribDivisor(3, 1);
+        for (int column = 0; column < 4; ++column)
+        {
+            glEnableVertexAttribArray(3 + column);
+            glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), reinterpret_cast<void *>(column * sizeof(glm::vec4)));
+            glVertexAttribDivisor(3 + column, 1);
+        }
 
         vaos.push_back(vao);
     }
 
     GLuint texture;
+    impostor bunny_impostor;
     {
-        auto const & mesh = input_model.meshes[0];
+        auto const & mesh = lod_primitive(0);
 
         auto path = std::filesystem::path(model_path).parent_path() / *mesh.material.texture_path;
 
@@ -244,9 +467,60 @@ int main() try
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
 
+        // Far bunnies are drawn as impostors of the highest LOD, rendered on the CPU
+        software_texture const albedo(width, height, reinterpret_cast<glm::u8vec4 const *>(data));
+        auto const indices = read_indices(mesh);
+
+        software_draw draw;
+        draw.positions = accessor_data<glm::vec3>(input_model, mesh.position);
+        draw.normals = accessor_data<glm::vec3>(input_model, mesh.normal);
+        draw.texcoords = accessor_data<glm::vec2>(input_model, mesh.texcoord);
+        draw.indices = indices;
+        draw.albedo = &albedo;
+
+        auto const bake_start = std::chrono::high_resolution_clock::now();
+        bunny_impostor = bake_impostor(draw, 16, 64);
+        std::printf("Baked %dx%d impostor views in %.1f ms\n", bunny_impostor.frames, bunny_impostor.frames,
+            std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - bake_start).count());
+
         stbi_image_free(data);
     }
 
+    // Mipmaps stop at 4x4 texels per frame, below that the frames would bleed into each other
+    auto create_impostor_texture = [&](std::vector<glm::u8vec4> const & pixels)
+    {
+        GLuint result;
+        glGenTextures(1, &result);
+        glBindTexture(GL_TEXTURE_2D, result);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, std::countr_zero(unsigned(bunny_impostor.frame_size)) - 2);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, bunny_impostor.atlas_size(), bunny_impostor.atlas_size(), 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        glGenerateMipmap(GL_TEXTURE_2D);
+        return result;
+    };
+
+    GLuint impostor_albedo_texture = create_impostor_texture(bunny_impostor.albedo);
+    GLuint impostor_normal_depth_texture = create_impostor_texture(bunny_impostor.normal_depth);
+
+    glUseProgram(impostor_program);
+    glUniform1i(impostor_albedo_location, 0);
+    glUniform1i(impostor_normal_depth_location, 1);
+
+    // No vertex attributes, the quad corners come from gl_VertexID
+    GLuint impostor_vao;
+    glGenVertexArrays(1, &impostor_vao);
+    glBindVertexArray(impostor_vao);
+    glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+    for (int column = 0; column < 4; ++column)
+    {
+        glEnableVertexAttribArray(3 + column);
+        glVertexAttribPointer(3 + column, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), reinterpret_cast<void *>(column * sizeof(glm::vec4)));
+        glVertexAttribDivisor(3 + column, 1);
+    }
+
     auto last_frame_start = std::chrono::high_resolution_clock::now();
 
     float time = 0.f;
@@ -258,13 +532,31 @@ int main() try
 
     std::vector<GLuint> query_object_ids;
     std::vector<bool> object_used;
+    // Frame whose GPU time the query measures
+    std::vector<std::size_t> query_frame;
+
+    frame_stats stats({"update", "cull", "draw"}, 512, "frame_stats.csv");
+    float title_update_time = 0.f;
 
     bool paused = false;
 
+    // A wave lifts one row at a time, the rest of the scene stays static
+    std::size_t wave_row = 0;
+
+    frame_arena arena;
+
+    // Window point of a click waiting to be picked, and the scene node of the last picked bunny
+    std::optional<glm::vec2> pick_request;
+    std::optional<std::uint32_t> picked_object;
+
+    // Bunnies whose bounding sphere is smaller than this on screen are drawn as impostors, toggled with I
+    bool use_impostors = true;
+    float const impostor_screen_size = 32.f;
+
     bool running = true;
     while (running)
     {
-        for (SDL_Event event; SDL_PollEvent(&event);) switch (event.type)
+        for (SDL_Event event; recording.poll_event(event);) switch (event.type)
         {
         case SDL_QUIT:
             running = false;
@@ -282,17 +574,23 @@ int main() try
             button_down[event.key.keysym.sym] = true;
             if (event.key.keysym.sym == SDLK_SPACE)
                 paused = !paused;
+            if (event.key.keysym.sym == SDLK_i)
+                use_impostors = !use_impostors;
             break;
         case SDL_KEYUP:
             button_down[event.key.keysym.sym] = false;
             break;
+        case SDL_MOUSEBUTTONDOWN:
+            if (event.button.button == SDL_BUTTON_LEFT)
+                pick_request = glm::vec2(event.button.x, event.button.y);
+            break;
         }
 
         if (!running)
             break;
 
         auto now = std::chrono::high_resolution_clock::now();
-        float dt = std::chrono::duration_cast<std::chrono::duration<float>>(now - last_frame_start).count();
+        float dt = recording.time_step(std::chrono::duration_cast<std::chrono::duration<float>>(now - last_frame_start).count());
         last_frame_start = now;
 
         if (!paused)
@@ -320,15 +618,22 @@ int main() try
         if (button_down[SDLK_UP])
             camera_position.y += 3.f * dt;
 
+        arena.begin_frame();
+
+        std::size_t const frame = stats.begin_frame();
+        stats.begin_phase(0);
+
         GLuint free_query_object_index = 0;
         while (free_query_object_index < query_object_ids.size() && object_used[free_query_object_index])
             free_query_object_index++;
         if (free_query_object_index == query_object_ids.size()) {
             query_object_ids.emplace_back();
             object_used.push_back(false);
+            query_frame.push_back(0);
             glGenQueries(1, &query_object_ids[query_object_ids.size() - 1]);
         }
         object_used[free_query_object_index] = true;
+        query_frame[free_query_object_index] = frame;
         glBeginQuery(GL_TIME_ELAPSED, query_object_ids[free_query_object_index]);
 
         camera_position += camera_move_forward * glm::vec3(-std::sin(camera_rotation), 0.f, std::cos(camera_rotation));
@@ -356,15 +661,91 @@ int main() try
 
         glm::vec3 light_direction = glm::normalize(glm::vec3(1.f, 2.f, 3.f));
 
-        std::vector<glm::vec3> instances[6];
+        {
+            float const wave = time * 4.f;
+            std::size_t const row = static_cast<std::size_t>(wave) % rows.size();
+            if (row != wave_row)
+            {
+                scene.set_translation(rows[wave_row], scene.translation(rows[wave_row]) * glm::vec3(1.f, 0.f, 1.f));
+                wave_row = row;
+            }
+            auto translation = scene.translation(rows[row]);
+            translation.y = 0.3f * std::sin(glm::pi<float>() * (wave - std::floor(wave)));
+            scene.set_translation(rows[row], translation);
+        }
+        scene.update();
+
+        auto lod_at = [&](glm::vec3 const & position)
+        {
+            return std::min(5, (int)std::round(glm::distance(position, camera_position) / 5));
+        };
+
+        if (pick_request)
+        {
+            auto const pick_start = std::chrono::high_resolution_clock::now();
+
+            // The instances move, so the top level is rebuilt for every click
+            frame_vector<std::uint32_t> meshes;
+            frame_vector<glm::mat4> transforms;
+            for (auto object : objects)
+            {
+                transforms.push_back(scene.world(object));
+                meshes.push_back(lod_at(transforms.back()[3].xyz()));
+            }
+            picker.set_instances(meshes, transforms);
+
+            auto const hit = picker.pick(cursor_ray(projection * view, pick_request->x, pick_request->y, width, height));
+
+            float const pick_ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - pick_start).count();
+
+            if (hit)
+            {
+                picked_object = objects[hit->instance];
+                std::printf("Picked bunny %u (LOD %u), triangle %u, barycentrics (%.3f, %.3f), point (%.3f, %.3f, %.3f), %.3f ms\n",
+                    hit->instance, hit->mesh, hit->triangle, hit->u, hit->v, hit->position.x, hit->position.y, hit->position.z, pick_ms);
+            }
+            else
+            {
+                picked_object.reset();
+                std::printf("Nothing picked, %.3f ms\n", pick_ms);
+            }
+
+            pick_request.reset();
+        }
+
+        stats.begin_phase(1);
+
+        frame_vector<glm::mat4> instances[6];
+        // Index of the picked bunny among the instances of its LOD, -1 for the other LODs
+        int highlighted[6] = {-1, -1, -1, -1, -1, -1};
+        frame_vector<glm::mat4> impostor_instances;
+        int highlighted_impostor = -1;
         frustum frustum(projection * view);
-        for (auto& offset : offsets) {
-            aabb box = aabb(input_model.meshes[0].min + offset, input_model.meshes[0].max + offset);
-            int lod = std::min(5, (int)std::round(glm::distance(offset, camera_position) / 5));
-            if (intersect(box, frustum))
-                instances[lod].push_back(offset);
+        for (auto object : objects) {
+            auto const & transform = scene.world(object);
+            glm::vec3 const position = transform[3].xyz();
+            int lod = lod_at(position);
+            if (intersect(world_bounds(transform), frustum))
+            {
+                // Diameter of the bounding sphere in pixels, the vertical field of view is 90 degrees
+                glm::vec3 const center = (transform * glm::vec4(bunny_impostor.center, 1.f)).xyz();
+                float const screen_size = bunny_impostor.radius * height / glm::distance(center, camera_position);
+                if (use_impostors && screen_size < impostor_screen_size)
+                {
+                    if (object == picked_object)
+                        highlighted_impostor = impostor_instances.size();
+                    impostor_instances.push_back(transform);
+                    continue;
+                }
+
+                if (object == picked_object)
+                    highlighted[lod] = instances[lod].size();
+                instances[lod].push_back(transform);
+            }
         }
 
+        stats.begin_phase(2);
+
         glUseProgram(program);
         glUniformMatrix4fv(model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
         glUniformMatrix4fv(view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
@@ -374,39 +755,88 @@ int main() try
         glBindTexture(GL_TEXTURE_2D, texture);
 
         for (int i = 0; i < 6; i++) {
-            auto const & mesh = input_model.meshes[i];
+            auto const & mesh = vertices.meshes[i][0];
+            glUniform1i(highlighted_instance_location, highlighted[i]);
             glBindVertexArray(vaos[i]);
             glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
-            glBufferData(GL_ARRAY_BUFFER, instances[i].size() * sizeof(glm::vec3), instances[i].data(), GL_STATIC_DRAW);
+            glBufferData(GL_ARRAY_BUFFER, instances[i].size() * sizeof(glm::mat4), instances[i].data(), GL_STATIC_DRAW);
             glDrawElementsInstanced(GL_TRIANGLES, mesh.indices.count, mesh.indices.type, reinterpret_cast<void *>(mesh.indices.view.offset), instances[i].size());
         }
 
+        if (!impostor_instances.empty())
+        {
+            glUseProgram(impostor_program);
+            glUniformMatrix4fv(impostor_model_location, 1, GL_FALSE, reinterpret_cast<float *>(&model));
+            glUniformMatrix4fv(impostor_view_location, 1, GL_FALSE, reinterpret_cast<float *>(&view));
+            glUniformMatrix4fv(impostor_projection_location, 1, GL_FALSE, reinterpret_cast<float *>(&projection));
+            glUniform3fv(impostor_camera_position_location, 1, reinterpret_cast<float *>(&camera_position));
+            glUniform3fv(impostor_light_direction_location, 1, reinterpret_cast<float *>(&light_direction));
+            glUniform1i(impostor_highlighted_instance_location, highlighted_impostor);
+            glUniform1i(impostor_frames_location, bunny_impostor.frames);
+            glUniform3fv(impostor_center_location, 1, reinterpret_cast<float *>(&bunny_impostor.center));
+            glUniform1f(impostor_radius_location, bunny_impostor.radius);
+
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_2D, impostor_normal_depth_texture);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, impostor_albedo_texture);
+
+            glBindVertexArray(impostor_vao);
+            glBindBuffer(GL_ARRAY_BUFFER, instance_vbo);
+            glBufferData(GL_ARRAY_BUFFER, impostor_instances.size() * sizeof(glm::mat4), impostor_instances.data(), GL_STATIC_DRAW);
+            glDrawArraysInstanced(GL_TRIANGLES, 0, 6, impostor_instances.size());
+        }
+
         glEndQuery(GL_TIME_ELAPSED);
         SDL_GL_SwapWindow(window);
 
+        stats.end_frame();
+
+        arena.end_frame();
+
+        recording.end_frame();
+        if (recording.finished())
+            running = false;
+
         for (int i = 0; i < query_object_ids.size(); i++) {
             if (!object_used[i])
                 continue;
 
             GLint query_finished;
-            glGetQueryObjectiv(i, GL_QUERY_RESULT_AVAILABLE, &query_finished);
+            glGetQueryObjectiv(query_object_ids[i], GL_QUERY_RESULT_AVAILABLE, &query_finished);
             if (query_finished == GL_FALSE)
                 continue;
 
-
-            GLint time_passed;
-            glGetQueryObjectiv(i, GL_QUERY_RESULT, &time_passed);
-            std::cout << "query " << query_object_ids[i] << " finished: "
-                << time_passed / 1e6f << " ms passed" << std::endl;
+            GLuint64 time_passed;
+            glGetQueryObjectui64v(query_object_ids[i], GL_QUERY_RESULT, &time_passed);
+            stats.set_gpu_time(query_frame[i], time_passed / 1e6f);
 
             object_used[i] = false;
         }
+
+        // Printing every frame would itself show up in the frame times, so the summary goes to the window title once a second
+        title_update_time += dt;
+        if (title_update_time >= 1.f)
+        {
+            title_update_time = 0.f;
+
+            auto const cpu = stats.cpu();
+            auto const gpu = stats.gpu();
+            char title[256];
+            std::snprintf(title, sizeof(title), "frame %.2f ms (p99 %.2f, max %.2f), gpu %.2f ms (p99 %.2f), %zu stutters",
+                cpu.mean, cpu.p99, cpu.max, gpu.mean, gpu.p99, stats.stutters());
+            SDL_SetWindowTitle(window, title);
+        }
     }
 
     SDL_GL_DeleteContext(gl_context);
     SDL_DestroyWindow(window);
 
-    std::cout << "query size: " << query_object_ids.size() << std::endl;
+    if (arena.allocating_frames() > 0)
+        std::cerr << arena.total_heap_allocations() << " heap allocations in " << arena.allocating_frames()
+            << " of " << arena.frames() << " frames of the frame loop" << std::endl;
+
+    std::cout << stats.report() << std::endl;
 }
 catch (std::exception const & e)
 {
@@ -0,0 +1,208 @@
+#include "picking.hpp"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+#include <glm/matrix.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace
+{
+
+    constexpr float infinity = std::numeric_limits<float>::infinity();
+
+    // Instances per top-level leaf
+    constexpr std::uint32_t leaf_size = 2;
+
+    // Median splits keep the top level balanced, so this covers any realistic instance count
+    constexpr int stack_size = 64;
+
+    // Distance at which the ray enters the box, infinity if it misses it before t_max
+    float enter(glm::vec3 const & origin, glm::vec3 const & inv_direction, float t_min, float t_max, glm::vec3 const & min, glm::vec3 const & max)
+    {
+        glm::vec3 const t0 = (min - origin) * inv_direction;
+        glm::vec3 const t1 = (max - origin) * inv_direction;
+        glm::vec3 const near = glm::min(t0, t1);
+        glm::vec3 const far = glm::max(t0, t1);
+
+        float const t_near = std::max({t_min, near.x, near.y, near.z});
+        float const t_far = std::min({t_max, far.x, far.y, far.z});
+        return t_near <= t_far ? t_near : infinity;
+    }
+
+}
+
+std::uint32_t ray_picker::add_mesh(std::span<glm::vec3 const> positions, std::span<std::uint32_t const> indices)
+{
+    glm::vec3 min(infinity);
+    glm::vec3 max(-infinity);
+    for (auto const & p : positions)
+    {
+        min = glm::min(min, p);
+        max = glm::max(max, p);
+    }
+
+    meshes_.push_back({bvh(positions, indices), min, max});
+    return meshes_.size() - 1;
+}
+
+void ray_picker::set_instances(std::span<std::uint32_t const> meshes, std::span<glm::mat4 const> transforms)
+{
+    std::size_t const count = meshes.size();
+
+    instances_.resize(count);
+    instance_min_.resize(count);
+    instance_max_.resize(count);
+    order_.resize(count);
+
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        auto const & m = meshes_[meshes[i]];
+        instances_[i] = {meshes[i], glm::inverse(transforms[i])};
+
+        // World bounds of the transformed object-space box
+        glm::vec3 min(infinity);
+        glm::vec3 max(-infinity);
+        for (int corner = 0; corner < 8; ++corner)
+        {
+            glm::vec3 const p((corner & 1) ? m.max.x : m.min.x, (corner & 2) ? m.max.y : m.min.y, (corner & 4) ? m.max.z : m.min.z);
+            glm::vec3 const q = glm::vec3(transforms[i] * glm::vec4(p, 1.f));
+            min = glm::min(min, q);
+            max = glm::max(max, q);
+        }
+        instance_min_[i] = min;
+        instance_max_[i] = max;
+        order_[i] = i;
+    }
+
+    nodes_.clear();
+    if (count == 0)
+        return;
+
+    nodes_.emplace_back();
+    build(0, 0, count);
+}
+
+void ray_picker::build(std::uint32_t node, std::uint32_t first, std::uint32_t count)
+{
+    glm::vec3 min(infinity);
+    glm::vec3 max(-infinity);
+    for (std::uint32_t i = first; i < first + count; ++i)
+    {
+        min = glm::min(min, instance_min_[order_[i]]);
+        max = glm::max(max, instance_max_[order_[i]]);
+    }
+
+    if (count <= leaf_size)
+    {
+        nodes_[node] = {min, max, first, count};
+        return;
+    }
+
+    glm::vec3 const extent = max - min;
+    int const axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+
+    auto const begin = order_.begin() + first;
+    std::nth_element(begin, begin + count / 2, begin + count, [&](std::uint32_t a, std::uint32_t b){
+        return instance_min_[a][axis] + instance_max_[a][axis] < instance_min_[b][axis] + instance_max_[b][axis];
+    });
+
+    // The children are allocated together, so that one index finds both
+    std::uint32_t const children = nodes_.size();
+    nodes_.resize(nodes_.size() + 2);
+    nodes_[node] = {min, max, children, 0};
+
+    build(children, first, count / 2);
+    build(children + 1, first + count / 2, count - count / 2);
+}
+
+std::optional<ray_picker::hit> ray_picker::pick(ray const & r) const
+{
+    std::optional<hit> result;
+    if (nodes_.empty())
+        return result;
+
+    glm::vec3 inv_direction;
+    for (int axis = 0; axis < 3; ++axis)
+        inv_direction[axis] = 1.f / (r.direction[axis] == 0.f ? 1e-20f : r.direction[axis]);
+
+    float closest = r.t_max;
+
+    std::uint32_t stack[stack_size];
+    int size = 0;
+    stack[size++] = 0;
+
+    while (size > 0)
+    {
+        node const & n = nodes_[stack[--size]];
+        if (enter(r.origin, inv_direction, r.t_min, closest, n.min, n.max) == infinity)
+            continue;
+
+        if (n.count == 0)
+        {
+            node const & a = nodes_[n.first];
+            node const & b = nodes_[n.first + 1];
+            float const ta = enter(r.origin, inv_direction, r.t_min, closest, a.min, a.max);
+            float const tb = enter(r.origin, inv_direction, r.t_min, closest, b.min, b.max);
+
+            // The nearer child goes on top
+            if (ta <= tb)
+            {
+                if (tb != infinity)
+                    stack[size++] = n.first + 1;
+                if (ta != infinity)
+                    stack[size++] = n.first;
+            }
+            else
+            {
+                if (ta != infinity)
+                    stack[size++] = n.first;
+                stack[size++] = n.first + 1;
+            }
+            continue;
+        }
+
+        for (std::uint32_t i = n.first; i < n.first + n.count; ++i)
+        {
+            std::uint32_t const index = order_[i];
+            auto const & inst = instances_[index];
+
+            // An affine transform keeps the ray parameter, so t means the same in both spaces
+            ray local;
+            local.origin = glm::vec3(inst.world_to_object * glm::vec4(r.origin, 1.f));
+            local.direction = glm::vec3(inst.world_to_object * glm::vec4(r.direction, 0.f));
+            local.t_min = r.t_min;
+            local.t_max = closest;
+
+            auto const h = meshes_[inst.mesh].tree.intersect(local);
+            if (h && h.t < closest)
+            {
+                closest = h.t;
+                result = hit{index, inst.mesh, h.triangle, h.u, h.v, h.t, r.origin + r.direction * h.t};
+            }
+        }
+    }
+
+    return result;
+}
+
+ray cursor_ray(glm::mat4 const & view_projection, float x, float y, int width, int height)
+{
+    // Through the pixel center, from the near to the far plane
+    glm::vec2 const ndc(2.f * (x + 0.5f) / width - 1.f, 1.f - 2.f * (y + 0.5f) / height);
+
+    glm::mat4 const inverse = glm::inverse(view_projection);
+    glm::vec4 const near = inverse * glm::vec4(ndc, -1.f, 1.f);
+    glm::vec4 const far = inverse * glm::vec4(ndc, 1.f, 1.f);
+
+    glm::vec3 const origin = glm::vec3(near) / near.w;
+    glm::vec3 const end = glm::vec3(far) / far.w;
+
+    ray result;
+    result.origin = origin;
+    result.direction = glm::normalize(end - origin);
+    result.t_max = glm::distance(origin, end);
+    return result;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "bvh.hpp"
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <vector>
+
+// Two-level ray casting over instanced meshes. Every mesh gets its own BVH once, shared by all of
+// its instances; the top level is a small BVH over the world bounds of the instances, rebuilt by
+// set_instances() whenever they move. Only the instances whose bounds the ray enters are traced,
+// with the ray transformed into their object space.
+struct ray_picker
+{
+    struct hit
+    {
+        std::uint32_t instance;
+        std::uint32_t mesh;
+        // Index of the triangle in the mesh index buffer divided by 3
+        std::uint32_t triangle;
+        // Barycentric coordinates of the second and the third vertex
+        float u;
+        float v;
+        // Distance along the ray and the world-space hit point
+        float t;
+        glm::vec3 position;
+    };
+
+    // Returns the mesh index for set_instances()
+    std::uint32_t add_mesh(std::span<glm::vec3 const> positions, std::span<std::uint32_t const> indices);
+
+    // Instance i draws mesh meshes[i] with the model matrix transforms[i]
+    void set_instances(std::span<std::uint32_t const> meshes, std::span<glm::mat4 const> transforms);
+
+    std::optional<hit> pick(ray const & r) const;
+
+private:
+    struct mesh
+    {
+        bvh tree;
+        glm::vec3 min;
+        glm::vec3 max;
+    };
+
+    struct instance
+    {
+        std::uint32_t mesh;
+        glm::mat4 world_to_object;
+    };
+
+    // Inner nodes have count = 0 and the children first and first + 1,
+    // leaves cover count instances starting at order_[first]
+    struct node
+    {
+        glm::vec3 min;
+        glm::vec3 max;
+        std::uint32_t first;
+        std::uint32_t count;
+    };
+
+    // Fills node with the instances order_[first, first + count), splitting at the median
+    void build(std::uint32_t node, std::uint32_t first, std::uint32_t count);
+
+    std::vector<mesh> meshes_;
+    std::vector<instance> instances_;
+
+    std::vector<node> nodes_;
+    std::vector<std::uint32_t> order_;
+    std::vector<glm::vec3> instance_min_;
+    std::vector<glm::vec3> instance_max_;
+};
+
+// World-space ray from the camera through a window point, in pixels from the top left corner like SDL mouse events
+ray cursor_ray(glm::mat4 const & view_projection, float x, float y, int width, int height);
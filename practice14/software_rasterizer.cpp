@@ -0,0 +1,564 @@
+#include "software_rasterizer.hpp"
+
+#include <glm/geometric.hpp>
+#include <glm/common.hpp>
+#include <glm/mat3x3.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <limits>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+    int wrap(int i, int n)
+    {
+        // Texcoords are mostly inside [0, 1], the division is only needed for the rest
+        if (static_cast<unsigned>(i) < static_cast<unsigned>(n))
+            return i;
+        i %= n;
+        return i < 0 ? i + n : i;
+    }
+
+    float plane(glm::vec3 const & p, float x, float y)
+    {
+        return p.x * x + p.y * y + p.z;
+    }
+
+    // Vertices and triangles are processed in chunks of at least this many per worker
+    constexpr std::size_t min_vertices_per_chunk = 4096;
+    constexpr std::size_t min_triangles_per_chunk = 2048;
+
+    // Clipping against the actual screen edges is replaced by a guard band this many times larger,
+    // which only keeps the screen coordinates in a range where floats are precise enough
+    constexpr float guard_band = 8.f;
+
+    // Signed distances to the clip planes: near, far and the four guard band planes
+    constexpr int clip_plane_count = 6;
+
+    float clip_distance(glm::vec4 const & p, int plane)
+    {
+        switch (plane)
+        {
+        case 0: return p.z + p.w;
+        case 1: return p.w - p.z;
+        case 2: return guard_band * p.w - p.x;
+        case 3: return guard_band * p.w + p.x;
+        case 4: return guard_band * p.w - p.y;
+        default: return guard_band * p.w + p.y;
+        }
+    }
+
+    // Bit per frustum side the vertex is outside of, for the trivial rejection
+    int outcode(glm::vec4 const & p)
+    {
+        return (p.x > p.w) | ((p.x < -p.w) << 1) | ((p.y > p.w) << 2) | ((p.y < -p.w) << 3) | ((p.z > p.w) << 4) | ((p.z < -p.w) << 5);
+    }
+
+    // Coverage and depth test of the four pixels of a row starting at x. Bit i of the result
+    // is set when pixel x + i is inside the triangle and closer than the depth buffer,
+    // whose values are then replaced.
+    int cover_and_test(software_rasterizer::triangle const & t, int x, int y, float * depth)
+    {
+#ifdef __SSE2__
+        __m128 const px = _mm_add_ps(_mm_set1_ps(float(x)), _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+        float const py = y + 0.5f;
+
+        __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+        for (int k = 0; k < 3; ++k)
+        {
+            __m128 const e = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.edge_a[k]), px), _mm_set1_ps(t.edge_b[k] * py + t.edge_c[k]));
+            inside = _mm_and_ps(inside, _mm_cmpge_ps(e, _mm_set1_ps(t.edge_bias[k])));
+        }
+        if (_mm_movemask_ps(inside) == 0)
+            return 0;
+
+        __m128 const z = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(t.depth.x), px), _mm_set1_ps(t.depth.y * py + t.depth.z));
+        __m128 const old = _mm_loadu_ps(depth);
+        __m128 const pass = _mm_and_ps(inside, _mm_cmplt_ps(z, old));
+        int const mask = _mm_movemask_ps(pass);
+        if (mask)
+            _mm_storeu_ps(depth, _mm_or_ps(_mm_and_ps(pass, z), _mm_andnot_ps(pass, old)));
+        return mask;
+#else
+        float const py = y + 0.5f;
+
+        int mask = 0;
+        for (int i = 0; i < 4; ++i)
+        {
+            float const px = x + i + 0.5f;
+
+            bool inside = true;
+            for (int k = 0; k < 3; ++k)
+                inside &= (t.edge_a[k] * px + (t.edge_b[k] * py + t.edge_c[k]) >= t.edge_bias[k]);
+
+            float const z = t.depth.x * px + (t.depth.y * py + t.depth.z);
+            if (inside && z < depth[i])
+            {
+                depth[i] = z;
+                mask |= 1 << i;
+            }
+        }
+        return mask;
+#endif
+    }
+
+}
+
+software_texture::level::level(int width, int height)
+    : width(width)
+    , height(height)
+    , blocks_x((width + 3) / 4)
+    , pixels(blocks_x * ((height + 3) / 4) * 16)
+{}
+
+software_texture::software_texture(int width, int height, glm::u8vec4 const * pixels)
+{
+    auto & base = levels.emplace_back(width, height);
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < width; ++x)
+            base.texel(x, y) = pixels[y * width + x];
+
+    while (levels.back().width > 1 || levels.back().height > 1)
+    {
+        auto const & source = levels.back();
+        level next(std::max(1, source.width / 2), std::max(1, source.height / 2));
+
+        for (int y = 0; y < next.height; ++y)
+        {
+            for (int x = 0; x < next.width; ++x)
+            {
+                int const sx = std::min(2 * x + 1, source.width - 1);
+                int const sy = std::min(2 * y + 1, source.height - 1);
+
+                glm::uvec4 const sum = glm::uvec4(source.texel(2 * x, 2 * y)) + glm::uvec4(source.texel(sx, 2 * y))
+                    + glm::uvec4(source.texel(2 * x, sy)) + glm::uvec4(source.texel(sx, sy));
+                next.texel(x, y) = glm::u8vec4((sum + 2u) / 4u);
+            }
+        }
+
+        levels.push_back(std::move(next));
+    }
+}
+
+glm::vec3 software_texture::sample(glm::vec2 texcoord, float lod) const
+{
+    auto bilinear = [&](level const & l)
+    {
+        float const x = texcoord.x * l.width - 0.5f;
+        float const y = texcoord.y * l.height - 0.5f;
+        float const fx = std::floor(x);
+        float const fy = std::floor(y);
+
+        int const x0 = wrap(int(fx), l.width);
+        int const y0 = wrap(int(fy), l.height);
+        int const x1 = wrap(x0 + 1, l.width);
+        int const y1 = wrap(y0 + 1, l.height);
+
+        auto texel = [&](int x, int y){ return glm::vec3(l.texel(x, y)); };
+
+        glm::vec3 const top = glm::mix(texel(x0, y0), texel(x1, y0), x - fx);
+        glm::vec3 const bottom = glm::mix(texel(x0, y1), texel(x1, y1), x - fx);
+        return glm::mix(top, bottom, y - fy) / 255.f;
+    };
+
+    float const max_lod = levels.size() - 1;
+    lod = std::clamp(lod, 0.f, max_lod);
+
+    int const level = int(lod);
+    if (lod == float(level))
+        return bilinear(levels[level]);
+
+    return glm::mix(bilinear(levels[level]), bilinear(levels[level + 1]), lod - level);
+}
+
+software_framebuffer::software_framebuffer(int width, int height)
+    : width(width)
+    , height(height)
+    , stride((width + block_size - 1) / block_size * block_size)
+    , blocks_x(stride / block_size)
+    , blocks_y((height + block_size - 1) / block_size)
+{
+    color.resize(stride * blocks_y * block_size);
+    depth.resize(color.size());
+    block_max_depth.resize(blocks_x * blocks_y);
+    clear(glm::vec4(0.f));
+}
+
+void software_framebuffer::clear(glm::vec4 const & clear_color, float clear_depth)
+{
+    std::fill(color.begin(), color.end(), glm::u8vec4(glm::clamp(clear_color, 0.f, 1.f) * 255.f + 0.5f));
+    std::fill(depth.begin(), depth.end(), clear_depth);
+    std::fill(block_max_depth.begin(), block_max_depth.end(), clear_depth);
+}
+
+void software_rasterizer::begin_frame(software_framebuffer & target)
+{
+    target_ = &target;
+    tiles_x_ = (target.width + tile_size - 1) / tile_size;
+    tiles_y_ = (target.height + tile_size - 1) / tile_size;
+
+    bins_.resize(tiles_x_ * tiles_y_);
+    for (auto & bin : bins_)
+        bin.clear();
+
+    draws_.clear();
+    triangles_.clear();
+    stats_ = {};
+}
+
+void software_rasterizer::draw(software_draw const & draw)
+{
+    std::uint32_t const draw_index = draws_.size();
+    draws_.push_back({draw.shading, draw.albedo, draw.color, glm::normalize(draw.light_direction), draw.albedo && !draw.texcoords.empty()});
+
+    glm::mat4 const transform = draw.view_projection * draw.model;
+    glm::mat3 const normal_matrix(draw.model);
+
+    std::size_t const workers = std::max<std::size_t>(1, max_workers);
+
+    // Like parallel_for, but with at most max_workers threads
+    std::size_t const vertex_count = draw.positions.size();
+    vertices_.resize(vertex_count);
+    parallel_chunks(vertex_count, std::min(workers, std::max<std::size_t>(1, vertex_count / min_vertices_per_chunk)),
+        [&](std::size_t, std::size_t begin, std::size_t end)
+    {
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            auto & v = vertices_[i];
+            v.position = transform * glm::vec4(draw.positions[i], 1.f);
+            v.normal = draw.normals.empty() ? glm::vec3(0.f) : normal_matrix * draw.normals[i];
+            v.texcoord = draw.texcoords.empty() ? glm::vec2(0.f) : draw.texcoords[i];
+        }
+    });
+
+    std::size_t const triangle_count = draw.indices.size() / 3;
+    stats_.triangles += triangle_count;
+
+    std::size_t const chunks = std::min(workers, std::max<std::size_t>(1, triangle_count / min_triangles_per_chunk));
+    if (chunk_triangles_.size() < chunks)
+    {
+        chunk_triangles_.resize(chunks);
+        chunk_bins_.resize(chunks);
+    }
+
+    // Every chunk sets up and bins a contiguous range of triangles on its own,
+    // merging the chunks in order keeps the submission order within every tile
+    parallel_chunks(triangle_count, chunks, [&](std::size_t chunk, std::size_t begin, std::size_t end)
+    {
+        auto & result = chunk_triangles_[chunk];
+        auto & bins = chunk_bins_[chunk];
+        result.clear();
+        bins.resize(bins_.size());
+        for (auto & bin : bins)
+            bin.clear();
+
+        for (std::size_t i = begin; i < end; ++i)
+        {
+            clip_vertex polygon[3 + clip_plane_count];
+            int count = 3;
+            for (int k = 0; k < 3; ++k)
+                polygon[k] = vertices_[draw.indices[3 * i + k]];
+
+            if (outcode(polygon[0].position) & outcode(polygon[1].position) & outcode(polygon[2].position))
+                continue;
+
+            // Sutherland-Hodgman against the planes that some vertex is behind
+            for (int p = 0; p < clip_plane_count && count > 0; ++p)
+            {
+                bool outside = false;
+                for (int k = 0; k < count; ++k)
+                    outside |= clip_distance(polygon[k].position, p) < 0.f;
+                if (!outside)
+                    continue;
+
+                clip_vertex clipped[3 + clip_plane_count];
+                int clipped_count = 0;
+                for (int k = 0; k < count; ++k)
+                {
+                    auto const & a = polygon[k];
+                    auto const & b = polygon[(k + 1) % count];
+                    float const da = clip_distance(a.position, p);
+                    float const db = clip_distance(b.position, p);
+
+                    if (da >= 0.f)
+                        clipped[clipped_count++] = a;
+                    if ((da >= 0.f) != (db >= 0.f))
+                    {
+                        float const s = da / (da - db);
+                        clipped[clipped_count++] = {
+                            glm::mix(a.position, b.position, s),
+                            glm::mix(a.normal, b.normal, s),
+                            glm::mix(a.texcoord, b.texcoord, s),
+                        };
+                    }
+                }
+
+                std::copy(clipped, clipped + clipped_count, polygon);
+                count = clipped_count;
+            }
+
+            std::size_t const first = result.size();
+            setup(polygon, count, draw_index, draw.cull_back_faces, result);
+
+            for (std::size_t t = first; t < result.size(); ++t)
+            {
+                auto const & tri = result[t];
+                for (int ty = tri.min_y / tile_size; ty <= tri.max_y / tile_size; ++ty)
+                    for (int tx = tri.min_x / tile_size; tx <= tri.max_x / tile_size; ++tx)
+                        bins[ty * tiles_x_ + tx].push_back(t);
+            }
+        }
+    });
+
+    for (std::size_t chunk = 0; chunk < chunks; ++chunk)
+    {
+        std::uint32_t const base = triangles_.size();
+        triangles_.insert(triangles_.end(), chunk_triangles_[chunk].begin(), chunk_triangles_[chunk].end());
+
+        for (std::size_t tile = 0; tile < bins_.size(); ++tile)
+            for (auto t : chunk_bins_[chunk][tile])
+                bins_[tile].push_back(base + t);
+    }
+}
+
+void software_rasterizer::setup(clip_vertex const * polygon, int count, std::uint32_t draw, bool cull_back_faces, std::vector<triangle> & result) const
+{
+    float const width = target_->width;
+    float const height = target_->height;
+
+    struct screen_vertex
+    {
+        glm::vec2 position;
+        float depth;
+        float inv_w;
+        clip_vertex const * source;
+    };
+
+    auto project = [&](clip_vertex const & v)
+    {
+        float const inv_w = 1.f / v.position.w;
+        glm::vec3 const ndc = glm::vec3(v.position) * inv_w;
+        return screen_vertex{{(ndc.x * 0.5f + 0.5f) * width, (0.5f - ndc.y * 0.5f) * height}, ndc.z * 0.5f + 0.5f, inv_w, &v};
+    };
+
+    // The clipped polygon is convex, a fan covers it
+    for (int i = 1; i + 1 < count; ++i)
+    {
+        screen_vertex v[3] = {project(polygon[0]), project(polygon[i]), project(polygon[i + 1])};
+
+        // Front faces are counter-clockwise with y up, so their area is negative with y down
+        float area = (v[1].position.x - v[0].position.x) * (v[2].position.y - v[0].position.y)
+            - (v[1].position.y - v[0].position.y) * (v[2].position.x - v[0].position.x);
+        if (area == 0.f || (cull_back_faces && area > 0.f))
+            continue;
+        if (area < 0.f)
+        {
+            std::swap(v[1], v[2]);
+            area = -area;
+        }
+
+        triangle t;
+
+        glm::vec2 min = glm::min(v[0].position, glm::min(v[1].position, v[2].position));
+        glm::vec2 max = glm::max(v[0].position, glm::max(v[1].position, v[2].position));
+        t.min_x = std::max(0, int(std::floor(min.x)));
+        t.min_y = std::max(0, int(std::floor(min.y)));
+        t.max_x = std::min(target_->width - 1, int(std::ceil(max.x)));
+        t.max_y = std::min(target_->height - 1, int(std::ceil(max.y)));
+        if (t.min_x > t.max_x || t.min_y > t.max_y)
+            continue;
+
+        // Edge k is opposite to vertex k. Its coefficients are computed from the lexicographically
+        // smaller end, so the triangle on the other side of the edge gets exactly the negated function.
+        for (int k = 0; k < 3; ++k)
+        {
+            glm::vec2 const a = v[(k + 1) % 3].position;
+            glm::vec2 const b = v[(k + 2) % 3].position;
+            glm::vec2 const origin = (a.x < b.x || (a.x == b.x && a.y < b.y)) ? a : b;
+
+            t.edge_a[k] = a.y - b.y;
+            t.edge_b[k] = b.x - a.x;
+            t.edge_c[k] = -(t.edge_a[k] * origin.x + t.edge_b[k] * origin.y);
+
+            bool const top_left = t.edge_a[k] > 0.f || (t.edge_a[k] == 0.f && t.edge_b[k] > 0.f);
+            t.edge_bias[k] = top_left ? 0.f : std::numeric_limits<float>::min();
+        }
+
+        // Plane through the values at the vertices: sum of value * barycentric
+        auto value_plane = [&](float v0, float v1, float v2)
+        {
+            return glm::vec3(
+                v0 * t.edge_a[0] + v1 * t.edge_a[1] + v2 * t.edge_a[2],
+                v0 * t.edge_b[0] + v1 * t.edge_b[1] + v2 * t.edge_b[2],
+                v0 * t.edge_c[0] + v1 * t.edge_c[1] + v2 * t.edge_c[2]) / area;
+        };
+
+        t.depth = value_plane(v[0].depth, v[1].depth, v[2].depth);
+        t.inv_w = value_plane(v[0].inv_w, v[1].inv_w, v[2].inv_w);
+        for (int c = 0; c < 3; ++c)
+            t.normal[c] = value_plane(v[0].source->normal[c] * v[0].inv_w, v[1].source->normal[c] * v[1].inv_w, v[2].source->normal[c] * v[2].inv_w);
+        for (int c = 0; c < 2; ++c)
+            t.texcoord[c] = value_plane(v[0].source->texcoord[c] * v[0].inv_w, v[1].source->texcoord[c] * v[1].inv_w, v[2].source->texcoord[c] * v[2].inv_w);
+
+        t.min_depth = std::min({v[0].depth, v[1].depth, v[2].depth});
+        t.draw = draw;
+
+        result.push_back(t);
+    }
+}
+
+void software_rasterizer::rasterize_tile(int tile, statistics & stats) const
+{
+    constexpr int block_size = software_framebuffer::block_size;
+
+    auto & target = *target_;
+
+    int const tile_x0 = (tile % tiles_x_) * tile_size;
+    int const tile_y0 = (tile / tiles_x_) * tile_size;
+    int const tile_x1 = std::min(tile_x0 + tile_size, target.width) - 1;
+    int const tile_y1 = std::min(tile_y0 + tile_size, target.height) - 1;
+
+    for (auto index : bins_[tile])
+    {
+        auto const & t = triangles_[index];
+        auto const & state = draws_[t.draw];
+
+        int const bx0 = std::max(t.min_x, tile_x0) / block_size;
+        int const by0 = std::max(t.min_y, tile_y0) / block_size;
+        int const bx1 = std::min(t.max_x, tile_x1) / block_size;
+        int const by1 = std::min(t.max_y, tile_y1) / block_size;
+
+        for (int by = by0; by <= by1; ++by)
+        {
+            for (int bx = bx0; bx <= bx1; ++bx)
+            {
+                int const x0 = bx * block_size;
+                int const y0 = by * block_size;
+
+                // The block is outside when an edge is negative even at the pixel center where it is largest
+                bool outside = false;
+                for (int k = 0; k < 3; ++k)
+                {
+                    float const x = x0 + (t.edge_a[k] > 0.f ? block_size - 0.5f : 0.5f);
+                    float const y = y0 + (t.edge_b[k] > 0.f ? block_size - 0.5f : 0.5f);
+                    outside |= t.edge_a[k] * x + t.edge_b[k] * y + t.edge_c[k] < t.edge_bias[k];
+                }
+                if (outside)
+                    continue;
+
+                float & block_max_depth = target.block_max_depth[by * target.blocks_x + bx];
+                if (t.min_depth >= block_max_depth)
+                {
+                    ++stats.blocks_occluded;
+                    continue;
+                }
+
+                bool written = false;
+                for (int y = y0; y < y0 + block_size; ++y)
+                {
+                    for (int x = x0; x < x0 + block_size; x += 4)
+                    {
+                        std::size_t const offset = y * target.stride + x;
+                        int const mask = cover_and_test(t, x, y, target.depth.data() + offset);
+                        if (!mask)
+                            continue;
+
+                        written = true;
+                        if (state.shading == software_shading::depth)
+                        {
+                            stats.pixels += std::popcount(static_cast<unsigned>(mask));
+                            continue;
+                        }
+
+                        for (int i = 0; i < 4; ++i)
+                        {
+                            if (!(mask & (1 << i)))
+                                continue;
+
+                            ++stats.pixels;
+
+                            // Attributes divided by w are linear in screen space, dividing by the interpolated 1/w restores them
+                            float const px = x + i + 0.5f;
+                            float const py = y + 0.5f;
+                            float const w = 1.f / plane(t.inv_w, px, py);
+
+                            glm::vec3 albedo = state.color;
+                            if (state.textured)
+                            {
+                                glm::vec2 const texcoord = glm::vec2(plane(t.texcoord[0], px, py), plane(t.texcoord[1], px, py)) * w;
+
+                                // Screen-space derivatives of u = (u/w) / (1/w) by the quotient rule, they pick the mipmap level
+                                glm::vec2 const dx = (glm::vec2(t.texcoord[0].x, t.texcoord[1].x) - texcoord * t.inv_w.x) * w;
+                                glm::vec2 const dy = (glm::vec2(t.texcoord[0].y, t.texcoord[1].y) - texcoord * t.inv_w.y) * w;
+                                glm::vec2 const size(state.albedo->levels[0].width, state.albedo->levels[0].height);
+                                float const rho = std::max(glm::length(dx * size), glm::length(dy * size));
+
+                                albedo = state.albedo->sample(texcoord, std::log2(rho));
+                            }
+
+                            glm::vec3 const normal = glm::normalize(glm::vec3(plane(t.normal[0], px, py), plane(t.normal[1], px, py), plane(t.normal[2], px, py)));
+
+                            glm::vec3 color;
+                            switch (state.shading)
+                            {
+                            case software_shading::unlit:
+                                color = albedo;
+                                break;
+                            case software_shading::lambert:
+                                color = albedo * (0.4f + std::max(0.f, glm::dot(normal, state.light_direction)));
+                                break;
+                            default:
+                                color = normal * 0.5f + 0.5f;
+                                break;
+                            }
+
+                            target.color[offset + i] = glm::u8vec4(glm::vec4(glm::clamp(color, 0.f, 1.f), 1.f) * 255.f + 0.5f);
+                        }
+                    }
+                }
+
+                if (written)
+                {
+                    float max_depth = 0.f;
+                    for (int y = y0; y < y0 + block_size; ++y)
+                        for (int x = x0; x < x0 + block_size; ++x)
+                            max_depth = std::max(max_depth, target.depth[y * target.stride + x]);
+                    block_max_depth = max_depth;
+                }
+            }
+        }
+    }
+}
+
+software_rasterizer::statistics software_rasterizer::end_frame()
+{
+    stats_.triangles_binned = triangles_.size();
+
+    // Tiles differ a lot in cost, so workers take them one at a time instead of in fixed ranges
+    int const tile_count = bins_.size();
+    std::size_t const workers = std::clamp<std::size_t>(tile_count, 1, std::max<std::size_t>(1, max_workers));
+    std::vector<statistics> worker_stats(workers);
+    std::atomic<int> next_tile{0};
+
+    parallel_chunks(workers, workers, [&](std::size_t worker, std::size_t, std::size_t)
+    {
+        for (int tile; (tile = next_tile++) < tile_count;)
+            rasterize_tile(tile, worker_stats[worker]);
+    });
+
+    for (auto const & s : worker_stats)
+    {
+        stats_.pixels += s.pixels;
+        stats_.blocks_occluded += s.blocks_occluded;
+    }
+
+    target_ = nullptr;
+    return stats_;
+}
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/ext/vector_uint4_sized.hpp>
+
+#include <cstdint>
+#include <cstddef>
+#include <span>
+#include <vector>
+
+#include "parallel.hpp"
+
+// RGBA8 image with a mipmap chain, sampled with trilinear filtering and repeat wrapping like the GL textures
+// of the demos. Rows are stored as stbi_load returns them, so texcoords mean the same as with glTexImage2D.
+struct software_texture
+{
+    // Texels are stored in 4x4 blocks, a 64-byte cache line each, so the four texels
+    // of a bilinear lookup are almost always in the same line
+    struct level
+    {
+        level(int width, int height);
+
+        glm::u8vec4 & texel(int x, int y) { return pixels[((y >> 2) * blocks_x + (x >> 2)) * 16 + (y & 3) * 4 + (x & 3)]; }
+        glm::u8vec4 const & texel(int x, int y) const { return pixels[((y >> 2) * blocks_x + (x >> 2)) * 16 + (y & 3) * 4 + (x & 3)]; }
+
+        int width;
+        int height;
+        int blocks_x;
+        std::vector<glm::u8vec4> pixels;
+    };
+
+    // Builds the mipmap chain by averaging 2x2 texels, like glGenerateMipmap
+    software_texture(int width, int height, glm::u8vec4 const * pixels);
+
+    // lod is log2 of the number of texels per pixel, as computed by the GPU from the texcoord derivatives
+    glm::vec3 sample(glm::vec2 texcoord, float lod) const;
+
+    std::vector<level> levels;
+};
+
+// Color and depth buffers, rows from the top of the image down. Depth is window-space z in [0, 1]
+// and passes with GL_LESS. The buffers are padded to whole 8x8 blocks, rows are stride pixels apart.
+struct software_framebuffer
+{
+    software_framebuffer(int width, int height);
+
+    void clear(glm::vec4 const & color, float depth = 1.f);
+
+    glm::u8vec4 pixel(int x, int y) const { return color[y * stride + x]; }
+
+    static constexpr int block_size = 8;
+
+    int width;
+    int height;
+    int stride;
+
+    std::vector<glm::u8vec4> color;
+    std::vector<float> depth;
+
+    // Farthest depth of every block, the coarse level of the hierarchical depth test
+    int blocks_x;
+    int blocks_y;
+    std::vector<float> block_max_depth;
+};
+
+enum class software_shading
+{
+    // Only the depth buffer is written
+    depth,
+    // Albedo without lighting
+    unlit,
+    // The practice14 fragment shader: albedo * (0.4 + max(0, dot(normal, light_direction)))
+    lambert,
+    // World-space normal mapped from [-1, 1] to [0, 1]
+    normal,
+};
+
+struct software_draw
+{
+    // Read during draw() only. Texcoords may be empty, then the albedo is just the color.
+    std::span<glm::vec3 const> positions;
+    std::span<glm::vec3 const> normals;
+    std::span<glm::vec2 const> texcoords;
+    std::span<std::uint32_t const> indices;
+
+    // As the demo uniforms: the clip position is view_projection * model * position,
+    // the normal is mat3(model) * normal
+    glm::mat4 model{1.f};
+    glm::mat4 view_projection{1.f};
+
+    software_shading shading = software_shading::lambert;
+    // Has to live until end_frame()
+    software_texture const * albedo = nullptr;
+    glm::vec3 color{1.f};
+    glm::vec3 light_direction{0.f, 0.f, 1.f};
+
+    bool cull_back_faces = true;
+};
+
+// Tile-based CPU rasterizer. draw() transforms, clips and sets up the triangles and bins them into
+// 64x64 pixel tiles; end_frame() rasterizes the tiles on all cores, each tile drawing its triangles
+// in submission order. Inside a tile, 8x8 blocks are rejected by the edge functions and by the
+// hierarchical depth test, and the remaining pixels are covered and depth tested four at a time.
+struct software_rasterizer
+{
+    struct statistics
+    {
+        std::size_t triangles = 0;
+        // Triangles left after culling and clipping, a clipped triangle may turn into several
+        std::size_t triangles_binned = 0;
+        // Pixels that passed the depth test
+        std::size_t pixels = 0;
+        // Blocks of a triangle skipped because the triangle is behind everything drawn there
+        std::size_t blocks_occluded = 0;
+    };
+
+    static constexpr int tile_size = 64;
+
+    // Threads draw() and end_frame() may use; end_frame() never uses more than there are tiles.
+    // Callers that already keep every core busy, like the impostor baker, set it to 1 to run
+    // everything on the calling thread.
+    std::size_t max_workers = worker_count();
+
+    void begin_frame(software_framebuffer & target);
+    void draw(software_draw const & draw);
+    statistics end_frame();
+
+    // Per-triangle data, public for the helpers in the implementation file
+    struct triangle
+    {
+        // Edge functions a * x + b * y + c, non-negative inside; bias is 0 on top-left edges
+        // and the smallest positive float on the others, to never draw a pixel twice
+        float edge_a[3];
+        float edge_b[3];
+        float edge_c[3];
+        float edge_bias[3];
+
+        // Planes of the values linear in screen space: depth, 1/w and the attributes divided by w
+        glm::vec3 depth;
+        glm::vec3 inv_w;
+        glm::vec3 normal[3];
+        glm::vec3 texcoord[2];
+
+        float min_depth;
+        int min_x, min_y, max_x, max_y;
+        std::uint32_t draw;
+    };
+
+private:
+    struct draw_state
+    {
+        software_shading shading;
+        software_texture const * albedo;
+        glm::vec3 color;
+        glm::vec3 light_direction;
+        bool textured;
+    };
+
+    struct clip_vertex
+    {
+        glm::vec4 position;
+        glm::vec3 normal;
+        glm::vec2 texcoord;
+    };
+
+    void setup(clip_vertex const * polygon, int count, std::uint32_t draw, bool cull_back_faces, std::vector<triangle> & result) const;
+    void rasterize_tile(int tile, statistics & stats) const;
+
+    software_framebuffer * target_ = nullptr;
+    int tiles_x_ = 0;
+    int tiles_y_ = 0;
+
+    std::vector<draw_state> draws_;
+    std::vector<triangle> triangles_;
+    std::vector<std::vector<std::uint32_t>> bins_;
+    statistics stats_;
+
+    // Reused between draws, so that a frame does not allocate once the sizes settle
+    std::vector<clip_vertex> vertices_;
+    std::vector<std::vector<triangle>> chunk_triangles_;
+    std::vector<std::vector<std::vector<std::uint32_t>>> chunk_bins_;
+};
@@ -0,0 +1,278 @@
+#include "transform_hierarchy.hpp"
+
+#include <algorithm>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+namespace
+{
+
+#ifdef __SSE__
+    // Four lanes of the same component of four different nodes
+    struct float4
+    {
+        __m128 v;
+
+        float4() = default;
+        float4(float x) : v(_mm_set1_ps(x)) {}
+        float4(__m128 v) : v(v) {}
+    };
+
+    float4 operator + (float4 a, float4 b) { return _mm_add_ps(a.v, b.v); }
+    float4 operator - (float4 a, float4 b) { return _mm_sub_ps(a.v, b.v); }
+    float4 operator * (float4 a, float4 b) { return _mm_mul_ps(a.v, b.v); }
+#endif
+
+    // Columns of the upper 3x3 of scale * rotation, written once for both one and four nodes at a time
+    template <typename T>
+    void rotation_scale(T qx, T qy, T qz, T qw, T sx, T sy, T sz, T (&m)[9])
+    {
+        T const one = 1.f;
+        T const two = 2.f;
+
+        T const xx = qx * qx, yy = qy * qy, zz = qz * qz;
+        T const xy = qx * qy, xz = qx * qz, yz = qy * qz;
+        T const wx = qw * qx, wy = qw * qy, wz = qw * qz;
+
+        m[0] = (one - two * (yy + zz)) * sx;
+        m[1] = two * (xy + wz) * sx;
+        m[2] = two * (xz - wy) * sx;
+
+        m[3] = two * (xy - wz) * sy;
+        m[4] = (one - two * (xx + zz)) * sy;
+        m[5] = two * (yz + wx) * sy;
+
+        m[6] = two * (xz + wy) * sz;
+        m[7] = two * (yz - wx) * sz;
+        m[8] = (one - two * (xx + yy)) * sz;
+    }
+
+    glm::mat4 multiply(glm::mat4 const & a, glm::mat4 const & b)
+    {
+#ifdef __SSE__
+        __m128 const a0 = _mm_loadu_ps(&a[0][0]);
+        __m128 const a1 = _mm_loadu_ps(&a[1][0]);
+        __m128 const a2 = _mm_loadu_ps(&a[2][0]);
+        __m128 const a3 = _mm_loadu_ps(&a[3][0]);
+
+        glm::mat4 result;
+        for (int i = 0; i < 4; ++i)
+        {
+            __m128 column = _mm_mul_ps(a0, _mm_set1_ps(b[i][0]));
+            column = _mm_add_ps(column, _mm_mul_ps(a1, _mm_set1_ps(b[i][1])));
+            column = _mm_add_ps(column, _mm_mul_ps(a2, _mm_set1_ps(b[i][2])));
+            column = _mm_add_ps(column, _mm_mul_ps(a3, _mm_set1_ps(b[i][3])));
+            _mm_storeu_ps(&result[i][0], column);
+        }
+        return result;
+#else
+        return a * b;
+#endif
+    }
+
+}
+
+std::uint32_t transform_hierarchy::add(std::uint32_t parent, glm::vec3 const & translation, glm::quat const & rotation, glm::vec3 const & scale)
+{
+    std::uint32_t const node = parents_.size();
+
+    parents_.push_back(parent);
+    first_child_.push_back(no_parent);
+    next_sibling_.push_back(no_parent);
+    last_child_.push_back(no_parent);
+    subtree_size_.push_back(1);
+    for (std::uint32_t ancestor = parent; ancestor != no_parent; ancestor = parents_[ancestor])
+        ++subtree_size_[ancestor];
+    if (parent != no_parent)
+    {
+        if (last_child_[parent] == no_parent)
+            first_child_[parent] = node;
+        else
+            next_sibling_[last_child_[parent]] = node;
+        last_child_[parent] = node;
+    }
+
+    tx_.push_back(translation.x);
+    ty_.push_back(translation.y);
+    tz_.push_back(translation.z);
+    qx_.push_back(rotation.x);
+    qy_.push_back(rotation.y);
+    qz_.push_back(rotation.z);
+    qw_.push_back(rotation.w);
+    sx_.push_back(scale.x);
+    sy_.push_back(scale.y);
+    sz_.push_back(scale.z);
+
+    local_.emplace_back(1.f);
+    world_.emplace_back(1.f);
+    local_dirty_.push_back(0);
+    changed_.push_back(0);
+
+    mark_dirty(node);
+    return node;
+}
+
+void transform_hierarchy::mark_dirty(std::uint32_t node)
+{
+    if (!local_dirty_[node])
+    {
+        local_dirty_[node] = 1;
+        dirty_.push_back(node);
+    }
+}
+
+void transform_hierarchy::set_translation(std::uint32_t node, glm::vec3 const & translation)
+{
+    tx_[node] = translation.x;
+    ty_[node] = translation.y;
+    tz_[node] = translation.z;
+    mark_dirty(node);
+}
+
+void transform_hierarchy::set_rotation(std::uint32_t node, glm::quat const & rotation)
+{
+    qx_[node] = rotation.x;
+    qy_[node] = rotation.y;
+    qz_[node] = rotation.z;
+    qw_[node] = rotation.w;
+    mark_dirty(node);
+}
+
+void transform_hierarchy::set_scale(std::uint32_t node, glm::vec3 const & scale)
+{
+    sx_[node] = scale.x;
+    sy_[node] = scale.y;
+    sz_[node] = scale.z;
+    mark_dirty(node);
+}
+
+glm::vec3 transform_hierarchy::translation(std::uint32_t node) const
+{
+    return {tx_[node], ty_[node], tz_[node]};
+}
+
+glm::quat transform_hierarchy::rotation(std::uint32_t node) const
+{
+    return glm::quat(qw_[node], qx_[node], qy_[node], qz_[node]);
+}
+
+glm::vec3 transform_hierarchy::scale(std::uint32_t node) const
+{
+    return {sx_[node], sy_[node], sz_[node]};
+}
+
+void transform_hierarchy::update_local()
+{
+    std::size_t i = 0;
+#ifdef __SSE__
+    // Four dirty nodes at a time. dirty_ is sorted, so four consecutive nodes, the common case when
+    // whole groups change, are read from the component arrays with plain loads instead of gathers.
+    // The results are transposed back into one column of each of the four matrices at a time.
+    for (; i + 4 <= dirty_.size(); i += 4)
+    {
+        std::uint32_t const * nodes = dirty_.data() + i;
+        bool const contiguous = nodes[3] - nodes[0] == 3;
+
+        auto load = [&](std::vector<float> const & values) -> float4
+        {
+            if (contiguous)
+                return _mm_loadu_ps(values.data() + nodes[0]);
+            return _mm_setr_ps(values[nodes[0]], values[nodes[1]], values[nodes[2]], values[nodes[3]]);
+        };
+
+        float4 m[9];
+        rotation_scale<float4>(load(qx_), load(qy_), load(qz_), load(qw_), load(sx_), load(sy_), load(sz_), m);
+
+        auto store_column = [&](int column, __m128 x, __m128 y, __m128 z, __m128 w)
+        {
+            _MM_TRANSPOSE4_PS(x, y, z, w);
+            _mm_storeu_ps(&local_[nodes[0]][column][0], x);
+            _mm_storeu_ps(&local_[nodes[1]][column][0], y);
+            _mm_storeu_ps(&local_[nodes[2]][column][0], z);
+            _mm_storeu_ps(&local_[nodes[3]][column][0], w);
+        };
+
+        __m128 const zero = _mm_setzero_ps();
+        store_column(0, m[0].v, m[1].v, m[2].v, zero);
+        store_column(1, m[3].v, m[4].v, m[5].v, zero);
+        store_column(2, m[6].v, m[7].v, m[8].v, zero);
+        store_column(3, load(tx_).v, load(ty_).v, load(tz_).v, _mm_set1_ps(1.f));
+    }
+#endif
+    for (; i < dirty_.size(); ++i)
+    {
+        std::uint32_t const node = dirty_[i];
+
+        float m[9];
+        rotation_scale<float>(qx_[node], qy_[node], qz_[node], qw_[node], sx_[node], sy_[node], sz_[node], m);
+
+        auto & local = local_[node];
+        local[0] = glm::vec4(m[0], m[1], m[2], 0.f);
+        local[1] = glm::vec4(m[3], m[4], m[5], 0.f);
+        local[2] = glm::vec4(m[6], m[7], m[8], 0.f);
+        local[3] = glm::vec4(tx_[node], ty_[node], tz_[node], 1.f);
+    }
+}
+
+std::size_t transform_hierarchy::update()
+{
+    for (std::uint32_t const node : changed_nodes_)
+        changed_[node] = 0;
+    changed_nodes_.clear();
+
+    if (dirty_.empty())
+        return 0;
+
+    // Topological order puts every dirty ancestor first, so a dirty node inside a subtree
+    // that was already walked is skipped. Sorted nodes also batch better in update_local.
+    std::sort(dirty_.begin(), dirty_.end());
+
+    update_local();
+
+    auto update_world = [&](std::uint32_t node)
+    {
+        std::uint32_t const parent = parents_[node];
+        world_[node] = (parent == no_parent) ? local_[node] : multiply(world_[parent], local_[node]);
+        changed_[node] = 1;
+        changed_nodes_.push_back(node);
+        local_dirty_[node] = 0;
+    };
+
+    // Upper bound on the number of nodes to update, nested dirty nodes are counted twice
+    std::size_t work = 0;
+    for (std::uint32_t const node : dirty_)
+        work += subtree_size_[node];
+
+    std::uint32_t const first = dirty_.front();
+    if (4 * work >= parents_.size() - first)
+    {
+        // Topological order means a single forward sweep from the first dirty node
+        // sees every parent's world matrix before the children need it
+        for (std::uint32_t node = first; node < parents_.size(); ++node)
+        {
+            std::uint32_t const parent = parents_[node];
+            if (local_dirty_[node] || (parent != no_parent && changed_[parent]))
+                update_world(node);
+        }
+    }
+    else
+    {
+        // Breadth-first through the subtree of every dirty node: changed_nodes_ doubles as the queue
+        for (std::uint32_t const root : dirty_)
+        {
+            if (changed_[root])
+                continue;
+
+            std::size_t next = changed_nodes_.size();
+            update_world(root);
+            for (; next < changed_nodes_.size(); ++next)
+                for (std::uint32_t child = first_child_[changed_nodes_[next]]; child != no_parent; child = next_sibling_[child])
+                    update_world(child);
+        }
+    }
+
+    dirty_.clear();
+    return changed_nodes_.size();
+}
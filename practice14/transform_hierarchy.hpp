@@ -0,0 +1,75 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+// Scene graph transforms. Local translation, rotation and scale are stored per component
+// (structure of arrays), nodes are kept in topological order (every parent before its children),
+// and update() recomputes local and world matrices only for the nodes changed since the last
+// update and their descendants. Local matrices are built four nodes at a time with SSE. Small
+// changed subtrees are walked down the child lists, so their cost does not depend on the size of
+// the scene; when the changed subtrees cover a good part of the scene, a single forward sweep
+// over the nodes is cheaper and is used instead.
+struct transform_hierarchy
+{
+    static constexpr std::uint32_t no_parent = -1;
+
+    // The parent must already exist, which keeps the nodes in topological order
+    std::uint32_t add(std::uint32_t parent, glm::vec3 const & translation = glm::vec3(0.f),
+        glm::quat const & rotation = glm::quat(1.f, 0.f, 0.f, 0.f), glm::vec3 const & scale = glm::vec3(1.f));
+
+    void set_translation(std::uint32_t node, glm::vec3 const & translation);
+    void set_rotation(std::uint32_t node, glm::quat const & rotation);
+    void set_scale(std::uint32_t node, glm::vec3 const & scale);
+
+    glm::vec3 translation(std::uint32_t node) const;
+    glm::quat rotation(std::uint32_t node) const;
+    glm::vec3 scale(std::uint32_t node) const;
+
+    std::uint32_t parent(std::uint32_t node) const { return parents_[node]; }
+    std::size_t size() const { return parents_.size(); }
+
+    // Returns the number of world matrices that were recomputed
+    std::size_t update();
+
+    glm::mat4 const & world(std::uint32_t node) const { return world_[node]; }
+
+    // Whether the world matrix changed in the last update
+    bool changed(std::uint32_t node) const { return changed_[node]; }
+
+    // Nodes whose world matrices changed in the last update, every parent before its children
+    std::vector<std::uint32_t> const & changed_nodes() const { return changed_nodes_; }
+
+private:
+    void mark_dirty(std::uint32_t node);
+
+    // Computes local matrices of the dirty_ nodes
+    void update_local();
+
+    std::vector<std::uint32_t> parents_;
+    // Children of a node in the order they were added, as a singly linked list ended by no_parent
+    std::vector<std::uint32_t> first_child_;
+    std::vector<std::uint32_t> next_sibling_;
+    std::vector<std::uint32_t> last_child_;
+    // Number of nodes in the subtree of a node, the node included
+    std::vector<std::uint32_t> subtree_size_;
+
+    std::vector<float> tx_, ty_, tz_;
+    std::vector<float> qx_, qy_, qz_, qw_;
+    std::vector<float> sx_, sy_, sz_;
+
+    std::vector<glm::mat4> local_;
+    std::vector<glm::mat4> world_;
+
+    // Nodes with a changed local transform, each listed once
+    std::vector<std::uint32_t> dirty_;
+    std::vector<std::uint8_t> local_dirty_;
+
+    std::vector<std::uint8_t> changed_;
+    std::vector<std::uint32_t> changed_nodes_;
+};
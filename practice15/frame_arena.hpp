@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Bump allocator for data that lives for a frame: per-frame instance lists, bone matrices,
+// vertices that are uploaded right away. Two blocks are used in turns, so whatever was
+// allocated in a frame stays valid during the next one (while the GPU may still read it)
+// and is dropped all at once, in O(1), when the block is reused.
+struct frame_arena
+{
+    explicit frame_arena(std::size_t capacity = 1 << 20);
+    ~frame_arena();
+
+    frame_arena(frame_arena const &) = delete;
+    frame_arena & operator = (frame_arena const &) = delete;
+
+    // Switches to the other block, releases what was allocated in it two frames ago
+    // and makes this arena the one used by default-constructed arena_allocator-s on this thread.
+    // In debug builds also starts counting general-heap allocations of this thread.
+    void begin_frame();
+
+    // Returns the number of operator new calls on this thread since begin_frame,
+    // always 0 in release builds
+    std::size_t end_frame();
+
+    void * allocate(std::size_t size, std::size_t alignment);
+
+    // Bytes allocated in the current frame
+    std::size_t used() const { return used_; }
+
+    // Totals over all frames so far, to report once at exit rather than every frame;
+    // the heap allocation counts are always 0 in release builds
+    std::size_t frames() const { return frames_; }
+    std::size_t allocating_frames() const { return allocating_frames_; }
+    std::size_t total_heap_allocations() const { return total_heap_allocations_; }
+
+    // Arena of the current frame on this thread
+    static frame_arena & current();
+
+private:
+    struct overflow_chunk;
+
+    struct block
+    {
+        std::unique_ptr<std::byte[]> data;
+        std::size_t capacity = 0;
+        std::size_t offset = 0;
+        // Allocations that did not fit, freed when the block is reused
+        overflow_chunk * overflow = nullptr;
+        std::size_t overflow_size = 0;
+    };
+
+    void release_overflow(block & b);
+
+    block blocks_[2];
+    int current_ = 0;
+    std::size_t used_ = 0;
+
+    std::size_t frames_ = 0;
+    std::size_t allocating_frames_ = 0;
+    std::size_t total_heap_allocations_ = 0;
+};
+
+// Standard allocator on top of a frame_arena, deallocation is a no-op
+template <typename T>
+struct arena_allocator
+{
+    using value_type = T;
+
+    frame_arena * arena;
+
+    arena_allocator() : arena(&frame_arena::current()) {}
+    arena_allocator(frame_arena & arena) : arena(&arena) {}
+
+    template <typename U>
+    arena_allocator(arena_allocator<U> const & other) : arena(other.arena) {}
+
+    T * allocate(std::size_t n)
+    {
+        return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *, std::size_t) {}
+
+    template <typename U>
+    bool operator == (arena_allocator<U> const & other) const { return arena == other.arena; }
+};
+
+template <typename T>
+using frame_vector = std::vector<T, arena_allocator<T>>;
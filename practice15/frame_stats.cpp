@@ -0,0 +1,185 @@
+#include "frame_stats.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+namespace
+{
+
+    float milliseconds(std::chrono::steady_clock::duration duration)
+    {
+        return std::chrono::duration<float, std::milli>(duration).count();
+    }
+
+}
+
+frame_stats::frame_stats(std::vector<std::string> phases, std::size_t window, std::string const & csv_path)
+    : phase_names_(std::move(phases))
+    , window_(window)
+    , frames_(window)
+{
+    if (phase_names_.size() > max_phases)
+        throw std::invalid_argument("Too many frame phases");
+    if (window_ == 0)
+        throw std::invalid_argument("Empty frame stats window");
+
+    scratch_.reserve(window_);
+    // A header line, the frame and gpu lines, a line per phase and the stutter line
+    report_.resize(128 * (phase_names_.size() + 4));
+
+    if (!csv_path.empty())
+    {
+        csv_.open(csv_path);
+        if (!csv_)
+            throw std::runtime_error("Failed to open " + csv_path);
+
+        csv_ << "frame,cpu_ms,gpu_ms";
+        for (auto const & name : phase_names_)
+            csv_ << ',' << name << "_ms";
+        csv_ << '\n';
+    }
+}
+
+frame_stats::~frame_stats()
+{
+    if (!csv_.is_open())
+        return;
+
+    std::size_t const first = frame_count_ > window_ ? frame_count_ - window_ : 0;
+    for (std::size_t i = first; i < frame_count_; ++i)
+        write_csv_row(i);
+}
+
+std::size_t frame_stats::begin_frame()
+{
+    frame_start_ = clock::now();
+    current_phase_ = max_phases;
+
+    // The oldest frame leaves the ring, its GPU time had window frames to arrive
+    if (frame_count_ >= window_ && csv_.is_open())
+        write_csv_row(frame_count_ - window_);
+
+    frames_[frame_count_ % window_] = {};
+    return frame_count_++;
+}
+
+void frame_stats::begin_phase(std::size_t phase)
+{
+    auto const now = clock::now();
+    if (current_phase_ < max_phases)
+        current().phases[current_phase_] += milliseconds(now - phase_start_);
+
+    current_phase_ = phase;
+    phase_start_ = now;
+}
+
+void frame_stats::end_frame()
+{
+    auto const now = clock::now();
+    auto & f = current();
+
+    if (current_phase_ < max_phases)
+        f.phases[current_phase_] += milliseconds(now - phase_start_);
+    current_phase_ = max_phases;
+
+    f.cpu = milliseconds(now - frame_start_);
+
+    // The first frames of the window have no meaningful median yet
+    if (frame_count_ > 16 && f.cpu > stutter_factor * cpu().p50)
+        ++stutters_;
+}
+
+void frame_stats::set_gpu_time(std::size_t frame, float milliseconds)
+{
+    if (frame < frame_count_ && frame + window_ >= frame_count_)
+        frames_[frame % window_].gpu = milliseconds;
+}
+
+template <typename Value>
+frame_stats::summary frame_stats::summarize(Value && value) const
+{
+    scratch_.clear();
+    // The order of the frames does not matter, they get sorted anyway
+    std::size_t const count = std::min(frame_count_, window_);
+    for (std::size_t i = 0; i < count; ++i)
+        if (float const v = value(frames_[i]); v >= 0.f)
+            scratch_.push_back(v);
+
+    summary result;
+    if (scratch_.empty())
+        return result;
+
+    std::sort(scratch_.begin(), scratch_.end());
+
+    // Nearest-rank percentile
+    auto percentile = [&](float p)
+    {
+        std::size_t const rank = std::max<std::size_t>(1, static_cast<std::size_t>(p / 100.f * scratch_.size() + 0.999f));
+        return scratch_[std::min(rank, scratch_.size()) - 1];
+    };
+
+    for (float v : scratch_)
+        result.mean += v;
+    result.mean /= scratch_.size();
+
+    result.p50 = percentile(50.f);
+    result.p95 = percentile(95.f);
+    result.p99 = percentile(99.f);
+    result.max = scratch_.back();
+    return result;
+}
+
+frame_stats::summary frame_stats::cpu() const
+{
+    return summarize([](frame const & f){ return f.cpu; });
+}
+
+frame_stats::summary frame_stats::gpu() const
+{
+    return summarize([](frame const & f){ return f.gpu; });
+}
+
+frame_stats::summary frame_stats::phase(std::size_t phase) const
+{
+    return summarize([phase](frame const & f){ return f.phases[phase]; });
+}
+
+std::string_view frame_stats::report() const
+{
+    std::size_t size = 0;
+
+    // snprintf truncates whatever does not fit, so the report is cut short rather than reallocated
+    auto print = [&](char const * format, auto ... args)
+    {
+        std::size_t const room = report_.size() - size;
+        int const written = std::snprintf(report_.data() + size, room, format, args...);
+        if (written > 0)
+            size += std::min<std::size_t>(written, room - 1);
+    };
+
+    auto add = [&](char const * name, summary const & s)
+    {
+        print("%-8s %6.2f %6.2f %6.2f %6.2f %6.2f\n", name, s.mean, s.p50, s.p95, s.p99, s.max);
+    };
+
+    print("ms         mean    p50    p95    p99    max\n");
+    add("frame", cpu());
+    add("gpu", gpu());
+    for (std::size_t i = 0; i < phase_names_.size(); ++i)
+        add(phase_names_[i].c_str(), phase(i));
+
+    print("stutters %zu in %zu frames", stutters_, frame_count_);
+    return {report_.data(), size};
+}
+
+void frame_stats::write_csv_row(std::size_t index)
+{
+    auto const & f = frames_[index % window_];
+    csv_ << index << ',' << f.cpu << ',';
+    if (f.gpu >= 0.f)
+        csv_ << f.gpu;
+    for (std::size_t p = 0; p < phase_names_.size(); ++p)
+        csv_ << ',' << f.phases[p];
+    csv_ << '\n';
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Per-frame timings: total CPU frame time, GPU time (which arrives a few frames late,
+// from timer queries) and CPU time of named phases of the frame. Only a ring of the last
+// window frames is kept and the statistics are computed over it; the whole history can be
+// streamed to a CSV file, a row per frame as it leaves the ring. Nothing is allocated per frame.
+struct frame_stats
+{
+    struct summary
+    {
+        float mean = 0.f;
+        float p50 = 0.f;
+        float p95 = 0.f;
+        float p99 = 0.f;
+        float max = 0.f;
+    };
+
+    // With a non-empty csv_path the history is written to that file, the last frames by the destructor
+    explicit frame_stats(std::vector<std::string> phases, std::size_t window = 512, std::string const & csv_path = {});
+    ~frame_stats();
+
+    // Returns the frame index, to attach the GPU time to it later
+    std::size_t begin_frame();
+    // Time from now until the next begin_phase or end_frame goes to the given phase
+    void begin_phase(std::size_t phase);
+    void end_frame();
+
+    // Ignored for frames that already left the window
+    void set_gpu_time(std::size_t frame, float milliseconds);
+
+    std::size_t frame_count() const { return frame_count_; }
+
+    summary cpu() const;
+    summary gpu() const;
+    summary phase(std::size_t phase) const;
+
+    // Frames that took more than stutter_factor times the rolling median
+    static constexpr float stutter_factor = 2.f;
+    std::size_t stutters() const { return stutters_; }
+
+    // A few lines of text with the numbers above, for an on-screen overlay. Formatted into a buffer
+    // allocated up front, valid until the next call; never longer than max_report_size().
+    std::string_view report() const;
+    std::size_t max_report_size() const { return report_.size(); }
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr std::size_t max_phases = 4;
+
+    struct frame
+    {
+        float cpu = 0.f;
+        // Negative until the timer query result arrives
+        float gpu = -1.f;
+        float phases[max_phases] = {};
+    };
+
+    template <typename Value>
+    summary summarize(Value && value) const;
+
+    frame & current() { return frames_[(frame_count_ - 1) % window_]; }
+    void write_csv_row(std::size_t index);
+
+    std::vector<std::string> phase_names_;
+    std::size_t window_;
+
+    // Frame i lives in frames_[i % window_] until frame i + window_ begins
+    std::vector<frame> frames_;
+    std::size_t frame_count_ = 0;
+    std::size_t stutters_ = 0;
+
+    std::ofstream csv_;
+
+    clock::time_point frame_start_;
+    clock::time_point phase_start_;
+    std::size_t current_phase_ = max_phases;
+
+    mutable std::vector<float> scratch_;
+    mutable std::vector<char> report_;
+};
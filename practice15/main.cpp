@@ -16,6 +16,12 @@
 #include <random>
 #include <map>
 #include <cmath>
+#include <optional>
+#include <algorithm>
+#include <sstream>
+#include <cstdio>
+#include <utility>
+#include <limits>
 
 #include <glm/vec3.hpp>
 #include <glm/mat4x4.hpp>
@@ -26,6 +32,11 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "msdf_loader.hpp"
+#include "text_layout.hpp"
+#include "text_document.hpp"
+#include "frame_arena.hpp"
+#include "frame_stats.hpp"
+#include "utf8.hpp"
 #include "stb_image.h"
 
 std::string to_string(std::string_view str)
@@ -46,17 +57,31 @@ void glew_fail(std::string_view message, GLenum error)
 const char msdf_vertex_shader_source[] =
 R"(#version 330 core
 
-layout (location = 0) in vec2 position;
-layout (location = 1) in vec2 in_texcoord;
+layout (location = 0) in vec2 in_position;
+layout (location = 1) in uvec2 in_glyph;
+layout (location = 2) in vec4 in_color;
 
 uniform mat4 transform;
+uniform float glyph_scale;
 
-out vec2 texcoord;
+// Two texels per glyph: atlas rectangle (min, max) and quad geometry (offset, size) in font pixels
+uniform samplerBuffer glyph_table;
+
+out vec3 texcoord;
+out vec4 color;
 
 void main()
 {
+    vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+
+    vec4 rect = texelFetch(glyph_table, int(in_glyph.x) * 2);
+    vec4 geometry = texelFetch(glyph_table, int(in_glyph.x) * 2 + 1);
+
+    vec2 position = in_position + (geometry.xy + corner * geometry.zw) * glyph_scale;
+
     gl_Position = transform * vec4(position, 0.0, 1.0);
-    texcoord = in_texcoord;
+    texcoord = vec3(mix(rect.xy, rect.zw, corner), float(in_glyph.y));
+    color = in_color;
 }
 )";
 
@@ -65,10 +90,11 @@ R"(#version 330 core
 
 layout (location = 0) out vec4 out_color;
 
-uniform sampler2D sdf_texture;
+uniform sampler2DArray sdf_texture;
 uniform float sdf_scale;
 
-in vec2 texcoord;
+in vec3 texcoord;
+in vec4 color;
 
 float median(vec3 v) {
     return max(min(v.r, v.g), min(max(v.r, v.g), v.b));
@@ -79,8 +105,8 @@ void main()
     float sdf_value = sdf_scale * (median(texture(sdf_texture, texcoord).rgb) - 0.5);
     float smooth_constant = length(vec2(dFdx(sdf_value), dFdy(sdf_value))) / sqrt(2.0);
     float alpha = smoothstep(-smooth_constant, smooth_constant, sdf_value);
-    vec3 color = sdf_value < 0.4 ? vec3(1.0) : vec3(0.0);
-    out_color = vec4(color, alpha);
+    vec3 fill = sdf_value < 0.4 ? vec3(1.0) : color.rgb;
+    out_color = vec4(fill, alpha * color.a);
 }
 )";
 
@@ -123,14 +149,7 @@ GLuint create_program(Shaders ... shaders)
     return result;
 }
 
-struct vertex {
-    glm::vec2 position;
-    glm::vec2 texcoord;
-
-    vertex(glm::vec2 position, glm::vec2 texcoord) : position(position), texcoord(texcoord) {}
-};
-
-int main() try
+int main(int argc, char ** argv) try
 {
     if (SDL_Init(SDL_INIT_VIDEO) != 0)
         sdl2_fail("SDL_Init: ");
@@ -172,16 +191,39 @@ int main() try
 
     GLuint transform_location = glGetUniformLocation(msdf_program, "transform");
     GLuint scale_location = glGetUniformLocation(msdf_program, "sdf_scale");
+    GLuint glyph_scale_location = glGetUniformLocation(msdf_program, "glyph_scale");
+    GLuint sdf_texture_location = glGetUniformLocation(msdf_program, "sdf_texture");
+    GLuint glyph_table_location = glGetUniformLocation(msdf_program, "glyph_table");
 
     const std::string project_root = PROJECT_ROOT;
     const std::string font_path = project_root + "/font/font-msdf.json";
 
     auto const font = load_msdf_font(font_path);
 
-    std::vector<vertex> vertices;
-    vertices.push_back(vertex({0, 0}, {0, 0}));
-    vertices.push_back(vertex({100, 0}, {1, 0}));
-    vertices.push_back(vertex({0, 100}, {0, 1}));
+    // glyph_instance keeps glyph indices and atlas pages in 16 bits
+    if (font.glyphs.size() > std::numeric_limits<std::uint16_t>::max())
+        throw std::runtime_error("Fonts with more than 65535 glyphs are not supported");
+    if (font.texture_paths.size() > std::numeric_limits<std::uint16_t>::max())
+        throw std::runtime_error("Fonts with more than 65535 atlas pages are not supported");
+
+    std::vector<glyph_instance> instances;
+
+    // line_first_instance[i] is where the glyphs of the i-th line start
+    std::vector<std::size_t> line_first_instance = {0};
+    std::size_t vbo_capacity = 0;
+
+    auto setup_glyph_attributes = []
+    {
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glyph_instance), (void *) offsetof(glyph_instance, position));
+        glVertexAttribDivisor(0, 1);
+        glEnableVertexAttribArray(1);
+        glVertexAttribIPointer(1, 2, GL_UNSIGNED_SHORT, sizeof(glyph_instance), (void *) offsetof(glyph_instance, glyph));
+        glVertexAttribDivisor(1, 1);
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(glyph_instance), (void *) offsetof(glyph_instance, color));
+        glVertexAttribDivisor(2, 1);
+    };
 
     GLuint vao;
     glGenVertexArrays(1, &vao);
@@ -190,28 +232,88 @@ int main() try
     GLuint vbo;
     glGenBuffers(1, &vbo);
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
-//    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertices[0]), vertices.data(), GL_STATIC_DRAW);
+    setup_glyph_attributes();
 
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), (void *) offsetof(vertex, position));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), (void *) offsetof(vertex, texcoord));
+    // Only the visible lines of the document are ever uploaded here
+    std::size_t document_instance_count = 0;
 
-    GLuint texture;
-    int texture_width, texture_height;
+    GLuint document_vao;
+    glGenVertexArrays(1, &document_vao);
+    glBindVertexArray(document_vao);
+
+    GLuint document_vbo;
+    glGenBuffers(1, &document_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, document_vbo);
+    setup_glyph_attributes();
+
+    // Frame statistics overlay, laid out in window pixels from the top-left corner
+    std::size_t overlay_instance_count = 0;
+
+    GLuint overlay_vao;
+    glGenVertexArrays(1, &overlay_vao);
+    glBindVertexArray(overlay_vao);
+
+    GLuint overlay_vbo;
+    glGenBuffers(1, &overlay_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, overlay_vbo);
+    setup_glyph_attributes();
+
+    // A few timer queries in flight, so reading one back does not wait for the GPU
+    constexpr std::size_t query_count = 4;
+    GLuint queries[query_count];
+    std::size_t query_frame[query_count];
+    bool query_used[query_count] = {};
+    glGenQueries(query_count, queries);
+
+    GLuint glyph_table_buffer, glyph_table_texture;
     {
-        int channels;
-        auto data = stbi_load(font.texture_path.c_str(), &texture_width, &texture_height, &channels, 4);
-        assert(data);
+        std::vector<glm::vec4> table;
+        table.reserve(2 * font.glyphs.size());
+        for (auto const & glyph : font.glyphs)
+        {
+            table.emplace_back(glyph.texcoord_min, glyph.texcoord_max);
+            table.emplace_back(glyph.xoffset, glyph.yoffset, glyph.width, glyph.height);
+        }
+
+        glGenBuffers(1, &glyph_table_buffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, glyph_table_buffer);
+        glBufferData(GL_TEXTURE_BUFFER, table.size() * sizeof(table[0]), table.data(), GL_STATIC_DRAW);
+
+        glGenTextures(1, &glyph_table_texture);
+        glBindTexture(GL_TEXTURE_BUFFER, glyph_table_texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, glyph_table_buffer);
+    }
 
+    // All atlas pages go into one texture array, so glyphs from any page are drawn in the same call
+    GLuint texture;
+    int texture_width = 0, texture_height = 0;
+    {
         glGenTextures(1, &texture);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, texture_width, texture_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+
+        for (std::size_t page = 0; page < font.texture_paths.size(); ++page)
+        {
+            int page_width, page_height, channels;
+            auto data = stbi_load(font.texture_paths[page].c_str(), &page_width, &page_height, &channels, 4);
+            assert(data);
 
-        stbi_image_free(data);
+            if (page == 0)
+            {
+                texture_width = page_width;
+                texture_height = page_height;
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, texture_width, texture_height, font.texture_paths.size(), 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            }
+            else if (page_width != texture_width || page_height != texture_height)
+                throw std::runtime_error("All font atlas pages must have the same size");
+
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, page, texture_width, texture_height, 1, GL_RGBA, GL_UNSIGNED_BYTE, data);
+
+            stbi_image_free(data);
+        }
+
+        glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
     }
 
     auto last_frame_start = std::chrono::high_resolution_clock::now();
@@ -222,37 +324,136 @@ int main() try
 
     std::map<SDL_Keycode, bool> button_down;
 
-    std::string text = "Hello, world!";
+    const float text_scale = 5.f;
+
+    layout_cache cache;
+    text_layout layout(font, font.size, width / text_scale, cache);
+    layout.set_text("Hello, world!");
     bool text_changed = true;
 
+    // When a file is given on the command line, it is shown as a scrollable document instead
+    std::optional<text_document> document;
+    const float document_font_size = 20.f;
+    float document_scroll = 0.f;
+    std::pair<std::size_t, std::size_t> document_range = {0, 0};
+    std::size_t document_revision = 0;
+
+    if (argc > 1)
+    {
+        std::ifstream input(argv[1], std::ios::binary);
+        if (!input)
+            throw std::runtime_error(std::string("Failed to open ") + argv[1]);
+
+        std::ostringstream contents;
+        contents << input.rdbuf();
+
+        document.emplace(font, document_font_size, cache);
+        document->set_text(contents.str());
+        document_revision = document->revision - 1;
+    }
+
+    // The document is edited at its first visible line
+    auto document_cursor = [&]{ return std::min(document_range.first, document->line_count() - 1); };
+
+    frame_arena arena;
+
+    frame_stats stats({"layout", "draw"}, 512, "frame_stats.csv");
+    // A glyph per byte of the report at most
+    std::vector<glyph_instance> overlay_instances(stats.max_report_size());
+    glBindBuffer(GL_ARRAY_BUFFER, overlay_vbo);
+    glBufferData(GL_ARRAY_BUFFER, overlay_instances.size() * sizeof(overlay_instances[0]), nullptr, GL_STREAM_DRAW);
+    bool show_stats = true;
+    const float overlay_font_size = 16.f;
+    // The overlay is re-laid out a few times a second, not every frame
+    std::chrono::high_resolution_clock::time_point last_overlay_update;
+
+    // Scrolling with the arrow keys held is the only animation, everything else changes on input
+    auto animating = [&]{ return document && (button_down[SDLK_UP] || button_down[SDLK_DOWN]); };
+
+    // Set by every change to the picture; with nothing animating the loop sleeps until an event sets it
+    bool redraw = true;
+
     bool running = true;
     glm::vec2 bbox(0.f);
     while (running)
     {
-        for (SDL_Event event; SDL_PollEvent(&event);) switch (event.type)
+        bool wait = !redraw && !animating();
+        bool const waited = wait;
+        auto next_event = [&](SDL_Event & event)
+        {
+            if (std::exchange(wait, false))
+                return SDL_WaitEventTimeout(&event, 1000) != 0;
+            return SDL_PollEvent(&event) != 0;
+        };
+
+        for (SDL_Event event; next_event(event);) switch (event.type)
         {
         case SDL_QUIT:
             running = false;
             break;
-        case SDL_WINDOWEVENT: switch (event.window.event)
+        case SDL_WINDOWEVENT:
+            redraw = true;
+            switch (event.window.event)
             {
             case SDL_WINDOWEVENT_RESIZED:
                 width = event.window.data1;
                 height = event.window.data2;
                 glViewport(0, 0, width, height);
+                layout.set_max_width(width / text_scale);
+                text_changed = true;
                 break;
             }
             break;
+        case SDL_MOUSEWHEEL:
+            redraw = true;
+            if (document)
+                document_scroll -= event.wheel.y * 3.f * document->line_height();
+            break;
         case SDL_KEYDOWN:
+            redraw = true;
             button_down[event.key.keysym.sym] = true;
-            if (event.key.keysym.sym == SDLK_BACKSPACE && !text.empty())
+            if (event.key.keysym.sym == SDLK_F1)
+                show_stats = !show_stats;
+            if (document)
             {
-                text.pop_back();
+                auto const cursor = document_cursor();
+                if (event.key.keysym.sym == SDLK_BACKSPACE)
+                {
+                    if (auto line = document->line(cursor); !line.empty())
+                    {
+                        utf8_pop_back(line);
+                        document->set_line(cursor, std::move(line));
+                    }
+                    else if (document->line_count() > 1)
+                        document->erase_line(cursor);
+                }
+                else if (event.key.keysym.sym == SDLK_RETURN)
+                    document->insert_line(cursor + 1, {});
+                else if (event.key.keysym.sym == SDLK_PAGEDOWN)
+                    document_scroll += height;
+                else if (event.key.keysym.sym == SDLK_PAGEUP)
+                    document_scroll -= height;
+            }
+            else if (event.key.keysym.sym == SDLK_BACKSPACE && !layout.empty())
+            {
+                layout.pop_back();
+                text_changed = true;
+            }
+            else if (event.key.keysym.sym == SDLK_RETURN)
+            {
+                layout.append("\n");
                 text_changed = true;
             }
             break;
         case SDL_TEXTINPUT:
-            text.append(event.text.text);
+            redraw = true;
+            if (document)
+            {
+                auto const cursor = document_cursor();
+                document->set_line(cursor, document->line(cursor) + event.text.text);
+                break;
+            }
+            layout.append(event.text.text);
             text_changed = true;
         case SDL_KEYUP:
             button_down[event.key.keysym.sym] = false;
@@ -263,54 +464,121 @@ int main() try
             break;
 
         auto now = std::chrono::high_resolution_clock::now();
+        // Time spent asleep is not animated
+        if (waited)
+            last_frame_start = now;
         float dt = std::chrono::duration_cast<std::chrono::duration<float>>(now - last_frame_start).count();
         last_frame_start = now;
 
+        if (!redraw && !animating())
+            continue;
+        redraw = false;
+
+        arena.begin_frame();
+
+        std::size_t const frame = stats.begin_frame();
+        stats.begin_phase(0);
+
+        std::size_t const query = frame % query_count;
+        if (query_used[query]) {
+            GLuint64 time_passed;
+            glGetQueryObjectui64v(queries[query], GL_QUERY_RESULT, &time_passed);
+            stats.set_gpu_time(query_frame[query], time_passed / 1e6f);
+        }
+        query_used[query] = true;
+        query_frame[query] = frame;
+
+        if (document) {
+            if (button_down[SDLK_DOWN])
+                document_scroll += 20.f * document->line_height() * dt;
+            if (button_down[SDLK_UP])
+                document_scroll -= 20.f * document->line_height() * dt;
+
+            document_scroll = std::clamp(document_scroll, 0.f, std::max(0.f, document->height() - height));
+
+            // Nothing is laid out or uploaded while the visible range and the text stay the same
+            auto const range = document->visible_lines(document_scroll, height);
+            if (range != document_range || document->revision != document_revision) {
+                document_range = range;
+                document_revision = document->revision;
+
+                // Uploaded right away, so the instances only have to live until the end of the frame
+                frame_vector<glyph_instance> document_instances;
+                for (std::size_t i = range.first; i < range.second; ++i) {
+                    glm::vec2 const line_offset = {0.f, document->line_y(i)};
+                    for (auto instance : document->run(i).glyphs) {
+                        instance.position += line_offset;
+                        document_instances.push_back(instance);
+                    }
+                }
+
+                // Keep a screen worth of lines around, so that scrolling back and forth does not re-layout them
+                document->evict(range.first, range.second, range.second - range.first);
+
+                glBindBuffer(GL_ARRAY_BUFFER, document_vbo);
+                glBufferData(GL_ARRAY_BUFFER, document_instances.size() * sizeof(document_instances[0]), document_instances.data(), GL_STREAM_DRAW);
+                document_instance_count = document_instances.size();
+            }
+        }
+
         if (text_changed) {
-            vertices.clear();
-            glm::vec2 pen(0.f);
-            for (char c: text) {
-                auto glyph = font.glyphs.at(c);
-
-                glm::vec2 texture_size = {texture_width, texture_height};
-
-                auto vertex_1 = vertex(
-                        {glyph.xoffset + pen.x, glyph.yoffset + pen.y},
-                        glm::vec2{glyph.x, glyph.y} / texture_size
-                );
-                auto vertex_2 = vertex(
-                        {glyph.xoffset + pen.x, glyph.yoffset + glyph.height + pen.y},
-                        glm::vec2{glyph.x, glyph.y + glyph.height} / texture_size
-                );
-                auto vertex_3 = vertex(
-                        {glyph.xoffset + glyph.width + pen.x, glyph.yoffset + pen.y},
-                        glm::vec2{glyph.x + glyph.width, glyph.y} / texture_size
-                );
-                auto vertex_4 = vertex(
-                        {glyph.xoffset + glyph.width + pen.x, glyph.yoffset + glyph.height + pen.y},
-                        glm::vec2{glyph.x + glyph.width, glyph.y + glyph.height} / texture_size
-                );
-
-                vertices.push_back(vertex_1);
-                vertices.push_back(vertex_2);
-                vertices.push_back(vertex_3);
-
-                vertices.push_back(vertex_3);
-                vertices.push_back(vertex_2);
-                vertices.push_back(vertex_4);
-
-                pen.x += glyph.advance;
-
-
-                bbox.x = -pen.x / 2;
-                for (auto& v : vertices)
-                    bbox.y = fmin(bbox.y, -(float)v.position.y / 2.0);
+            // Only the lines touched since the last upload are rebuilt
+            std::size_t const first_line = std::min(layout.first_dirty_line, line_first_instance.size() - 1);
+            std::size_t const first_instance = line_first_instance[first_line];
+            instances.resize(first_instance);
+            line_first_instance.resize(first_line + 1);
+
+            for (std::size_t i = first_line; i < layout.lines.size(); ++i) {
+                glm::vec2 const line_offset = {0.f, layout.line_y(i)};
+
+                for (auto instance : layout.lines[i].run->glyphs) {
+                    instance.position += line_offset;
+                    instances.push_back(instance);
+                }
+
+                line_first_instance.push_back(instances.size());
+            }
+
+            bbox = -(layout.bbox_min() + layout.bbox_max()) / 2.f;
+
+            glBindBuffer(GL_ARRAY_BUFFER, vbo);
+            if (instances.size() > vbo_capacity) {
+                vbo_capacity = std::max<std::size_t>(instances.size(), 2 * vbo_capacity);
+                glBufferData(GL_ARRAY_BUFFER, vbo_capacity * sizeof(instances[0]), nullptr, GL_DYNAMIC_DRAW);
+                glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(instances[0]), instances.data());
+            }
+            else if (instances.size() > first_instance) {
+                glBufferSubData(GL_ARRAY_BUFFER, first_instance * sizeof(instances[0]), (instances.size() - first_instance) * sizeof(instances[0]), instances.data() + first_instance);
             }
-            glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertices[0]), vertices.data(), GL_STATIC_DRAW);
 
+            layout.reset_dirty();
             text_changed = false;
         }
 
+        if (show_stats && now - last_overlay_update >= std::chrono::milliseconds(250)) {
+            last_overlay_update = now;
+
+            float const line_height = font.line_height * overlay_font_size / font.size;
+
+            // The report and its glyphs go to buffers sized up front, the overlay does not allocate
+            std::string_view report = stats.report();
+            std::size_t count = 0;
+            for (std::size_t i = 0; !report.empty(); ++i) {
+                auto const newline = std::min(report.find('\n'), report.size());
+                glm::vec2 const line_offset = {8.f, 8.f + i * line_height};
+                count += layout_run(font, report.substr(0, newline), overlay_font_size, {0, 0, 64, 255},
+                    line_offset, std::span(overlay_instances).subspan(count));
+                report.remove_prefix(std::min(newline + 1, report.size()));
+            }
+
+            glBindBuffer(GL_ARRAY_BUFFER, overlay_vbo);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(overlay_instances[0]), overlay_instances.data());
+            overlay_instance_count = count;
+        }
+
+        stats.begin_phase(1);
+        glBeginQuery(GL_TIME_ELAPSED, queries[query]);
+
         glClearColor(0.8f, 0.8f, 1.f, 0.f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -318,25 +586,63 @@ int main() try
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
         glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_BUFFER, glyph_table_texture);
 
         glm::mat4 transform(1.f);
-        transform = glm::scale(transform, glm::vec3({2.f / width, -2.f / height, 0.f}));
-        transform = glm::scale(transform, glm::vec3(5.f));
-        transform = glm::translate(transform, glm::vec3(bbox, 0.f));
+        if (document) {
+            // Document coordinates are window pixels from the top-left corner
+            transform = glm::translate(transform, glm::vec3(-1.f, 1.f, 0.f));
+            transform = glm::scale(transform, glm::vec3({2.f / width, -2.f / height, 0.f}));
+            transform = glm::translate(transform, glm::vec3(0.f, -document_scroll, 0.f));
+        } else {
+            transform = glm::scale(transform, glm::vec3({2.f / width, -2.f / height, 0.f}));
+            transform = glm::scale(transform, glm::vec3(text_scale));
+            transform = glm::translate(transform, glm::vec3(bbox, 0.f));
+        }
 
         glUseProgram(msdf_program);
         glUniformMatrix4fv(transform_location, 1, GL_FALSE, reinterpret_cast<float *>(&transform));
         glUniform1f(scale_location, font.sdf_scale);
-        glBindVertexArray(vao);
+        glUniform1f(glyph_scale_location, document ? document->glyph_scale() : layout.glyph_scale());
+        glUniform1i(sdf_texture_location, 0);
+        glUniform1i(glyph_table_location, 1);
+
+        if (document) {
+            glBindVertexArray(document_vao);
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, document_instance_count);
+        } else {
+            glBindVertexArray(vao);
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, instances.size());
+        }
+
+        if (show_stats) {
+            glm::mat4 overlay_transform(1.f);
+            overlay_transform = glm::translate(overlay_transform, glm::vec3(-1.f, 1.f, 0.f));
+            overlay_transform = glm::scale(overlay_transform, glm::vec3({2.f / width, -2.f / height, 0.f}));
 
-        glDrawArrays(GL_TRIANGLES, 0, vertices.size());
+            glUniformMatrix4fv(transform_location, 1, GL_FALSE, reinterpret_cast<float *>(&overlay_transform));
+            glUniform1f(glyph_scale_location, overlay_font_size / font.size);
 
+            glBindVertexArray(overlay_vao);
+            glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, overlay_instance_count);
+        }
+
+        glEndQuery(GL_TIME_ELAPSED);
         SDL_GL_SwapWindow(window);
+
+        stats.end_frame();
+
+        arena.end_frame();
     }
 
     SDL_GL_DeleteContext(gl_context);
     SDL_DestroyWindow(window);
+
+    if (arena.allocating_frames() > 0)
+        std::cerr << arena.total_heap_allocations() << " heap allocations in " << arena.allocating_frames()
+            << " of " << arena.frames() << " frames of the frame loop" << std::endl;
 }
 catch (std::exception const & e)
 {
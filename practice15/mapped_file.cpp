@@ -0,0 +1,74 @@
+#include "mapped_file.hpp"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+mapped_file::mapped_file(std::filesystem::path const & path)
+{
+#ifdef _WIN32
+    file_ = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file_ == INVALID_HANDLE_VALUE)
+        throw std::runtime_error("Failed to open " + path.string());
+
+    LARGE_INTEGER size;
+    GetFileSizeEx(file_, &size);
+    size_ = size.QuadPart;
+
+    if (size_ > 0)
+    {
+        mapping_ = CreateFileMappingW(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping_)
+        {
+            CloseHandle(file_);
+            throw std::runtime_error("Failed to map " + path.string());
+        }
+        data_ = static_cast<char const *>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+    }
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::runtime_error("Failed to open " + path.string());
+
+    struct stat info;
+    fstat(fd, &info);
+    size_ = info.st_size;
+
+    if (size_ > 0)
+    {
+        void * data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED)
+        {
+            close(fd);
+            throw std::runtime_error("Failed to map " + path.string());
+        }
+        data_ = static_cast<char const *>(data);
+    }
+
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+#endif
+}
+
+mapped_file::~mapped_file()
+{
+#ifdef _WIN32
+    if (data_)
+        UnmapViewOfFile(data_);
+    if (mapping_)
+        CloseHandle(mapping_);
+    CloseHandle(file_);
+#else
+    if (data_)
+        munmap(const_cast<char *>(data_), size_);
+#endif
+}
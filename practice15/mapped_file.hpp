@@ -0,0 +1,26 @@
+#pragma once
+
+#include <filesystem>
+#include <cstddef>
+
+// Read-only memory mapping of a whole file
+struct mapped_file
+{
+    explicit mapped_file(std::filesystem::path const & path);
+    ~mapped_file();
+
+    mapped_file(mapped_file const &) = delete;
+    mapped_file & operator = (mapped_file const &) = delete;
+
+    char const * data() const { return data_; }
+    std::size_t size() const { return size_; }
+
+private:
+    char const * data_ = nullptr;
+    std::size_t size_ = 0;
+
+#ifdef _WIN32
+    void * file_ = nullptr;
+    void * mapping_ = nullptr;
+#endif
+};
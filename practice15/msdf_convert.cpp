@@ -0,0 +1,27 @@
+#include "msdf_loader.hpp"
+
+#include <iostream>
+#include <filesystem>
+
+// Converts an msdf-bmfont JSON font into the binary format loaded by load_msdf_font_binary
+int main(int argc, char ** argv) try
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " <font.json> [<font.bin>]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::string const input = argv[1];
+    std::string const output = argc > 2 ? argv[2] : std::filesystem::path(input).replace_extension(".bin").string();
+
+    auto const font = load_msdf_font_json(input);
+    save_msdf_font_binary(font, output);
+
+    std::cout << "Wrote " << font.glyphs.size() << " glyphs, " << font.kernings.size() << " kerning pairs to " << output << std::endl;
+}
+catch (std::exception const & e)
+{
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+}
@@ -1,4 +1,5 @@
 #include "msdf_loader.hpp"
+#include "mapped_file.hpp"
 
 #include <rapidjson/document.h>
 #include <rapidjson/istreamwrapper.h>
@@ -6,8 +7,102 @@
 #include <fstream>
 #include <stdexcept>
 #include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <type_traits>
+
+namespace
+{
+
+    // Native-endian layout of the binary font: header, then the tables at the given offsets
+    // (each aligned to 16 bytes), then page paths relative to the file as (uint32 length, bytes)
+    struct binary_header
+    {
+        char magic[4];
+        std::uint32_t version;
+
+        float sdf_scale;
+        float size;
+        float line_height;
+        float base;
+
+        std::uint32_t page_count;
+        std::uint32_t glyph_count;
+        std::uint32_t dense_count;
+        std::uint32_t sparse_count;
+        std::uint32_t kerning_count;
+        std::uint32_t padding;
+
+        std::uint64_t glyphs_offset;
+        std::uint64_t dense_offset;
+        std::uint64_t sparse_offset;
+        std::uint64_t kernings_offset;
+        std::uint64_t pages_offset;
+    };
+
+    constexpr char binary_magic[4] = {'M', 'S', 'D', 'F'};
+    constexpr std::uint32_t binary_version = 1;
+
+    static_assert(std::is_trivially_copyable_v<msdf_font::glyph>);
+
+    struct json_storage
+    {
+        std::vector<msdf_font::glyph> glyphs;
+        std::vector<std::int32_t> dense_index;
+        std::vector<msdf_font::sparse_entry> sparse_index;
+        std::vector<msdf_font::kerning_entry> kernings;
+    };
+
+    template <typename T>
+    std::span<T const> mapped_table(mapped_file const & file, std::uint64_t offset, std::uint32_t count)
+    {
+        if (offset % alignof(T) != 0 || offset + std::uint64_t(count) * sizeof(T) > file.size())
+            throw std::runtime_error("Bad binary font: table out of bounds");
+        return {reinterpret_cast<T const *>(file.data() + offset), count};
+    }
+
+    std::filesystem::path binary_cache_path(std::string const & json_path)
+    {
+        return std::filesystem::path(json_path).replace_extension(".bin");
+    }
+
+}
 
 msdf_font load_msdf_font(std::string const & path)
+{
+    if (std::filesystem::path(path).extension() == ".bin")
+        return load_msdf_font_binary(path);
+
+    auto const cache_path = binary_cache_path(path);
+
+    std::error_code error;
+    if (std::filesystem::exists(cache_path, error) && std::filesystem::last_write_time(cache_path, error) >= std::filesystem::last_write_time(path, error))
+    {
+        try
+        {
+            return load_msdf_font_binary(cache_path.string());
+        }
+        catch (std::exception const &)
+        {
+            // Stale or foreign cache, fall back to JSON and overwrite it
+        }
+    }
+
+    auto result = load_msdf_font_json(path);
+
+    try
+    {
+        save_msdf_font_binary(result, cache_path.string());
+    }
+    catch (std::exception const &)
+    {
+        // Read-only font directory, the cache is only an optimization
+    }
+
+    return result;
+}
+
+msdf_font load_msdf_font_json(std::string const & path)
 {
     rapidjson::Document document;
 
@@ -18,11 +113,11 @@ msdf_font load_msdf_font(std::string const & path)
     }
 
     msdf_font result;
+    auto storage = std::make_shared<json_storage>();
 
     {
-        auto pages = document["pages"].GetArray();
-        assert(pages.Size() == 1);
-        result.texture_path = (std::filesystem::path(path).parent_path() / pages[0].GetString()).string();
+        for (auto const & page : document["pages"].GetArray())
+            result.texture_paths.push_back((std::filesystem::path(path).parent_path() / page.GetString()).string());
     }
 
     {
@@ -30,13 +125,45 @@ msdf_font load_msdf_font(std::string const & path)
         result.sdf_scale = sdf["distanceRange"].GetFloat();
     }
 
+    {
+        result.size = document["info"]["size"].GetFloat();
+
+        auto const & common = document["common"];
+        result.line_height = common["lineHeight"].GetFloat();
+        result.base = common["base"].GetFloat();
+    }
+
     auto chars = document["chars"].GetArray();
 
+    static constexpr char32_t dense_limit = 0x10000;
+
+    char32_t dense_size = 0;
+    for (auto const & charInfo : chars)
+    {
+        char32_t id = charInfo["id"].GetUint();
+        if (id < dense_limit)
+            dense_size = std::max<char32_t>(dense_size, id + 1);
+    }
+
+    storage->dense_index.assign(dense_size, -1);
+    storage->glyphs.reserve(chars.Size());
+
+    glm::vec2 const texture_size = {
+        document["common"]["scaleW"].GetFloat(),
+        document["common"]["scaleH"].GetFloat(),
+    };
+
     for (auto const & charInfo : chars)
     {
         char32_t id = charInfo["id"].GetUint();
 
-        auto & data = result.glyphs[id];
+        std::int32_t const index = storage->glyphs.size();
+        if (id < dense_limit)
+            storage->dense_index[id] = index;
+        else
+            storage->sparse_index.push_back({id, index});
+
+        auto & data = storage->glyphs.emplace_back();
         data.x = charInfo["x"].GetInt();
         data.y = charInfo["y"].GetInt();
         data.width = charInfo["width"].GetInt();
@@ -44,7 +171,151 @@ msdf_font load_msdf_font(std::string const & path)
         data.xoffset = charInfo["xoffset"].GetInt();
         data.yoffset = charInfo["yoffset"].GetInt();
         data.advance = charInfo["xadvance"].GetInt();
+        data.page = charInfo.HasMember("page") ? charInfo["page"].GetInt() : 0;
+        data.texcoord_min = glm::vec2(data.x, data.y) / texture_size;
+        data.texcoord_max = glm::vec2(data.x + data.width, data.y + data.height) / texture_size;
+    }
+
+    std::sort(storage->sparse_index.begin(), storage->sparse_index.end(),
+        [](auto const & a, auto const & b){ return a.codepoint < b.codepoint; });
+
+    if (document.HasMember("kernings"))
+    {
+        for (auto const & kerning : document["kernings"].GetArray())
+        {
+            auto const key = msdf_font::kerning_key(kerning["first"].GetUint(), kerning["second"].GetUint());
+            storage->kernings.push_back({key, kerning["amount"].GetInt(), 0});
+        }
+
+        std::sort(storage->kernings.begin(), storage->kernings.end(),
+            [](auto const & a, auto const & b){ return a.key < b.key; });
+    }
+
+    result.glyphs = storage->glyphs;
+    result.dense_index = storage->dense_index;
+    result.sparse_index = storage->sparse_index;
+    result.kernings = storage->kernings;
+    result.storage = std::move(storage);
+
+    return result;
+}
+
+msdf_font load_msdf_font_binary(std::string const & path)
+{
+    auto file = std::make_shared<mapped_file>(path);
+
+    auto fail = [&](char const * reason){
+        throw std::runtime_error("Bad binary font " + path + ": " + reason);
+    };
+
+    if (file->size() < sizeof(binary_header))
+        fail("truncated header");
+
+    binary_header header;
+    std::memcpy(&header, file->data(), sizeof(header));
+
+    if (std::memcmp(header.magic, binary_magic, sizeof(binary_magic)) != 0)
+        fail("wrong magic");
+    if (header.version != binary_version)
+        fail("unsupported version");
+
+    msdf_font result;
+    result.sdf_scale = header.sdf_scale;
+    result.size = header.size;
+    result.line_height = header.line_height;
+    result.base = header.base;
+
+    result.glyphs = mapped_table<msdf_font::glyph>(*file, header.glyphs_offset, header.glyph_count);
+    result.dense_index = mapped_table<std::int32_t>(*file, header.dense_offset, header.dense_count);
+    result.sparse_index = mapped_table<msdf_font::sparse_entry>(*file, header.sparse_offset, header.sparse_count);
+    result.kernings = mapped_table<msdf_font::kerning_entry>(*file, header.kernings_offset, header.kerning_count);
+
+    // find() indexes glyphs with these without checking and binary-searches the sparse index,
+    // so a corrupted cache has to be caught here rather than read out of bounds later
+    auto valid_index = [&](std::int32_t index){ return index == -1 || (index >= 0 && std::uint32_t(index) < header.glyph_count); };
+
+    if (!std::all_of(result.dense_index.begin(), result.dense_index.end(), valid_index))
+        fail("dense index out of range");
+    if (!std::all_of(result.sparse_index.begin(), result.sparse_index.end(), [&](auto const & e){ return valid_index(e.index); }))
+        fail("sparse index out of range");
+    if (!std::is_sorted(result.sparse_index.begin(), result.sparse_index.end(), [](auto const & a, auto const & b){ return a.codepoint < b.codepoint; }))
+        fail("sparse index not sorted");
+
+    auto const directory = std::filesystem::path(path).parent_path();
+    std::uint64_t offset = header.pages_offset;
+    for (std::uint32_t page = 0; page < header.page_count; ++page)
+    {
+        std::uint32_t length;
+        if (offset + sizeof(length) > file->size())
+            fail("page table out of bounds");
+        std::memcpy(&length, file->data() + offset, sizeof(length));
+        offset += sizeof(length);
+
+        if (offset + length > file->size())
+            fail("page table out of bounds");
+        result.texture_paths.push_back((directory / std::string(file->data() + offset, length)).string());
+        offset += length;
     }
 
+    result.storage = std::move(file);
     return result;
 }
+
+void save_msdf_font_binary(msdf_font const & font, std::string const & path)
+{
+    std::vector<char> data(sizeof(binary_header));
+
+    auto append = [&](void const * bytes, std::size_t size)
+    {
+        data.insert(data.end(), static_cast<char const *>(bytes), static_cast<char const *>(bytes) + size);
+    };
+
+    auto append_table = [&](auto const & table) -> std::uint64_t
+    {
+        data.resize((data.size() + 15) / 16 * 16, 0);
+        std::uint64_t const offset = data.size();
+        append(table.data(), table.size_bytes());
+        return offset;
+    };
+
+    binary_header header{};
+    std::memcpy(header.magic, binary_magic, sizeof(binary_magic));
+    header.version = binary_version;
+    header.sdf_scale = font.sdf_scale;
+    header.size = font.size;
+    header.line_height = font.line_height;
+    header.base = font.base;
+
+    header.page_count = font.texture_paths.size();
+    header.glyph_count = font.glyphs.size();
+    header.dense_count = font.dense_index.size();
+    header.sparse_count = font.sparse_index.size();
+    header.kerning_count = font.kernings.size();
+
+    header.glyphs_offset = append_table(font.glyphs);
+    header.dense_offset = append_table(font.dense_index);
+    header.sparse_offset = append_table(font.sparse_index);
+    header.kernings_offset = append_table(font.kernings);
+
+    header.pages_offset = data.size();
+    auto const directory = std::filesystem::path(path).parent_path();
+    for (auto const & page : font.texture_paths)
+    {
+        auto const relative = std::filesystem::path(page).lexically_relative(directory).generic_string();
+        std::uint32_t const length = relative.size();
+        append(&length, sizeof(length));
+        append(relative.data(), relative.size());
+    }
+
+    std::memcpy(data.data(), &header, sizeof(header));
+
+    // Write to a temporary file first, so a concurrent reader never maps a half-written font
+    auto const temporary = path + ".tmp";
+    {
+        std::ofstream output(temporary, std::ios::binary | std::ios::trunc);
+        output.write(data.data(), data.size());
+        if (!output)
+            throw std::runtime_error("Failed to write " + temporary);
+    }
+    std::filesystem::rename(temporary, path);
+}
@@ -1,22 +1,103 @@
 #pragma once
 
+#include <glm/vec2.hpp>
+
 #include <string>
-#include <unordered_map>
+#include <vector>
+#include <span>
+#include <memory>
+#include <cstdint>
+#include <algorithm>
 
 struct msdf_font
 {
-    std::string texture_path;
+    // One atlas page per layer of the texture array, all pages have the same size
+    std::vector<std::string> texture_paths;
 
+    // All tables are plain arrays of trivially copyable records, so they can point
+    // straight into a memory-mapped binary font (see save_msdf_font_binary)
     struct glyph
     {
-        int x, y;
-        int width, height;
-        int xoffset, yoffset;
-        int advance;
+        std::int32_t x, y;
+        std::int32_t width, height;
+        std::int32_t xoffset, yoffset;
+        std::int32_t advance;
+        std::int32_t page;
+
+        // Atlas rectangle normalized by the atlas size, computed once at load time
+        glm::vec2 texcoord_min;
+        glm::vec2 texcoord_max;
+    };
+
+    struct sparse_entry
+    {
+        char32_t codepoint;
+        std::int32_t index;
     };
 
-    std::unordered_map<char32_t, glyph> glyphs;
+    struct kerning_entry
+    {
+        std::uint64_t key;
+        std::int32_t amount;
+        std::int32_t padding;
+    };
+
+    std::span<glyph const> glyphs;
     float sdf_scale;
+
+    glyph const * find(char32_t c) const
+    {
+        std::int32_t index = -1;
+        if (c < dense_index.size())
+            index = dense_index[c];
+        else
+        {
+            auto it = std::lower_bound(sparse_index.begin(), sparse_index.end(), c,
+                [](sparse_entry const & e, char32_t c){ return e.codepoint < c; });
+            if (it != sparse_index.end() && it->codepoint == c)
+                index = it->index;
+        }
+        return index < 0 ? nullptr : &glyphs[index];
+    }
+
+    // Codepoints of the BMP index glyphs directly, up to the largest one present
+    // in the font (-1 means no glyph); anything above is binary searched in sparse_index
+    std::span<std::int32_t const> dense_index;
+    // Sorted by codepoint
+    std::span<sparse_entry const> sparse_index;
+
+    // Size the glyphs were rasterized at, all metrics are in pixels of this size
+    float size;
+    float line_height;
+    float base;
+
+    // Sorted by key
+    std::span<kerning_entry const> kernings;
+
+    int kerning(char32_t first, char32_t second) const
+    {
+        auto const key = kerning_key(first, second);
+        auto it = std::lower_bound(kernings.begin(), kernings.end(), key,
+            [](kerning_entry const & e, std::uint64_t key){ return e.key < key; });
+        return (it != kernings.end() && it->key == key) ? it->amount : 0;
+    }
+
+    static std::uint64_t kerning_key(char32_t first, char32_t second)
+    {
+        return (std::uint64_t(first) << 32) | second;
+    }
+
+    // Keeps the memory the tables point into alive: either arrays parsed from JSON or a mapped file
+    std::shared_ptr<void const> storage;
 };
 
+// Loads the binary cache next to the JSON file (same name, .bin extension) if it is up to date,
+// otherwise parses the JSON and tries to write the cache for the next launch
 msdf_font load_msdf_font(std::string const & path);
+
+msdf_font load_msdf_font_json(std::string const & path);
+
+// Maps the file and points the font tables into it, so loading does not depend on the glyph count
+msdf_font load_msdf_font_binary(std::string const & path);
+
+void save_msdf_font_binary(msdf_font const & font, std::string const & path);
@@ -0,0 +1,114 @@
+#include "text_document.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+text_document::text_document(msdf_font const & font, float font_size, layout_cache & cache)
+    : font_(font)
+    , font_size_(font_size)
+    , cache_(cache)
+{
+    set_text({});
+}
+
+void text_document::set_text(std::string_view text)
+{
+    lines_.clear();
+    cached_lines_.clear();
+
+    while (true)
+    {
+        auto const newline = text.find('\n');
+        lines_.push_back({std::string(text.substr(0, newline)), nullptr});
+        if (newline == std::string_view::npos)
+            break;
+        text.remove_prefix(newline + 1);
+    }
+
+    ++revision;
+}
+
+void text_document::set_line(std::size_t index, std::string text)
+{
+    auto & line = lines_[index];
+    line.text = std::move(text);
+
+    if (line.run)
+    {
+        line.run = nullptr;
+        cached_lines_.erase(std::find(cached_lines_.begin(), cached_lines_.end(), index));
+    }
+
+    ++revision;
+}
+
+void text_document::insert_line(std::size_t index, std::string text)
+{
+    lines_.insert(lines_.begin() + index, {std::move(text), nullptr});
+
+    for (auto & cached : cached_lines_)
+        if (cached >= index)
+            ++cached;
+
+    ++revision;
+}
+
+void text_document::erase_line(std::size_t index)
+{
+    lines_.erase(lines_.begin() + index);
+
+    cached_lines_.erase(std::remove(cached_lines_.begin(), cached_lines_.end(), index), cached_lines_.end());
+    for (auto & cached : cached_lines_)
+        if (cached > index)
+            --cached;
+
+    if (lines_.empty())
+        lines_.emplace_back();
+
+    ++revision;
+}
+
+float text_document::glyph_scale() const
+{
+    return font_size_ / font_.size;
+}
+
+float text_document::line_height() const
+{
+    return font_.line_height * glyph_scale();
+}
+
+std::pair<std::size_t, std::size_t> text_document::visible_lines(float scroll, float viewport_height) const
+{
+    float const h = line_height();
+
+    auto const first = static_cast<std::size_t>(std::max(0.f, std::floor(scroll / h)));
+    auto const last = static_cast<std::size_t>(std::max(0.f, std::ceil((scroll + viewport_height) / h)));
+
+    return {std::min(first, lines_.size()), std::min(last, lines_.size())};
+}
+
+glyph_run const & text_document::run(std::size_t index)
+{
+    auto & line = lines_[index];
+    if (!line.run)
+    {
+        line.run = cache_.get(font_, line.text, font_size_, color);
+        cached_lines_.push_back(index);
+    }
+    return *line.run;
+}
+
+void text_document::evict(std::size_t first, std::size_t last, std::size_t margin)
+{
+    std::size_t const keep_first = first > margin ? first - margin : 0;
+    std::size_t const keep_last = last + margin;
+
+    auto outside = [&](std::size_t index){ return index < keep_first || index >= keep_last; };
+
+    for (auto index : cached_lines_)
+        if (outside(index))
+            lines_[index].run = nullptr;
+
+    cached_lines_.erase(std::remove_if(cached_lines_.begin(), cached_lines_.end(), outside), cached_lines_.end());
+}
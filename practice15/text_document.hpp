@@ -0,0 +1,62 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <utility>
+
+#include "text_layout.hpp"
+
+// Line-oriented text of arbitrary size (log files, source code) without wrapping.
+// Lines are laid out lazily when they become visible and their runs are dropped
+// again once they scroll far enough away, so memory and per-frame work depend on the viewport.
+struct text_document
+{
+    text_document(msdf_font const & font, float font_size, layout_cache & cache);
+
+    void set_text(std::string_view text);
+
+    std::string const & line(std::size_t index) const { return lines_[index].text; }
+    void set_line(std::size_t index, std::string text);
+    void insert_line(std::size_t index, std::string text);
+    void erase_line(std::size_t index);
+
+    std::size_t line_count() const { return lines_.size(); }
+    float glyph_scale() const;
+    float line_height() const;
+    float line_y(std::size_t index) const { return index * line_height(); }
+    float height() const { return line_y(lines_.size()); }
+
+    // Lines [first, last) that intersect the viewport [scroll, scroll + viewport_height)
+    std::pair<std::size_t, std::size_t> visible_lines(float scroll, float viewport_height) const;
+
+    // Lays the line out if it has no run yet
+    glyph_run const & run(std::size_t index);
+
+    // Drops runs of the lines outside [first - margin, last + margin)
+    void evict(std::size_t first, std::size_t last, std::size_t margin);
+
+    std::size_t cached_runs() const { return cached_lines_.size(); }
+
+    // Changes on every edit, so that views know when to rebuild their buffers
+    std::size_t revision = 0;
+
+    glm::u8vec4 color = {0, 0, 0, 255};
+
+private:
+    struct line_data
+    {
+        std::string text;
+        std::shared_ptr<glyph_run const> run;
+    };
+
+    msdf_font const & font_;
+    float font_size_;
+    layout_cache & cache_;
+
+    std::vector<line_data> lines_;
+
+    // Indices of the lines that currently hold a run
+    std::vector<std::size_t> cached_lines_;
+};
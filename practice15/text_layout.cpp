@@ -0,0 +1,302 @@
+#include "text_layout.hpp"
+#include "utf8.hpp"
+
+#include <glm/common.hpp>
+
+#include <limits>
+#include <functional>
+
+namespace
+{
+
+    // Calls emit(instance, quad_min, quad_max) for every visible glyph of the line and returns its advance
+    template <typename Emit>
+    float layout_glyphs(msdf_font const & font, std::string_view text, float font_size, glm::u8vec4 color, Emit && emit)
+    {
+        float const scale = font_size / font.size;
+
+        float pen = 0.f;
+        char32_t previous = 0;
+
+        for_each_codepoint(text, [&](char32_t c)
+        {
+            auto const * glyph = font.find(c);
+            if (!glyph)
+                return;
+
+            if (previous != 0)
+                pen += font.kerning(previous, c) * scale;
+            previous = c;
+
+            if (glyph->width > 0 && glyph->height > 0)
+            {
+                glyph_instance instance;
+                instance.position = glm::vec2(pen, 0.f);
+                instance.glyph = glyph - font.glyphs.data();
+                instance.page = glyph->page;
+                instance.color = color;
+
+                glm::vec2 const quad_min = glm::vec2(pen + glyph->xoffset * scale, glyph->yoffset * scale);
+                glm::vec2 const quad_max = quad_min + glm::vec2(glyph->width, glyph->height) * scale;
+
+                emit(instance, quad_min, quad_max);
+            }
+
+            pen += glyph->advance * scale;
+        });
+
+        return pen;
+    }
+
+}
+
+glyph_run layout_run(msdf_font const & font, std::string_view text, float font_size, glm::u8vec4 color)
+{
+    static constexpr float inf = std::numeric_limits<float>::infinity();
+
+    glyph_run result;
+    result.glyphs.reserve(text.size());
+    result.bbox_min = glm::vec2(inf);
+    result.bbox_max = glm::vec2(-inf);
+
+    result.advance = layout_glyphs(font, text, font_size, color, [&](glyph_instance const & instance, glm::vec2 quad_min, glm::vec2 quad_max)
+    {
+        result.glyphs.push_back(instance);
+        result.bbox_min = glm::min(result.bbox_min, quad_min);
+        result.bbox_max = glm::max(result.bbox_max, quad_max);
+    });
+
+    return result;
+}
+
+std::size_t layout_run(msdf_font const & font, std::string_view text, float font_size, glm::u8vec4 color,
+    glm::vec2 offset, std::span<glyph_instance> output)
+{
+    std::size_t count = 0;
+    layout_glyphs(font, text, font_size, color, [&](glyph_instance instance, glm::vec2, glm::vec2)
+    {
+        instance.position += offset;
+        output[count++] = instance;
+    });
+    return count;
+}
+
+layout_cache::layout_cache(std::size_t capacity)
+    : capacity_(capacity)
+{}
+
+std::size_t layout_cache::key_hash::operator()(key const & k) const
+{
+    std::uint32_t const color = k.color.r | (k.color.g << 8) | (k.color.b << 16) | (std::uint32_t(k.color.a) << 24);
+    return std::hash<std::string>{}(k.text) ^ (std::hash<float>{}(k.font_size) * 31) ^ (std::hash<std::uint32_t>{}(color) * 17);
+}
+
+std::shared_ptr<glyph_run const> layout_cache::get(msdf_font const & font, std::string_view text, float font_size, glm::u8vec4 color)
+{
+    key k{std::string(text), font_size, color};
+
+    if (auto it = runs_.find(k); it != runs_.end())
+    {
+        ++hits;
+        return it->second;
+    }
+
+    ++misses;
+
+    // Lines still hold their runs through shared_ptr, so dropping everything is safe
+    if (runs_.size() >= capacity_)
+        runs_.clear();
+
+    auto run = std::make_shared<glyph_run const>(layout_run(font, text, font_size, color));
+    runs_.emplace(std::move(k), run);
+    return run;
+}
+
+text_layout::text_layout(msdf_font const & font, float font_size, float max_width, layout_cache & cache)
+    : font_(font)
+    , font_size_(font_size)
+    , max_width_(max_width)
+    , cache_(cache)
+{
+    set_text({});
+}
+
+void text_layout::set_text(std::string_view text)
+{
+    lines.clear();
+    first_dirty_line = 0;
+    relayout_from(0, std::string(text));
+}
+
+void text_layout::append(std::string_view text)
+{
+    // Greedy wrapping only looks forward, so the lines before the last one cannot change
+    std::size_t const last = lines.size() - 1;
+    relayout_from(last, lines[last].text + std::string(text));
+}
+
+void text_layout::pop_back()
+{
+    std::size_t const last = lines.size() - 1;
+
+    if (lines[last].text.empty())
+    {
+        if (last == 0)
+            return;
+
+        // Soft-wrapped lines are never empty, so this removes a '\n'
+        // The boxes of the remaining lines do not include the removed one
+        lines.pop_back();
+        lines.back().hard_break = false;
+        first_dirty_line = std::min(first_dirty_line, last);
+        return;
+    }
+
+    // A shorter last line may let its first word move back up to the previous soft-wrapped line
+    std::size_t first = last;
+    std::string text = lines[last].text;
+    if (last > 0 && !lines[last - 1].hard_break)
+    {
+        first = last - 1;
+        text = lines[first].text + text;
+    }
+
+    utf8_pop_back(text);
+    relayout_from(first, std::move(text));
+}
+
+void text_layout::set_max_width(float max_width)
+{
+    if (max_width == max_width_)
+        return;
+
+    max_width_ = max_width;
+    set_text(text());
+}
+
+std::string text_layout::text() const
+{
+    std::string result;
+    for (auto const & line : lines)
+    {
+        result += line.text;
+        if (line.hard_break)
+            result += '\n';
+    }
+    return result;
+}
+
+bool text_layout::empty() const
+{
+    return lines.size() == 1 && lines[0].text.empty();
+}
+
+float text_layout::glyph_scale() const
+{
+    return font_size_ / font_.size;
+}
+
+float text_layout::line_height() const
+{
+    return font_.line_height * font_size_ / font_.size;
+}
+
+glm::vec2 text_layout::bbox_min() const
+{
+    glm::vec2 const result = lines.back().bbox_min;
+    return std::isinf(result.x) ? glm::vec2(0.f) : result;
+}
+
+glm::vec2 text_layout::bbox_max() const
+{
+    glm::vec2 const result = lines.back().bbox_max;
+    return std::isinf(result.x) ? glm::vec2(0.f) : result;
+}
+
+void text_layout::add_bbox(std::size_t index)
+{
+    static constexpr float inf = std::numeric_limits<float>::infinity();
+
+    auto & line = lines[index];
+    line.bbox_min = index > 0 ? lines[index - 1].bbox_min : glm::vec2(inf);
+    line.bbox_max = index > 0 ? lines[index - 1].bbox_max : glm::vec2(-inf);
+
+    if (!line.run->glyphs.empty())
+    {
+        line.bbox_min = glm::min(line.bbox_min, line.run->bbox_min + glm::vec2(0.f, line_y(index)));
+        line.bbox_max = glm::max(line.bbox_max, line.run->bbox_max + glm::vec2(0.f, line_y(index)));
+    }
+}
+
+void text_layout::relayout_from(std::size_t first, std::string text)
+{
+    lines.resize(first);
+    first_dirty_line = std::min(first_dirty_line, first);
+
+    std::string_view rest = text;
+    while (true)
+    {
+        auto const newline = rest.find('\n');
+        std::string_view paragraph = rest.substr(0, newline);
+
+        // Empty paragraphs still produce an (empty) line
+        do
+        {
+            std::size_t const count = fit(paragraph);
+
+            auto & line = lines.emplace_back();
+            line.text = paragraph.substr(0, count);
+            line.run = cache_.get(font_, line.text, font_size_, color);
+            add_bbox(lines.size() - 1);
+
+            paragraph.remove_prefix(count);
+        }
+        while (!paragraph.empty());
+
+        if (newline == std::string_view::npos)
+            break;
+
+        lines.back().hard_break = true;
+        rest.remove_prefix(newline + 1);
+    }
+}
+
+std::size_t text_layout::fit(std::string_view text) const
+{
+    if (max_width_ <= 0.f)
+        return text.size();
+
+    float const scale = font_size_ / font_.size;
+
+    float pen = 0.f;
+    char32_t previous = 0;
+    std::size_t break_after = 0;
+
+    for (std::size_t offset = 0; offset < text.size();)
+    {
+        std::size_t const begin = offset;
+        char32_t const c = utf8_next(text, offset);
+
+        auto const * glyph = font_.find(c);
+        if (!glyph)
+            continue;
+
+        if (previous != 0)
+            pen += font_.kerning(previous, c) * scale;
+        previous = c;
+
+        pen += glyph->advance * scale;
+
+        // Trailing spaces are allowed to hang past the right edge
+        if (c == ' ')
+        {
+            break_after = offset;
+            continue;
+        }
+
+        if (pen > max_width_ && begin > 0)
+            return break_after > 0 ? break_after : begin;
+    }
+
+    return text.size();
+}
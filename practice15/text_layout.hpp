@@ -0,0 +1,137 @@
+#pragma once
+
+#include <glm/vec2.hpp>
+#include <glm/ext/vector_uint4_sized.hpp>
+
+#include <string>
+#include <string_view>
+#include <span>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include "msdf_loader.hpp"
+
+// One instance per glyph, expanded into a quad in the vertex shader
+// using the glyph table; 16 bytes instead of six 16-byte vertices
+struct glyph_instance
+{
+    // Pen position in layout units, y grows downwards
+    glm::vec2 position;
+    // Index into msdf_font::glyphs and the atlas page (texture array layer) it lives on
+    std::uint16_t glyph;
+    std::uint16_t page;
+    glm::u8vec4 color;
+};
+
+static_assert(sizeof(glyph_instance) == 16);
+
+struct glyph_run
+{
+    std::vector<glyph_instance> glyphs;
+    float advance = 0.f;
+
+    // Empty runs have bbox_min > bbox_max
+    glm::vec2 bbox_min;
+    glm::vec2 bbox_max;
+};
+
+// Lays out a single line in one pass, applying kerning and growing the bounding box as it goes
+glyph_run layout_run(msdf_font const & font, std::string_view text, float font_size, glm::u8vec4 color);
+
+// Same glyphs moved by offset, written to output instead of a freshly allocated run; a line never has more
+// glyphs than bytes, so output needs room for text.size() of them. Returns the number of glyphs written.
+std::size_t layout_run(msdf_font const & font, std::string_view text, float font_size, glm::u8vec4 color,
+    glm::vec2 offset, std::span<glyph_instance> output);
+
+// Shares identical runs (repeated lines, undo/redo of the same edit) between layouts
+struct layout_cache
+{
+    explicit layout_cache(std::size_t capacity = 4096);
+
+    std::shared_ptr<glyph_run const> get(msdf_font const & font, std::string_view text, float font_size, glm::u8vec4 color);
+
+    std::size_t hits = 0;
+    std::size_t misses = 0;
+
+private:
+    struct key
+    {
+        std::string text;
+        float font_size;
+        glm::u8vec4 color;
+
+        bool operator == (key const & other) const = default;
+    };
+
+    struct key_hash
+    {
+        std::size_t operator()(key const & k) const;
+    };
+
+    std::size_t capacity_;
+    std::unordered_map<key, std::shared_ptr<glyph_run const>, key_hash> runs_;
+};
+
+// Multi-line text with word wrapping. Edits at the end of the text re-layout
+// only the last one or two lines, so the cost of typing does not depend on the text length.
+struct text_layout
+{
+    struct line
+    {
+        std::string text;
+        // Whether the line was ended by '\n' rather than by wrapping
+        bool hard_break = false;
+        std::shared_ptr<glyph_run const> run;
+
+        // Union of the boxes of this line and all lines before it, so edits, which only ever
+        // replace a tail of the lines, keep the box of the whole text without rescanning it
+        glm::vec2 bbox_min;
+        glm::vec2 bbox_max;
+    };
+
+    text_layout(msdf_font const & font, float font_size, float max_width, layout_cache & cache);
+
+    void set_text(std::string_view text);
+    void append(std::string_view text);
+    void pop_back();
+
+    // Re-wraps the whole text
+    void set_max_width(float max_width);
+
+    std::string text() const;
+    bool empty() const;
+
+    // Color of the glyphs laid out from now on
+    glm::u8vec4 color = {0, 0, 0, 255};
+
+    // Scale from font pixels to layout units
+    float glyph_scale() const;
+    float line_height() const;
+    float line_y(std::size_t index) const { return index * line_height(); }
+
+    // Bounding box of the whole text, a union of the per-line boxes kept up to date by the edits
+    glm::vec2 bbox_min() const;
+    glm::vec2 bbox_max() const;
+
+    std::vector<line> lines;
+
+    // Lines before this index did not change since the last reset_dirty()
+    std::size_t first_dirty_line = 0;
+    void reset_dirty() { first_dirty_line = lines.size(); }
+
+private:
+    // Re-breaks the given text into lines starting at index first, replacing everything after it
+    void relayout_from(std::size_t first, std::string text);
+
+    // Sets the running bounding box of a freshly laid out line from the one before it
+    void add_bbox(std::size_t index);
+
+    // Number of bytes of text that fit into max_width, breaking after spaces when possible
+    std::size_t fit(std::string_view text) const;
+
+    msdf_font const & font_;
+    float font_size_;
+    float max_width_;
+    layout_cache & cache_;
+};
@@ -0,0 +1,122 @@
+#include "utf8.hpp"
+
+#include <cstring>
+#include <cstdint>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+
+    // Whether the 16 bytes at data have no high bit set
+    bool ascii_block(char const * data)
+    {
+#ifdef __SSE2__
+        __m128i const block = _mm_loadu_si128(reinterpret_cast<__m128i const *>(data));
+        return _mm_movemask_epi8(block) == 0;
+#else
+        std::uint64_t words[2];
+        std::memcpy(words, data, sizeof(words));
+        return ((words[0] | words[1]) & 0x8080808080808080ull) == 0;
+#endif
+    }
+
+}
+
+bool is_ascii(std::string_view text)
+{
+    std::size_t i = 0;
+    for (; i + 16 <= text.size(); i += 16)
+        if (!ascii_block(text.data() + i))
+            return false;
+
+    for (; i < text.size(); ++i)
+        if (static_cast<unsigned char>(text[i]) >= 0x80)
+            return false;
+
+    return true;
+}
+
+char32_t utf8_next(std::string_view text, std::size_t & offset)
+{
+    unsigned char const lead = text[offset];
+    if (lead < 0x80)
+    {
+        ++offset;
+        return lead;
+    }
+
+    std::size_t length;
+    char32_t result;
+    char32_t min;
+
+    if ((lead & 0xE0) == 0xC0)
+    {
+        length = 2;
+        result = lead & 0x1F;
+        min = 0x80;
+    }
+    else if ((lead & 0xF0) == 0xE0)
+    {
+        length = 3;
+        result = lead & 0x0F;
+        min = 0x800;
+    }
+    else if ((lead & 0xF8) == 0xF0)
+    {
+        length = 4;
+        result = lead & 0x07;
+        min = 0x10000;
+    }
+    else
+    {
+        ++offset;
+        return replacement_character;
+    }
+
+    if (offset + length > text.size())
+    {
+        ++offset;
+        return replacement_character;
+    }
+
+    for (std::size_t k = 1; k < length; ++k)
+    {
+        unsigned char const c = text[offset + k];
+        if ((c & 0xC0) != 0x80)
+        {
+            ++offset;
+            return replacement_character;
+        }
+        result = (result << 6) | (c & 0x3F);
+    }
+
+    // Overlong encodings and surrogates are not valid UTF-8
+    if (result < min || result > 0x10FFFF || (result >= 0xD800 && result <= 0xDFFF))
+    {
+        ++offset;
+        return replacement_character;
+    }
+
+    offset += length;
+    return result;
+}
+
+void utf8_pop_back(std::string & text)
+{
+    if (text.empty())
+        return;
+
+    // Walk back over at most three continuation bytes to the lead byte
+    std::size_t start = text.size() - 1;
+    while (start > 0 && text.size() - start < 4 && (static_cast<unsigned char>(text[start]) & 0xC0) == 0x80)
+        --start;
+
+    std::size_t offset = start;
+    utf8_next(text, offset);
+
+    // If the tail is not one valid sequence, only its last byte is a codepoint of its own
+    text.resize(offset == text.size() ? start : text.size() - 1);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+// Invalid or truncated sequences decode to this codepoint, one per bad byte
+constexpr char32_t replacement_character = 0xFFFD;
+
+// Whether the text is pure ASCII, checked 16 bytes at a time
+bool is_ascii(std::string_view text);
+
+// Decodes the codepoint starting at offset and moves offset past it
+char32_t utf8_next(std::string_view text, std::size_t & offset);
+
+// Removes the last codepoint (not the last byte) of the text
+void utf8_pop_back(std::string & text);
+
+// Calls f(codepoint) for every codepoint, skipping the decoder for 16-byte blocks of plain ASCII
+template <typename F>
+void for_each_codepoint(std::string_view text, F && f)
+{
+    std::size_t offset = 0;
+    while (offset < text.size())
+    {
+        if (offset + 16 <= text.size() && is_ascii(text.substr(offset, 16)))
+        {
+            for (std::size_t end = offset + 16; offset < end; ++offset)
+                f(static_cast<char32_t>(static_cast<unsigned char>(text[offset])));
+            continue;
+        }
+
+        f(utf8_next(text, offset));
+    }
+}
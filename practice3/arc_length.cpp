@@ -0,0 +1,54 @@
+#include "arc_length.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+void arc_length_table::update(std::vector<vec2> const & points, std::size_t first)
+{
+    distance.resize(points.size());
+    if (points.empty())
+        return;
+
+    if (first == 0) {
+        distance[0] = 0.f;
+        first = 1;
+    }
+
+    for (std::size_t i = first; i < points.size(); ++i)
+        distance[i] = distance[i - 1] + std::hypot(points[i].x - points[i - 1].x, points[i].y - points[i - 1].y);
+}
+
+arc_length_table::location arc_length_table::locate(float s) const
+{
+    if (distance.size() < 2 || s <= 0.f)
+        return {0, 0.f};
+    if (s >= distance.back())
+        return {distance.size() - 2, 1.f};
+
+    // First point past s, the segment before it contains s
+    std::size_t const next = std::upper_bound(distance.begin(), distance.end(), s) - distance.begin();
+    std::size_t const index = next - 1;
+
+    float const length = distance[next] - distance[index];
+    return {index, length > 0.f ? (s - distance[index]) / length : 0.f};
+}
+
+float arc_length_table::parameter(float s) const
+{
+    if (distance.size() < 2)
+        return 0.f;
+
+    auto const l = locate(s);
+    return (l.index + l.fraction) / (distance.size() - 1);
+}
+
+vec2 arc_length_table::point(std::vector<vec2> const & points, float s) const
+{
+    if (points.size() < 2)
+        return points.empty() ? vec2{0.f, 0.f} : points[0];
+
+    auto const l = locate(s);
+    vec2 const a = points[l.index];
+    vec2 const b = points[l.index + 1];
+    return {a.x + (b.x - a.x) * l.fraction, a.y + (b.y - a.y) * l.fraction};
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include "bezier.hpp"
+
+// Cumulative arc length of a polyline, built once per tessellation, so that a distance
+// along the curve maps back to a point or a parameter with a binary search instead of a walk
+struct arc_length_table
+{
+    // Position of a point on the polyline: the segment starting at points[index] and the fraction along it
+    struct location
+    {
+        std::size_t index;
+        float fraction;
+    };
+
+    // Recomputes the distances of points [first, points.size()), the ones before first are kept
+    void update(std::vector<vec2> const & points, std::size_t first = 0);
+
+    float length() const { return distance.empty() ? 0.f : distance.back(); }
+
+    // Distances outside of [0, length()] are clamped to the curve ends
+    location locate(float s) const;
+
+    // Curve parameter in [0, 1], if the points were sampled at uniformly spaced parameters
+    float parameter(float s) const;
+
+    vec2 point(std::vector<vec2> const & points, float s) const;
+
+    std::vector<float> distance;
+};
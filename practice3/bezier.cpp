@@ -0,0 +1,141 @@
+#include "bezier.hpp"
+
+#include <cmath>
+
+void bezier_evaluator::update_binomials(std::size_t degree)
+{
+    if (binomials_.size() == degree + 1)
+        return;
+
+    binomials_.assign(degree + 1, 1.0);
+    for (std::size_t i = 1; i <= degree; ++i)
+        binomials_[i] = binomials_[i - 1] * (degree - i + 1) / i;
+}
+
+vec2 bezier_evaluator::de_casteljau(std::vector<vec2> const & control, float t)
+{
+    scratch_.assign(control.begin(), control.end());
+
+    for (std::size_t k = 0; k + 1 < scratch_.size(); ++k) {
+        for (std::size_t i = 0; i + k + 1 < scratch_.size(); ++i) {
+            scratch_[i].x = scratch_[i].x * (1.f - t) + scratch_[i + 1].x * t;
+            scratch_[i].y = scratch_[i].y * (1.f - t) + scratch_[i + 1].y * t;
+        }
+    }
+    return scratch_[0];
+}
+
+vec2 bezier_evaluator::evaluate(std::vector<vec2> const & control, float t)
+{
+    std::size_t const n = control.size() - 1;
+    if (n == 0)
+        return control[0];
+    if (n > max_horner_degree)
+        return de_casteljau(control, t);
+
+    update_binomials(n);
+
+    // sum C(n, i) (1-t)^(n-i) t^i P_i = (1-t)^n sum C(n, i) P_i s^i with s = t / (1-t);
+    // the roles of t and 1-t are swapped past the middle to keep s <= 1
+    double const u = 1.0 - t;
+    double x, y, s, scale;
+
+    if (t <= 0.5f) {
+        s = t / u;
+        scale = std::pow(u, n);
+        x = binomials_[n] * control[n].x;
+        y = binomials_[n] * control[n].y;
+        for (std::size_t i = n; i-- > 0;) {
+            x = x * s + binomials_[i] * control[i].x;
+            y = y * s + binomials_[i] * control[i].y;
+        }
+    } else {
+        s = u / t;
+        scale = std::pow(double(t), n);
+        x = binomials_[0] * control[0].x;
+        y = binomials_[0] * control[0].y;
+        for (std::size_t i = 1; i <= n; ++i) {
+            x = x * s + binomials_[i] * control[i].x;
+            y = y * s + binomials_[i] * control[i].y;
+        }
+    }
+
+    return {float(x * scale), float(y * scale)};
+}
+
+void bezier_evaluator::sample_uniform(std::vector<vec2> const & control, std::size_t count, std::vector<vec2> & result)
+{
+    result.clear();
+    if (control.empty() || count == 0)
+        return;
+
+    result.reserve(count);
+    for (std::size_t i = 0; i < count; ++i)
+        result.push_back(evaluate(control, count == 1 ? 0.f : float(i) / (count - 1)));
+}
+
+void bezier_evaluator::flatten(std::vector<vec2> const & control, float tolerance, std::vector<vec2> & result)
+{
+    // Deep enough for sub-pixel pieces of any reasonable curve, and bounds the work for degenerate input
+    static constexpr int max_depth = 16;
+
+    result.clear();
+    if (control.empty())
+        return;
+
+    std::size_t const size = control.size();
+    result.push_back(control.front());
+    if (size == 1)
+        return;
+
+    stack_.assign(control.begin(), control.end());
+    depths_.assign(1, 0);
+
+    while (!depths_.empty()) {
+        int const depth = depths_.back();
+        depths_.pop_back();
+
+        scratch_.assign(stack_.end() - size, stack_.end());
+        stack_.resize(stack_.size() - size);
+
+        // Convex hull property: if every control point is close to the chord, so is the curve
+        vec2 const a = scratch_.front();
+        vec2 const b = scratch_.back();
+        float const dx = b.x - a.x;
+        float const dy = b.y - a.y;
+        float const length = std::hypot(dx, dy);
+
+        bool flat = true;
+        for (std::size_t i = 1; i + 1 < size && flat; ++i) {
+            float const px = scratch_[i].x - a.x;
+            float const py = scratch_[i].y - a.y;
+            float const distance = length > 0.f ? std::abs(px * dy - py * dx) / length : std::hypot(px, py);
+            flat = distance <= tolerance;
+        }
+
+        if (flat || depth == max_depth) {
+            result.push_back(b);
+            continue;
+        }
+
+        // De Casteljau at t = 1/2 in place: the left half is the first point of every level,
+        // the right half is the last point of every level
+        std::size_t const left = stack_.size();
+        stack_.resize(left + 2 * size);
+        vec2 * right_half = stack_.data() + left;
+        vec2 * left_half = stack_.data() + left + size;
+
+        for (std::size_t k = 0; k < size; ++k) {
+            left_half[k] = scratch_[0];
+            right_half[size - 1 - k] = scratch_[size - 1 - k];
+            for (std::size_t i = 0; i + k + 1 < size; ++i) {
+                scratch_[i].x = (scratch_[i].x + scratch_[i + 1].x) * 0.5f;
+                scratch_[i].y = (scratch_[i].y + scratch_[i + 1].y) * 0.5f;
+            }
+        }
+
+        // The left half is on top of the stack, so pieces come out in curve order
+        depths_.push_back(depth + 1);
+        depths_.push_back(depth + 1);
+    }
+}
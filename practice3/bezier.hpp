@@ -0,0 +1,39 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+struct vec2
+{
+    float x;
+    float y;
+};
+
+// Evaluates a single Bezier curve of arbitrary degree. All scratch memory is kept
+// between calls, so after the first call nothing is allocated per sample.
+struct bezier_evaluator
+{
+    // Point at parameter t, O(n) through the Bernstein form and Horner's rule
+    vec2 evaluate(std::vector<vec2> const & control, float t);
+
+    // count points at uniformly spaced parameters from 0 to 1
+    void sample_uniform(std::vector<vec2> const & control, std::size_t count, std::vector<vec2> & result);
+
+    // Recursively halves the curve until the control polygon of every piece lies within tolerance
+    // of its chord, and outputs the piece end points: flat parts get few segments, sharp turns many
+    void flatten(std::vector<vec2> const & control, float tolerance, std::vector<vec2> & result);
+
+private:
+    // Above this degree the binomial coefficients overflow a double, evaluate() falls back to De Casteljau
+    static constexpr std::size_t max_horner_degree = 512;
+
+    vec2 de_casteljau(std::vector<vec2> const & control, float t);
+    void update_binomials(std::size_t degree);
+
+    std::vector<double> binomials_;
+    std::vector<vec2> scratch_;
+
+    // Pieces waiting to be flattened, control.size() points each, and their subdivision depths
+    std::vector<vec2> stack_;
+    std::vector<int> depths_;
+};
@@ -12,6 +12,13 @@
 #include <iostream>
 #include <chrono>
 #include <vector>
+#include <cmath>
+#include <algorithm>
+#include <utility>
+
+#include "bezier.hpp"
+#include "spline.hpp"
+#include "arc_length.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -34,6 +41,13 @@ R"(#version 330 core
 uniform mat4 view;
 uniform float dash;
 uniform float time;
+// Spline vertices store the distance from the start of their segment, the segment
+// offsets live in buffer textures so that an edit does not touch the vertices after it:
+// the offset of a segment within its block of segments plus the offset of the block
+uniform samplerBuffer segment_offsets;
+uniform samplerBuffer block_offsets;
+uniform int segment_vertices;
+uniform int block_segments;
 
 layout (location = 0) in vec2 in_position;
 layout (location = 1) in vec4 in_color;
@@ -47,7 +61,12 @@ void main()
     gl_Position = view * vec4(in_position, 0.0, 1.0);
     color = in_color;
     if (dash == 1.0) {
-        dist = distance + int(time) % 40;
+        float offset = 0.0;
+        if (segment_vertices > 0) {
+            int segment = gl_VertexID / segment_vertices;
+            offset = texelFetch(block_offsets, segment / block_segments).r + texelFetch(segment_offsets, segment).r;
+        }
+        dist = distance + offset + int(time) % 40;
     } else {
         dist = 0.0;
     }
@@ -112,12 +131,6 @@ GLuint create_program(GLuint vertex_shader, GLuint fragment_shader)
     return result;
 }
 
-struct vec2
-{
-    float x;
-    float y;
-};
-
 struct vertex
 {
     vec2 position;
@@ -125,23 +138,6 @@ struct vertex
     float distance;
 };
 
-vec2 bezier(std::vector<vertex> const & vertices, float t)
-{
-    std::vector<vec2> points(vertices.size());
-
-    for (std::size_t i = 0; i < vertices.size(); ++i)
-        points[i] = vertices[i].position;
-
-    // De Casteljau's algorithm
-    for (std::size_t k = 0; k + 1 < vertices.size(); ++k) {
-        for (std::size_t i = 0; i + k + 1 < vertices.size(); ++i) {
-            points[i].x = points[i].x * (1.f - t) + points[i + 1].x * t;
-            points[i].y = points[i].y * (1.f - t) + points[i + 1].y * t;
-        }
-    }
-    return points[0];
-}
-
 GLuint create_buffer() {
     GLuint buff;
     glGenBuffers(1, &buff);
@@ -156,22 +152,44 @@ GLuint create_vertex_array() {
     return vao;
 }
 
-void generate_bezier_vertices(int quality, std::vector<vertex>& vertices, std::vector<vertex>& vertices_bezier) {
-    vertices_bezier.clear();
-    if (vertices.empty())
-        return;
-
-    for (float t = 0.0f; t < 1.0f + 1.0f / (vertices.size() * (float)quality * 2); t += 1.0f / (vertices.size() * (float)quality)) {
-        vec2 coord = bezier(vertices, t);
-        float distance = vertices_bezier.empty()
-                ? 0
-                : vertices_bezier.back().distance +
-                    std::hypot(
-                        vertices_bezier.back().position.x - coord.x,
-                        vertices_bezier.back().position.y - coord.y
-                    );
-        vertices_bezier.push_back(vertex {coord, {0, 0, 0, 0}, distance });
+void generate_bezier_vertices(int quality, bool adaptive, std::vector<vertex>& vertices, std::vector<vertex>& vertices_bezier,
+                              std::vector<vec2>& points, arc_length_table& table) {
+    static bezier_evaluator evaluator;
+    static std::vector<vec2> control;
+    static std::vector<vec2> previous;
+
+    std::swap(points, previous);
+    points.clear();
+
+    if (!vertices.empty()) {
+        control.clear();
+        for (auto const & v : vertices)
+            control.push_back(v.position);
+
+        if (adaptive)
+            evaluator.flatten(control, 1.f / quality, points);
+        else
+            evaluator.sample_uniform(control, vertices.size() * quality + 1, points);
     }
+
+    // Distances up to the first point that moved are still valid
+    std::size_t const first = std::mismatch(points.begin(), points.end(), previous.begin(), previous.end(),
+        [](vec2 const & a, vec2 const & b){ return a.x == b.x && a.y == b.y; }).first - points.begin();
+
+    table.update(points, first);
+    vertices_bezier.resize(points.size());
+    for (std::size_t i = first; i < points.size(); ++i)
+        vertices_bezier[i] = vertex {points[i], {0, 0, 0, 0}, table.distance[i] };
+}
+
+// Markers every marker_spacing pixels along the curve, running along it at marker_speed pixels per second
+void place_markers(float length, float time, std::vector<vertex>& markers, auto const & point_at) {
+    static constexpr float marker_spacing = 60.f;
+    static constexpr float marker_speed = 50.f;
+
+    markers.clear();
+    for (float s = std::fmod(time * marker_speed, marker_spacing); s < length; s += marker_spacing)
+        markers.push_back(vertex {point_at(s), {255, 0, 0, 255}, 0.f});
 }
 
 void update_vbo(GLuint vbo, std::vector<vertex>& vertices) {
@@ -179,6 +197,75 @@ void update_vbo(GLuint vbo, std::vector<vertex>& vertices) {
     glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertex), vertices.data(), GL_DYNAMIC_DRAW);
 }
 
+// Uploads data[first, last) into a buffer mirroring data, growing it by doubling
+void update_float_buffer(GLuint buffer, std::size_t & capacity, std::vector<float> const & data, std::size_t first, std::size_t last) {
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    if (data.size() > capacity) {
+        capacity = std::max(data.size(), 2 * capacity);
+        glBufferData(GL_TEXTURE_BUFFER, capacity * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
+        glBufferSubData(GL_TEXTURE_BUFFER, 0, data.size() * sizeof(float), data.data());
+    } else if (first < last) {
+        glBufferSubData(GL_TEXTURE_BUFFER, first * sizeof(float), (last - first) * sizeof(float), data.data() + first);
+    }
+}
+
+// Keeps a vertex buffer and the segment offsets in sync with the spline, re-uploading
+// only the samples and offsets of the changed segments; the buffers grow by doubling
+struct spline_buffers
+{
+    GLuint vbo;
+    GLuint offsets;
+    GLuint block_offsets;
+    std::size_t vertex_capacity = 0;
+    std::size_t offset_capacity = 0;
+    std::size_t block_capacity = 0;
+    std::vector<vertex> vertices;
+
+    void update(catmull_rom_spline const & spline, segment_range range) {
+        std::size_t const n = spline.samples_per_segment();
+        std::size_t const count = spline.samples.size();
+
+        vertices.resize(count);
+        if (count == 0)
+            return;
+
+        std::size_t const first = range.first * n;
+        std::size_t const last = std::min(range.last * n, count - 1);
+        for (std::size_t i = first; i < last; ++i)
+            vertices[i] = vertex{spline.samples[i], {0, 0, 0, 0}, spline.local_distance[i]};
+        vertices.back() = vertex{spline.samples.back(), {0, 0, 0, 0}, 0.f};
+
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        if (count > vertex_capacity) {
+            vertex_capacity = std::max(count, 2 * vertex_capacity);
+            glBufferData(GL_ARRAY_BUFFER, vertex_capacity * sizeof(vertex), nullptr, GL_DYNAMIC_DRAW);
+            glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(vertex), vertices.data());
+        } else {
+            if (first < last)
+                glBufferSubData(GL_ARRAY_BUFFER, first * sizeof(vertex), (last - first) * sizeof(vertex), vertices.data() + first);
+            glBufferSubData(GL_ARRAY_BUFFER, (count - 1) * sizeof(vertex), sizeof(vertex), &vertices.back());
+        }
+
+        // Offsets within the blocks of the changed segments, and the starts of the blocks after them
+        std::size_t const block_size = catmull_rom_spline::block_size;
+        std::size_t offsets_last = range.first;
+        if (range.first < range.last)
+            offsets_last = std::min(spline.local_start.size(), ((range.last - 1) / block_size + 1) * block_size);
+        update_float_buffer(offsets, offset_capacity, spline.local_start, range.first, offsets_last);
+        update_float_buffer(block_offsets, block_capacity, spline.block_start, range.first / block_size + 1, spline.block_start.size());
+    }
+};
+
+// Control point under the cursor, if any
+int find_control_point(std::vector<vertex> const & vertices, float x, float y) {
+    static constexpr float pick_radius = 8.f;
+
+    for (std::size_t i = vertices.size(); i-- > 0;)
+        if (std::hypot(vertices[i].position.x - x, vertices[i].position.y - y) <= pick_radius)
+            return i;
+    return -1;
+}
+
 void setupVertexAttribs() {
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(vertex), reinterpret_cast<void*>(offsetof(vertex, position)));
@@ -239,7 +326,21 @@ int main() try
 //     };
     std::vector<vertex> vertices = {};
     std::vector<vertex> vertices_bezier = {};
+    std::vector<vec2> bezier_points;
+    arc_length_table bezier_table;
+    std::vector<vertex> markers;
     int quality = 4;
+    // Adaptive flattening: quality is the inverse of the allowed deviation in pixels,
+    // uniform sampling: quality is the number of segments per control point
+    bool adaptive = true;
+    // Piecewise Catmull-Rom instead of a single Bezier curve through all the points
+    bool spline_mode = false;
+    // Control point being dragged with the left button
+    int dragged = -1;
+
+    // quality is the number of segments per control point in both uniform modes
+    auto samples_per_segment = [&]{ return std::size_t(quality); };
+    catmull_rom_spline spline(samples_per_segment());
 
     GLuint vbo = create_buffer();
     GLuint vao = create_vertex_array();
@@ -249,6 +350,40 @@ int main() try
     GLuint vao_bezier = create_vertex_array();
     setupVertexAttribs();
 
+    spline_buffers spline_gpu;
+    spline_gpu.vbo = create_buffer();
+    GLuint vao_spline = create_vertex_array();
+    setupVertexAttribs();
+
+    GLuint vbo_markers = create_buffer();
+    GLuint vao_markers = create_vertex_array();
+    setupVertexAttribs();
+
+    auto create_float_texture = [](GLuint & buffer) {
+        glGenBuffers(1, &buffer);
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, sizeof(float), nullptr, GL_DYNAMIC_DRAW);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_R32F, buffer);
+        return texture;
+    };
+
+    GLuint offsets_texture = create_float_texture(spline_gpu.offsets);
+    GLuint block_offsets_texture = create_float_texture(spline_gpu.block_offsets);
+
+    // Markers only move with the animation or with the curve, other redraws reuse the uploaded ones
+    bool markers_changed = true;
+
+    auto update_curve = [&]{
+        markers_changed = true;
+        if (!spline_mode) {
+            generate_bezier_vertices(quality, adaptive, vertices, vertices_bezier, bezier_points, bezier_table);
+            update_vbo(vbo_bezier, vertices_bezier);
+        }
+    };
+
 //    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertex), vertices.data(), GL_DYNAMIC_DRAW);
 
 //    vertex v{};
@@ -258,20 +393,42 @@ int main() try
     GLuint view_location = glGetUniformLocation(program, "view");
     GLuint dash_location = glGetUniformLocation(program, "dash");
     GLuint time_location = glGetUniformLocation(program, "time");
+    GLuint segment_offsets_location = glGetUniformLocation(program, "segment_offsets");
+    GLuint segment_vertices_location = glGetUniformLocation(program, "segment_vertices");
+    GLuint block_offsets_location = glGetUniformLocation(program, "block_offsets");
+    GLuint block_segments_location = glGetUniformLocation(program, "block_segments");
 
     auto last_frame_start = std::chrono::high_resolution_clock::now();
 
     float time = 0.f;
 
+    // The dashes and the markers move along the curve; P stops them
+    bool animate = true;
+    auto animating = [&]{ return animate && (spline_mode ? spline.length() : bezier_table.length()) > 0.f; };
+
+    // Set by every change to the picture; with nothing animating the loop sleeps until an event sets it
+    bool redraw = true;
+
     bool running = true;
     while (running)
     {
-        for (SDL_Event event; SDL_PollEvent(&event);) switch (event.type)
+        bool wait = !redraw && !animating();
+        bool const waited = wait;
+        auto next_event = [&](SDL_Event & event)
+        {
+            if (std::exchange(wait, false))
+                return SDL_WaitEventTimeout(&event, 1000) != 0;
+            return SDL_PollEvent(&event) != 0;
+        };
+
+        for (SDL_Event event; next_event(event);) switch (event.type)
         {
         case SDL_QUIT:
             running = false;
             break;
-        case SDL_WINDOWEVENT: switch (event.window.event)
+        case SDL_WINDOWEVENT:
+            redraw = true;
+            switch (event.window.event)
             {
             case SDL_WINDOWEVENT_RESIZED:
                 width = event.window.data1;
@@ -281,38 +438,74 @@ int main() try
             }
             break;
         case SDL_MOUSEBUTTONDOWN:
+            redraw = true;
             if (event.button.button == SDL_BUTTON_LEFT)
             {
                 float mouse_x = event.button.x;
                 float mouse_y = event.button.y;
-                vertices.push_back({{mouse_x, mouse_y}, {0, 0, 255, 255}, 0.0f});
-                update_vbo(vbo, vertices);
-                generate_bezier_vertices(quality, vertices, vertices_bezier);
-                update_vbo(vbo_bezier, vertices_bezier);
+                dragged = find_control_point(vertices, mouse_x, mouse_y);
+                if (dragged < 0) {
+                    vertices.push_back({{mouse_x, mouse_y}, {0, 0, 255, 255}, 0.0f});
+                    update_vbo(vbo, vertices);
+                    spline_gpu.update(spline, spline.push_back({mouse_x, mouse_y}));
+                    update_curve();
+                }
             }
             else if (event.button.button == SDL_BUTTON_RIGHT)
             {
                 if (!vertices.empty()) {
                     vertices.pop_back();
                 }
+                dragged = -1;
                 update_vbo(vbo, vertices);
-                generate_bezier_vertices(quality, vertices, vertices_bezier);
-                update_vbo(vbo_bezier, vertices_bezier);
+                spline_gpu.update(spline, spline.pop_back());
+                update_curve();
+            }
+            break;
+        case SDL_MOUSEBUTTONUP:
+            if (event.button.button == SDL_BUTTON_LEFT)
+                dragged = -1;
+            break;
+        case SDL_MOUSEMOTION:
+            if (dragged >= 0)
+            {
+                redraw = true;
+                vec2 const position{float(event.motion.x), float(event.motion.y)};
+                vertices[dragged].position = position;
+                glBindBuffer(GL_ARRAY_BUFFER, vbo);
+                glBufferSubData(GL_ARRAY_BUFFER, dragged * sizeof(vertex), sizeof(vertex), &vertices[dragged]);
+                spline_gpu.update(spline, spline.move(dragged, position));
+                update_curve();
             }
             break;
         case SDL_KEYDOWN:
+            redraw = true;
             if (event.key.keysym.sym == SDLK_LEFT)
             {
                 quality = std::max(quality - 1, 1);
-                generate_bezier_vertices(quality, vertices, vertices_bezier);
-                update_vbo(vbo_bezier, vertices_bezier);
+                spline.set_samples_per_segment(samples_per_segment());
+                spline_gpu.update(spline, {0, spline.segment_count()});
+                update_curve();
             }
             else if (event.key.keysym.sym == SDLK_RIGHT)
             {
                 quality++;
-                generate_bezier_vertices(quality, vertices, vertices_bezier);
-                update_vbo(vbo_bezier, vertices_bezier);
+                spline.set_samples_per_segment(samples_per_segment());
+                spline_gpu.update(spline, {0, spline.segment_count()});
+                update_curve();
+            }
+            else if (event.key.keysym.sym == SDLK_SPACE)
+            {
+                adaptive = !adaptive;
+                update_curve();
+            }
+            else if (event.key.keysym.sym == SDLK_m)
+            {
+                spline_mode = !spline_mode;
+                update_curve();
             }
+            else if (event.key.keysym.sym == SDLK_p)
+                animate = !animate;
             break;
         }
 
@@ -320,9 +513,28 @@ int main() try
             break;
 
         auto now = std::chrono::high_resolution_clock::now();
+        // Time spent asleep is not animated
+        if (waited)
+            last_frame_start = now;
         float dt = std::chrono::duration_cast<std::chrono::duration<float>>(now - last_frame_start).count();
         last_frame_start = now;
-        time += dt;
+
+        if (!redraw && !animating())
+            continue;
+        redraw = false;
+
+        if (animate && dt > 0.f) {
+            time += dt;
+            markers_changed = true;
+        }
+
+        if (std::exchange(markers_changed, false)) {
+            if (spline_mode)
+                place_markers(spline.length(), time, markers, [&](float s){ return spline.point_at(s); });
+            else
+                place_markers(bezier_table.length(), time, markers, [&](float s){ return bezier_table.point(bezier_points, s); });
+            update_vbo(vbo_markers, markers);
+        }
 
         glClear(GL_COLOR_BUFFER_BIT);
 
@@ -340,6 +552,16 @@ int main() try
         glUniformMatrix4fv(view_location, 1, GL_TRUE, view);
         glUniform1f(dash_location, dash);
         glUniform1f(time_location, time * 100);
+        glUniform1i(segment_offsets_location, 0);
+        glUniform1i(block_offsets_location, 1);
+        glUniform1i(segment_vertices_location, 0);
+        glUniform1i(block_segments_location, catmull_rom_spline::block_size);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_BUFFER, offsets_texture);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_BUFFER, block_offsets_texture);
+        glActiveTexture(GL_TEXTURE0);
 
         glBindVertexArray(vao);
 //        glDrawArrays(GL_TRIANGLES, 0, 3);
@@ -350,10 +572,22 @@ int main() try
 
         dash = 1.0f;
 
-        glBindVertexArray(vao_bezier);
         glLineWidth(5.0f);
         glUniform1f(dash_location, dash);
-        glDrawArrays(GL_LINE_STRIP, 0, vertices_bezier.size());
+        if (spline_mode) {
+            glBindVertexArray(vao_spline);
+            glUniform1i(segment_vertices_location, spline.samples_per_segment());
+            glDrawArrays(GL_LINE_STRIP, 0, spline.samples.size());
+        } else {
+            glBindVertexArray(vao_bezier);
+            glDrawArrays(GL_LINE_STRIP, 0, vertices_bezier.size());
+        }
+
+        glBindVertexArray(vao_markers);
+        glUniform1f(dash_location, 0.f);
+        glUniform1i(segment_vertices_location, 0);
+        glPointSize(8);
+        glDrawArrays(GL_POINTS, 0, markers.size());
 
         SDL_GL_SwapWindow(window);
     }
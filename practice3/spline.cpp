@@ -0,0 +1,167 @@
+#include "spline.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+catmull_rom_spline::catmull_rom_spline(std::size_t samples_per_segment)
+    : samples_per_segment_(std::max<std::size_t>(1, samples_per_segment))
+{}
+
+vec2 catmull_rom_spline::point(std::ptrdiff_t index) const
+{
+    // End segments reuse their end point as the missing neighbour
+    index = std::clamp<std::ptrdiff_t>(index, 0, points.size() - 1);
+    return points[index];
+}
+
+segment_range catmull_rom_spline::push_back(vec2 point)
+{
+    points.push_back(point);
+
+    // The previous last segment used its own end point as the next neighbour
+    std::size_t const segments = segment_count();
+    segment_range range{segments > 2 ? segments - 2 : 0, segments};
+    tessellate(range);
+    return range;
+}
+
+segment_range catmull_rom_spline::pop_back()
+{
+    if (points.empty())
+        return {0, 0};
+
+    points.pop_back();
+
+    std::size_t const segments = segment_count();
+    segment_range range{segments > 1 ? segments - 1 : 0, segments};
+    tessellate(range);
+    return range;
+}
+
+segment_range catmull_rom_spline::move(std::size_t index, vec2 point)
+{
+    points[index] = point;
+
+    // Point k is a neighbour of segments k - 2 .. k + 1
+    std::size_t const segments = segment_count();
+    segment_range range{index > 2 ? index - 2 : 0, std::min(segments, index + 2)};
+    tessellate(range);
+    return range;
+}
+
+float catmull_rom_spline::segment_start(std::size_t s) const
+{
+    return block_start[s / block_size] + local_start[s];
+}
+
+vec2 catmull_rom_spline::point_at(float s) const
+{
+    std::size_t const segments = segment_count();
+    if (segments == 0)
+        return points.empty() ? vec2{0.f, 0.f} : points[0];
+
+    s = std::clamp(s, 0.f, length());
+
+    std::size_t const blocks = block_start.size() - 1;
+    std::size_t const block = std::min<std::size_t>(
+        std::upper_bound(block_start.begin(), block_start.end(), s) - block_start.begin() - 1, blocks - 1);
+
+    auto const block_begin = local_start.begin() + block * block_size;
+    auto const block_end = local_start.begin() + std::min(segments, (block + 1) * block_size);
+    std::size_t const segment = std::upper_bound(block_begin + 1, block_end, s - block_start[block]) - local_start.begin() - 1;
+    float const local = s - segment_start(segment);
+
+    // Samples of the segment plus the first sample of the next one, whose local distance is the segment length
+    std::size_t const n = samples_per_segment_;
+    auto const begin = local_distance.begin() + segment * n;
+    std::size_t const i = std::max<std::ptrdiff_t>(1, std::upper_bound(begin, begin + n, local) - begin);
+    std::size_t const index = segment * n + i;
+
+    float const d0 = local_distance[index - 1];
+    float const d1 = (i == n) ? segment_length[segment] : local_distance[index];
+    float const f = d1 > d0 ? std::clamp((local - d0) / (d1 - d0), 0.f, 1.f) : 0.f;
+
+    vec2 const a = samples[index - 1];
+    vec2 const b = samples[index];
+    return {a.x + (b.x - a.x) * f, a.y + (b.y - a.y) * f};
+}
+
+void catmull_rom_spline::set_samples_per_segment(std::size_t samples_per_segment)
+{
+    samples_per_segment_ = std::max<std::size_t>(1, samples_per_segment);
+    tessellate({0, segment_count()});
+}
+
+void catmull_rom_spline::tessellate(segment_range range)
+{
+    std::size_t const segments = segment_count();
+    std::size_t const n = samples_per_segment_;
+    std::size_t const total = points.empty() ? 0 : segments * n + 1;
+
+    std::size_t const blocks = (segments + block_size - 1) / block_size;
+
+    samples.resize(total);
+    local_distance.resize(total);
+    segment_length.resize(segments);
+    local_start.resize(segments + 1);
+    block_start.resize(blocks + 1);
+
+    if (points.empty())
+        return;
+
+    for (std::size_t s = range.first; s < range.last; ++s) {
+        std::ptrdiff_t const k = s;
+        vec2 const p0 = point(k - 1);
+        vec2 const p1 = point(k);
+        vec2 const p2 = point(k + 1);
+        vec2 const p3 = point(k + 2);
+
+        float length = 0.f;
+        for (std::size_t j = 0; j < n; ++j) {
+            float const t = float(j) / n;
+            float const t2 = t * t;
+            float const t3 = t2 * t;
+
+            // Uniform Catmull-Rom in its polynomial form
+            auto blend = [&](float a, float b, float c, float d) {
+                return 0.5f * ((2.f * b) + (c - a) * t + (2.f * a - 5.f * b + 4.f * c - d) * t2 + (3.f * b - a - 3.f * c + d) * t3);
+            };
+
+            vec2 const p = {blend(p0.x, p1.x, p2.x, p3.x), blend(p0.y, p1.y, p2.y, p3.y)};
+
+            std::size_t const index = s * n + j;
+            if (j > 0)
+                length += std::hypot(p.x - samples[index - 1].x, p.y - samples[index - 1].y);
+            samples[index] = p;
+            local_distance[index] = length;
+        }
+    }
+
+    samples.back() = points.back();
+    local_distance.back() = 0.f;
+
+    block_start[0] = 0.f;
+
+    // Segment lengths only need the first sample of the following segment (or the final point)
+    std::size_t const first = std::min(range.first, segments);
+    std::size_t const last = std::min(range.last, segments);
+    for (std::size_t s = first; s < last; ++s) {
+        std::size_t const end = s * n + n - 1;
+        vec2 const a = samples[end];
+        vec2 const b = samples[end + 1];
+        segment_length[s] = local_distance[end] + std::hypot(b.x - a.x, b.y - a.y);
+    }
+
+    // Offsets within the blocks of the changed segments, then the starts of all the blocks after them
+    if (first < last) {
+        std::size_t const first_block = first / block_size;
+        std::size_t const last_block = (last - 1) / block_size;
+        for (std::size_t s = first; s < std::min(segments + 1, (last_block + 1) * block_size); ++s)
+            local_start[s] = (s % block_size == 0) ? 0.f : local_start[s - 1] + segment_length[s - 1];
+
+        for (std::size_t b = first_block; b < blocks; ++b) {
+            std::size_t const end = std::min(segments, (b + 1) * block_size) - 1;
+            block_start[b + 1] = block_start[b] + local_start[end] + segment_length[end];
+        }
+    }
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include "bezier.hpp"
+
+// Segments [first, last) whose samples changed after an edit
+struct segment_range
+{
+    std::size_t first;
+    std::size_t last;
+};
+
+// Piecewise cubic Catmull-Rom curve through its control points. Every segment owns a fixed number
+// of samples, so an edit re-tessellates only the segments within two points of it and the samples
+// of the other segments keep their positions in the arrays (and in any GPU buffer mirroring them).
+struct catmull_rom_spline
+{
+    explicit catmull_rom_spline(std::size_t samples_per_segment);
+
+    segment_range push_back(vec2 point);
+    segment_range pop_back();
+    segment_range move(std::size_t index, vec2 point);
+
+    // Re-tessellates everything
+    void set_samples_per_segment(std::size_t samples_per_segment);
+    std::size_t samples_per_segment() const { return samples_per_segment_; }
+
+    std::size_t segment_count() const { return points.empty() ? 0 : points.size() - 1; }
+    float length() const { return block_start.empty() ? 0.f : block_start.back(); }
+
+    // Arc length from the start of the curve to the start of segment s, or the total length for s == segment_count()
+    float segment_start(std::size_t s) const;
+
+    // Point at arc length s from the start: binary searches over block_start for the block, over its
+    // local_start for the segment, then over the segment's local_distance for the sample.
+    // Distances outside the curve are clamped.
+    vec2 point_at(float s) const;
+
+    // Segment offsets are prefix sums in two levels, so that an edit updates one block of local_start
+    // and the block_start after it instead of the offsets of every following segment
+    static constexpr std::size_t block_size = 256;
+
+    std::vector<vec2> points;
+
+    // Segment i owns samples [i * samples_per_segment, (i + 1) * samples_per_segment),
+    // the very last sample is the last control point
+    std::vector<vec2> samples;
+    // Arc length from the start of the sample's own segment
+    std::vector<float> local_distance;
+    // Length of every segment
+    std::vector<float> segment_length;
+    // Arc length from the start of the segment's block to the start of the segment, plus the same for the end of the curve
+    std::vector<float> local_start;
+    // Arc length from the start of the curve to the start of every block, plus the total length
+    std::vector<float> block_start;
+
+private:
+    void tessellate(segment_range range);
+    vec2 point(std::ptrdiff_t index) const;
+
+    std::size_t samples_per_segment_;
+};
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "obj_parser.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// Baked ambient occlusion of one vertex, four bytes meant to be uploaded as one more vertex attribute:
+// glVertexAttribPointer(location, 4, GL_BYTE, GL_TRUE, 4, 0) makes it vec4(bent_normal, visibility)
+struct ambient_occlusion_vertex
+{
+    // Average unoccluded direction, normalized and mapped to [-127, 127]
+    std::int8_t bent_normal[3];
+    // Cosine-weighted unoccluded fraction of the hemisphere around the normal, mapped to [0, 127]
+    std::int8_t visibility;
+};
+
+struct ambient_occlusion_settings
+{
+    int samples = 64;
+    // Occluders farther than this fraction of the bounding box diagonal don't count
+    float max_distance = 0.1f;
+};
+
+// Traces the hemisphere of every vertex against a BVH of the mesh, on all cores
+std::vector<ambient_occlusion_vertex> bake_ambient_occlusion(obj_data const & mesh, ambient_occlusion_settings const & settings = {});
+
+// Reads the cache file if it was baked from the same mesh with the same settings,
+// otherwise bakes and rewrites it. A cache that can't be written is not an error.
+std::vector<ambient_occlusion_vertex> load_ambient_occlusion(obj_data const & mesh, std::filesystem::path const & cache_path,
+    ambient_occlusion_settings const & settings = {});
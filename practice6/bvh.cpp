@@ -0,0 +1,966 @@
+#include "bvh.hpp"
+#include "parallel.hpp"
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <thread>
+#include <type_traits>
+
+#ifdef __SSE__
+#include <xmmintrin.h>
+#endif
+
+namespace
+{
+
+    constexpr float infinity = std::numeric_limits<float>::infinity();
+
+#ifdef __SSE__
+    struct float4
+    {
+        __m128 v;
+
+        float4() = default;
+        float4(float x) : v(_mm_set1_ps(x)) {}
+        float4(__m128 v) : v(v) {}
+
+        static float4 load(float const * p) { return _mm_load_ps(p); }
+        void store(float * p) const { _mm_store_ps(p, v); }
+    };
+
+    struct mask4
+    {
+        __m128 v;
+    };
+
+    float4 operator + (float4 a, float4 b) { return _mm_add_ps(a.v, b.v); }
+    float4 operator - (float4 a, float4 b) { return _mm_sub_ps(a.v, b.v); }
+    float4 operator * (float4 a, float4 b) { return _mm_mul_ps(a.v, b.v); }
+    float4 operator / (float4 a, float4 b) { return _mm_div_ps(a.v, b.v); }
+    float4 min(float4 a, float4 b) { return _mm_min_ps(a.v, b.v); }
+    float4 max(float4 a, float4 b) { return _mm_max_ps(a.v, b.v); }
+
+    mask4 operator < (float4 a, float4 b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+    mask4 operator <= (float4 a, float4 b) { return {_mm_cmple_ps(a.v, b.v)}; }
+    mask4 operator > (float4 a, float4 b) { return {_mm_cmpgt_ps(a.v, b.v)}; }
+    mask4 operator >= (float4 a, float4 b) { return {_mm_cmpge_ps(a.v, b.v)}; }
+    mask4 operator != (float4 a, float4 b) { return {_mm_cmpneq_ps(a.v, b.v)}; }
+    mask4 operator & (mask4 a, mask4 b) { return {_mm_and_ps(a.v, b.v)}; }
+
+    float4 select(mask4 m, float4 a, float4 b) { return _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)); }
+
+    // Bit i is set when lane i of the mask is
+    int bits(mask4 m) { return _mm_movemask_ps(m.v); }
+
+    float lane(float4 x, int i)
+    {
+        alignas(16) float values[4];
+        _mm_store_ps(values, x.v);
+        return values[i];
+    }
+#else
+    struct float4
+    {
+        float v[4];
+
+        float4() = default;
+        float4(float x) : v{x, x, x, x} {}
+
+        static float4 load(float const * p) { float4 r; std::copy(p, p + 4, r.v); return r; }
+        void store(float * p) const { std::copy(v, v + 4, p); }
+    };
+
+    struct mask4
+    {
+        bool v[4];
+    };
+
+    template <typename F>
+    auto lanewise(float4 a, float4 b, F f)
+    {
+        std::conditional_t<std::is_same_v<decltype(f(0.f, 0.f)), bool>, mask4, float4> r;
+        for (int i = 0; i < 4; ++i)
+            r.v[i] = f(a.v[i], b.v[i]);
+        return r;
+    }
+
+    float4 operator + (float4 a, float4 b) { return lanewise(a, b, [](float x, float y){ return x + y; }); }
+    float4 operator - (float4 a, float4 b) { return lanewise(a, b, [](float x, float y){ return x - y; }); }
+    float4 operator * (float4 a, float4 b) { return lanewise(a, b, [](float x, float y){ return x * y; }); }
+    float4 operator / (float4 a, float4 b) { return lanewise(a, b, [](float x, float y){ return x / y; }); }
+    float4 min(float4 a, float4 b) { return lanewise(a, b, [](float x, float y){ return x < y ? x : y; }); }
+    float4 max(float4 a, float4 b) { return lanewise(a, b, [](float x, float y){ return x > y ? x : y; }); }
+
+    mask4 operator < (float4 a, float4 b) { return lanewise(a, b, [](float x, float y){ return x < y; }); }
+    mask4 operator <= (float4 a, float4 b) { return lanewise(a, b, [](float x, float y){ return x <= y; }); }
+    mask4 operator > (float4 a, float4 b) { return lanewise(a, b, [](float x, float y){ return x > y; }); }
+    mask4 operator >= (float4 a, float4 b) { return lanewise(a, b, [](float x, float y){ return x >= y; }); }
+    mask4 operator != (float4 a, float4 b) { return lanewise(a, b, [](float x, float y){ return x != y; }); }
+    mask4 operator & (mask4 a, mask4 b) { return {{a.v[0] && b.v[0], a.v[1] && b.v[1], a.v[2] && b.v[2], a.v[3] && b.v[3]}}; }
+
+    float4 select(mask4 m, float4 a, float4 b)
+    {
+        float4 r;
+        for (int i = 0; i < 4; ++i)
+            r.v[i] = m.v[i] ? a.v[i] : b.v[i];
+        return r;
+    }
+
+    int bits(mask4 m) { return m.v[0] | (m.v[1] << 1) | (m.v[2] << 2) | (m.v[3] << 3); }
+
+    float lane(float4 x, int i)
+    {
+        return x.v[i];
+    }
+#endif
+
+    // Rays are either one ray broadcast to all lanes, tested against four boxes or triangles,
+    // or four rays tested against one broadcast box or triangle. The same code does both.
+    struct ray4
+    {
+        float4 origin[3];
+        float4 direction[3];
+        float4 inv_direction[3];
+        float4 t_min;
+    };
+
+    // Directions closer to zero than this are clamped, so that the slab distances stay finite
+    constexpr float min_direction = 1e-20f;
+
+    float safe_inverse(float d)
+    {
+        return 1.f / (std::abs(d) < min_direction ? std::copysign(min_direction, d) : d);
+    }
+
+    // Slab test. The near and far planes are picked by the sign of the ray direction, which also
+    // makes empty boxes (min = +inf, max = -inf) miss every ray.
+    mask4 intersect_box(ray4 const & r, float4 t_max, float4 const (& near)[3], float4 const (& far)[3], float4 & t_near)
+    {
+        float4 t0 = r.t_min;
+        float4 t1 = t_max;
+        for (int i = 0; i < 3; ++i)
+        {
+            t0 = max(t0, (near[i] - r.origin[i]) * r.inv_direction[i]);
+            t1 = min(t1, (far[i] - r.origin[i]) * r.inv_direction[i]);
+        }
+        t_near = t0;
+        return t0 <= t1;
+    }
+
+    // Möller–Trumbore, e1 and e2 are the edges from v0
+    mask4 intersect_triangle(ray4 const & r, float4 t_max, float4 const (& v0)[3], float4 const (& e1)[3], float4 const (& e2)[3],
+        float4 & t, float4 & u, float4 & v)
+    {
+        auto const & d = r.direction;
+
+        float4 const p[3] = {d[1] * e2[2] - d[2] * e2[1], d[2] * e2[0] - d[0] * e2[2], d[0] * e2[1] - d[1] * e2[0]};
+        float4 const det = e1[0] * p[0] + e1[1] * p[1] + e1[2] * p[2];
+        float4 const inv_det = float4(1.f) / det;
+
+        float4 const s[3] = {r.origin[0] - v0[0], r.origin[1] - v0[1], r.origin[2] - v0[2]};
+        u = (s[0] * p[0] + s[1] * p[1] + s[2] * p[2]) * inv_det;
+
+        float4 const q[3] = {s[1] * e1[2] - s[2] * e1[1], s[2] * e1[0] - s[0] * e1[2], s[0] * e1[1] - s[1] * e1[0]};
+        v = (d[0] * q[0] + d[1] * q[1] + d[2] * q[2]) * inv_det;
+        t = (e2[0] * q[0] + e2[1] * q[1] + e2[2] * q[2]) * inv_det;
+
+        return (det != float4(0.f)) & (u >= float4(0.f)) & (v >= float4(0.f)) & (u + v <= float4(1.f))
+            & (t > r.t_min) & (t < t_max);
+    }
+
+    struct bounds
+    {
+        glm::vec3 min{infinity};
+        glm::vec3 max{-infinity};
+
+        void extend(glm::vec3 const & p)
+        {
+            min = glm::min(min, p);
+            max = glm::max(max, p);
+        }
+
+        void extend(bounds const & b)
+        {
+            min = glm::min(min, b.min);
+            max = glm::max(max, b.max);
+        }
+
+        float area() const
+        {
+            if (min.x > max.x)
+                return 0.f;
+            glm::vec3 const d = max - min;
+            return 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+        }
+    };
+
+    // Binary tree built first and then collapsed into the four-wide one. Every subtree covers
+    // a contiguous range of the reordered triangles, inner nodes have more than leaf_size of them.
+    struct build_node
+    {
+        bounds box;
+        std::uint32_t first;
+        std::uint32_t count;
+        // The children are left and left + 1
+        std::uint32_t left;
+    };
+
+    struct build_context
+    {
+        std::vector<bounds> triangle_bounds;
+        std::vector<glm::vec3> centroids;
+        // Triangle indices, reordered by the build so that every node gets a contiguous range
+        std::vector<std::uint32_t> triangles;
+        // Only used by the LBVH builder, sorted together with the triangles
+        std::vector<std::uint32_t> morton_codes;
+
+        // A binary tree with at least one triangle per leaf never has more than 2n - 1 nodes,
+        // so the nodes are preallocated and taken with an atomic counter from any thread
+        std::vector<build_node> nodes;
+        std::atomic<std::uint32_t> node_count{1};
+    };
+
+    // Below this many triangles a node is not worth splitting across threads
+    constexpr std::uint32_t min_parallel_triangles = 16384;
+
+    template <typename Split>
+    void build(build_context & context, std::uint32_t index, std::uint32_t first, std::uint32_t count, int depth, Split const & split)
+    {
+        build_node & node = context.nodes[index];
+        node.first = first;
+        node.count = count;
+        node.left = 0;
+
+        if (count <= bvh::leaf_size)
+        {
+            for (std::uint32_t i = first; i < first + count; ++i)
+                node.box.extend(context.triangle_bounds[context.triangles[i]]);
+            return;
+        }
+
+        std::uint32_t const middle = split(first, count, depth);
+        std::uint32_t const left = context.node_count.fetch_add(2);
+        node.left = left;
+
+        // The halves are independent, the top levels build them in parallel until every worker has a subtree
+        if (count >= min_parallel_triangles && (std::size_t(2) << depth) <= worker_count())
+        {
+            std::thread thread([&]{ build(context, left, first, middle - first, depth + 1, split); });
+            build(context, left + 1, middle, first + count - middle, depth + 1, split);
+            thread.join();
+        }
+        else
+        {
+            build(context, left, first, middle - first, depth + 1, split);
+            build(context, left + 1, middle, first + count - middle, depth + 1, split);
+        }
+
+        node.box = context.nodes[left].box;
+        node.box.extend(context.nodes[left + 1].box);
+    }
+
+    // Splits in half along the longest axis of the centroids
+    std::uint32_t split_median(build_context & context, std::uint32_t first, std::uint32_t count, bounds const & centroid_bounds)
+    {
+        glm::vec3 const extent = centroid_bounds.max - centroid_bounds.min;
+        int const axis = (extent.x >= extent.y && extent.x >= extent.z) ? 0 : (extent.y >= extent.z ? 1 : 2);
+
+        auto const begin = context.triangles.begin() + first;
+        std::nth_element(begin, begin + count / 2, begin + count, [&](std::uint32_t a, std::uint32_t b){
+            return context.centroids[a][axis] < context.centroids[b][axis];
+        });
+        return first + count / 2;
+    }
+
+    struct sah_splitter
+    {
+        static constexpr int bin_count = 32;
+
+        // Deeper than this the tree is very unbalanced, and plain median splits bound the traversal stack
+        static constexpr int max_depth = 96;
+
+        struct bin
+        {
+            bounds box;
+            std::uint32_t count = 0;
+        };
+
+        build_context & context;
+
+        std::uint32_t operator()(std::uint32_t first, std::uint32_t count, int depth) const
+        {
+            // Large nodes are binned in parallel, each chunk into its own bins
+            std::size_t const chunks = count >= min_parallel_triangles ? std::max<std::size_t>(1, worker_count() >> depth) : 1;
+
+            std::vector<bounds> chunk_centroid_bounds(chunks);
+            parallel_chunks(count, chunks, [&](std::size_t chunk, std::size_t begin, std::size_t end){
+                for (std::size_t i = begin; i < end; ++i)
+                    chunk_centroid_bounds[chunk].extend(context.centroids[context.triangles[first + i]]);
+            });
+
+            bounds centroid_bounds;
+            for (auto const & b : chunk_centroid_bounds)
+                centroid_bounds.extend(b);
+
+            glm::vec3 const extent = centroid_bounds.max - centroid_bounds.min;
+            if (depth >= max_depth || (extent.x <= 0.f && extent.y <= 0.f && extent.z <= 0.f))
+                return split_median(context, first, count, centroid_bounds);
+
+            glm::vec3 scale;
+            for (int axis = 0; axis < 3; ++axis)
+                scale[axis] = extent[axis] > 0.f ? bin_count * (1.f - 1e-5f) / extent[axis] : 0.f;
+
+            auto bin_index = [&](std::uint32_t triangle, int axis){
+                return std::min(bin_count - 1, int((context.centroids[triangle][axis] - centroid_bounds.min[axis]) * scale[axis]));
+            };
+
+            std::vector<std::array<std::array<bin, bin_count>, 3>> chunk_bins(chunks);
+            parallel_chunks(count, chunks, [&](std::size_t chunk, std::size_t begin, std::size_t end){
+                auto & bins = chunk_bins[chunk];
+                for (std::size_t i = begin; i < end; ++i)
+                {
+                    std::uint32_t const triangle = context.triangles[first + i];
+                    for (int axis = 0; axis < 3; ++axis)
+                    {
+                        bin & b = bins[axis][bin_index(triangle, axis)];
+                        b.box.extend(context.triangle_bounds[triangle]);
+                        ++b.count;
+                    }
+                }
+            });
+
+            for (std::size_t chunk = 1; chunk < chunks; ++chunk)
+            {
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    for (int i = 0; i < bin_count; ++i)
+                    {
+                        chunk_bins[0][axis][i].box.extend(chunk_bins[chunk][axis][i].box);
+                        chunk_bins[0][axis][i].count += chunk_bins[chunk][axis][i].count;
+                    }
+                }
+            }
+
+            // The node area is the same for every candidate, so the cost is just the sum of area times count
+            float best_cost = infinity;
+            int best_axis = -1;
+            int best_split = 0;
+
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                if (extent[axis] <= 0.f)
+                    continue;
+
+                auto const & bins = chunk_bins[0][axis];
+
+                // right_cost[i] is the cost of bins i and up
+                float right_cost[bin_count];
+                bounds right;
+                std::uint32_t right_count = 0;
+                for (int i = bin_count - 1; i > 0; --i)
+                {
+                    right.extend(bins[i].box);
+                    right_count += bins[i].count;
+                    right_cost[i] = right.area() * right_count;
+                }
+
+                bounds left;
+                std::uint32_t left_count = 0;
+                for (int i = 1; i < bin_count; ++i)
+                {
+                    left.extend(bins[i - 1].box);
+                    left_count += bins[i - 1].count;
+
+                    if (left_count == 0 || left_count == count)
+                        continue;
+
+                    float const cost = left.area() * left_count + right_cost[i];
+                    if (cost < best_cost)
+                    {
+                        best_cost = cost;
+                        best_axis = axis;
+                        best_split = i;
+                    }
+                }
+            }
+
+            if (best_axis < 0)
+                return split_median(context, first, count, centroid_bounds);
+
+            auto const begin = context.triangles.begin() + first;
+            auto const middle = std::partition(begin, begin + count, [&](std::uint32_t triangle){
+                return bin_index(triangle, best_axis) < best_split;
+            });
+            return first + (middle - begin);
+        }
+    };
+
+    struct lbvh_splitter
+    {
+        build_context & context;
+
+        // Triangles are sorted by Morton code, the split is where the highest differing bit flips
+        std::uint32_t operator()(std::uint32_t first, std::uint32_t count, int) const
+        {
+            std::uint32_t const a = context.morton_codes[first];
+            std::uint32_t const b = context.morton_codes[first + count - 1];
+            if (a == b)
+                return first + count / 2;
+
+            int const bit = 31 - std::countl_zero(a ^ b);
+            auto const begin = context.morton_codes.begin() + first;
+            return first + (std::partition_point(begin, begin + count, [bit](std::uint32_t code){ return ((code >> bit) & 1) == 0; }) - begin);
+        }
+    };
+
+    // Spreads the lower 10 bits so that there are two zero bits between any two of them
+    std::uint32_t expand_bits(std::uint32_t x)
+    {
+        x &= 0x3ff;
+        x = (x | (x << 16)) & 0x030000ff;
+        x = (x | (x << 8)) & 0x0300f00f;
+        x = (x | (x << 4)) & 0x030c30c3;
+        x = (x | (x << 2)) & 0x09249249;
+        return x;
+    }
+
+    void sort_by_morton_code(build_context & context)
+    {
+        std::size_t const count = context.triangles.size();
+
+        std::vector<bounds> chunk_bounds(worker_count());
+        parallel_chunks(count, chunk_bounds.size(), [&](std::size_t chunk, std::size_t begin, std::size_t end){
+            for (std::size_t i = begin; i < end; ++i)
+                chunk_bounds[chunk].extend(context.centroids[i]);
+        });
+
+        bounds centroid_bounds;
+        for (auto const & b : chunk_bounds)
+            centroid_bounds.extend(b);
+
+        glm::vec3 const extent = centroid_bounds.max - centroid_bounds.min;
+        glm::vec3 scale;
+        for (int axis = 0; axis < 3; ++axis)
+            scale[axis] = extent[axis] > 0.f ? 1023.f / extent[axis] : 0.f;
+
+        std::vector<std::uint32_t> codes(count);
+        parallel_for(count, [&](std::size_t i){
+            glm::vec3 const p = (context.centroids[i] - centroid_bounds.min) * scale;
+            codes[i] = (expand_bits(std::uint32_t(p.x)) << 2) | (expand_bits(std::uint32_t(p.y)) << 1) | expand_bits(std::uint32_t(p.z));
+        });
+
+        // Three passes of a 10-bit radix sort cover the 30-bit codes
+        std::vector<std::uint32_t> order = context.triangles;
+        std::vector<std::uint32_t> sorted(count);
+        for (int shift = 0; shift < 30; shift += 10)
+        {
+            std::vector<std::uint32_t> offsets(1025, 0);
+            for (std::uint32_t triangle : order)
+                ++offsets[((codes[triangle] >> shift) & 1023) + 1];
+            for (std::size_t i = 1; i < offsets.size(); ++i)
+                offsets[i] += offsets[i - 1];
+            for (std::uint32_t triangle : order)
+                sorted[offsets[(codes[triangle] >> shift) & 1023]++] = triangle;
+            std::swap(order, sorted);
+        }
+
+        context.triangles = std::move(order);
+        context.morton_codes.resize(count);
+        for (std::size_t i = 0; i < count; ++i)
+            context.morton_codes[i] = codes[context.triangles[i]];
+    }
+
+    // Turns the binary tree into the four-wide one by pulling up the grandchildren with the largest area
+    struct collapser
+    {
+        build_context const & context;
+        std::span<glm::vec3 const> positions;
+        std::span<std::uint32_t const> indices;
+        std::vector<bvh::node> & nodes;
+        std::vector<bvh::leaf> & leaves;
+
+        std::uint32_t make_leaf(build_node const & source)
+        {
+            bvh::leaf & leaf = leaves.emplace_back();
+            for (int i = 0; i < bvh::leaf_size; ++i)
+            {
+                glm::vec3 v0(0.f), e1(0.f), e2(0.f);
+                leaf.triangles[i] = ray_hit::none;
+
+                if (std::uint32_t(i) < source.count)
+                {
+                    std::uint32_t const triangle = context.triangles[source.first + i];
+                    v0 = positions[indices[3 * triangle + 0]];
+                    e1 = positions[indices[3 * triangle + 1]] - v0;
+                    e2 = positions[indices[3 * triangle + 2]] - v0;
+                    leaf.triangles[i] = triangle;
+                }
+
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    leaf.v0[axis][i] = v0[axis];
+                    leaf.e1[axis][i] = e1[axis];
+                    leaf.e2[axis][i] = e2[axis];
+                }
+            }
+            return std::uint32_t(leaves.size() - 1) | bvh::leaf_bit;
+        }
+
+        std::uint32_t make_child(std::uint32_t index)
+        {
+            build_node const & source = context.nodes[index];
+            return source.count > bvh::leaf_size ? make_node(index) : make_leaf(source);
+        }
+
+        void set_child(std::uint32_t node, int slot, bounds const & box, std::uint32_t child)
+        {
+            bvh::node & n = nodes[node];
+            n.min_x[slot] = box.min.x;
+            n.min_y[slot] = box.min.y;
+            n.min_z[slot] = box.min.z;
+            n.max_x[slot] = box.max.x;
+            n.max_y[slot] = box.max.y;
+            n.max_z[slot] = box.max.z;
+            n.children[slot] = child;
+        }
+
+        std::uint32_t make_node(std::uint32_t index)
+        {
+            std::uint32_t children[bvh::width] = {context.nodes[index].left, context.nodes[index].left + 1};
+            int count = 2;
+
+            while (count < bvh::width)
+            {
+                int largest = -1;
+                float largest_area = -1.f;
+                for (int i = 0; i < count; ++i)
+                {
+                    build_node const & child = context.nodes[children[i]];
+                    if (child.count > bvh::leaf_size && child.box.area() > largest_area)
+                    {
+                        largest = i;
+                        largest_area = child.box.area();
+                    }
+                }
+
+                if (largest < 0)
+                    break;
+
+                std::uint32_t const left = context.nodes[children[largest]].left;
+                children[largest] = left;
+                children[count++] = left + 1;
+            }
+
+            std::uint32_t const result = nodes.size();
+            nodes.emplace_back();
+
+            for (int i = 0; i < bvh::width; ++i)
+            {
+                if (i < count)
+                    set_child(result, i, context.nodes[children[i]].box, make_child(children[i]));
+                else
+                    set_child(result, i, bounds{}, bvh::empty);
+            }
+
+            return result;
+        }
+    };
+
+    // Deep enough for any tree the builders make: at most max_depth + 32 binary levels
+    constexpr int stack_size = 512;
+
+    struct stack_entry
+    {
+        std::uint32_t child;
+        float t;
+    };
+
+    // Pushes the hit children so that the nearest one is popped first. At most four of them,
+    // so an insertion sort straight onto the stack, farthest at the bottom
+    void push_sorted(stack_entry * stack, int & size, stack_entry const * hit, int hit_count)
+    {
+        stack_entry * const first = stack + size;
+        for (int i = 0; i < hit_count; ++i)
+        {
+            int j = i;
+            for (; j > 0 && first[j - 1].t < hit[i].t; --j)
+                first[j] = first[j - 1];
+            first[j] = hit[i];
+        }
+        size += hit_count;
+    }
+
+}
+
+bvh::bvh(std::span<glm::vec3 const> positions, std::span<std::uint32_t const> indices, builder method)
+{
+    std::size_t const triangle_count = indices.size() / 3;
+
+    build_context context;
+    context.triangle_bounds.resize(triangle_count);
+    context.centroids.resize(triangle_count);
+    context.triangles.resize(triangle_count);
+
+    parallel_for(triangle_count, [&](std::size_t i){
+        bounds & box = context.triangle_bounds[i];
+        for (int j = 0; j < 3; ++j)
+            box.extend(positions[indices[3 * i + j]]);
+        context.centroids[i] = (box.min + box.max) * 0.5f;
+        context.triangles[i] = i;
+    });
+
+    context.nodes.resize(std::max<std::size_t>(1, 2 * triangle_count));
+
+    if (method == builder::sah)
+        build(context, 0, 0, triangle_count, 0, sah_splitter{context});
+    else
+    {
+        sort_by_morton_code(context);
+        build(context, 0, 0, triangle_count, 0, lbvh_splitter{context});
+    }
+
+    nodes_.reserve(context.node_count / 2 + 1);
+    leaves_.reserve(context.node_count / 2 + 1);
+
+    collapser c{context, positions, indices, nodes_, leaves_};
+    if (triangle_count > leaf_size)
+        c.make_node(0);
+    else
+    {
+        // The root is always an inner node, even when everything fits into one leaf
+        nodes_.emplace_back();
+        for (int i = 0; i < width; ++i)
+            c.set_child(0, i, bounds{}, empty);
+        if (triangle_count > 0)
+            c.set_child(0, 0, context.nodes[0].box, c.make_leaf(context.nodes[0]));
+    }
+}
+
+ray_hit bvh::intersect(ray const & r) const
+{
+    ray_hit hit;
+    trace<false>(r, &hit);
+    return hit;
+}
+
+bool bvh::occluded(ray const & r) const
+{
+    return trace<true>(r, nullptr);
+}
+
+void bvh::intersect(std::span<ray const, 4> rays, std::span<ray_hit, 4> hits) const
+{
+    trace<false>(rays, hits.data(), nullptr);
+}
+
+void bvh::occluded(std::span<ray const, 4> rays, std::span<bool, 4> result) const
+{
+    trace<true>(rays, nullptr, result.data());
+}
+
+float bvh::sah_cost() const
+{
+    bounds root;
+    for (int i = 0; i < width; ++i)
+    {
+        root.extend(glm::vec3(nodes_[0].min_x[i], nodes_[0].min_y[i], nodes_[0].min_z[i]));
+        root.extend(glm::vec3(nodes_[0].max_x[i], nodes_[0].max_y[i], nodes_[0].max_z[i]));
+    }
+
+    float const root_area = root.area();
+    if (root_area <= 0.f)
+        return 1.f;
+
+    // Every visit of a node or a leaf costs one four-wide test, a child is visited as often as its area is hit
+    float cost = 1.f;
+    for (auto const & n : nodes_)
+    {
+        for (int i = 0; i < width; ++i)
+        {
+            if (n.children[i] == empty)
+                continue;
+
+            bounds box;
+            box.extend(glm::vec3(n.min_x[i], n.min_y[i], n.min_z[i]));
+            box.extend(glm::vec3(n.max_x[i], n.max_y[i], n.max_z[i]));
+            cost += box.area() / root_area;
+        }
+    }
+    return cost;
+}
+
+template <bool any_hit>
+bool bvh::trace(ray const & r, ray_hit * hit) const
+{
+    ray4 r4;
+    // Offsets of the near and far planes in a node, in units of four floats from min_x
+    int near_offset[3];
+    int far_offset[3];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        r4.origin[axis] = float4(r.origin[axis]);
+        r4.direction[axis] = float4(r.direction[axis]);
+        r4.inv_direction[axis] = float4(safe_inverse(r.direction[axis]));
+        bool const negative = r.direction[axis] < 0.f;
+        near_offset[axis] = axis + (negative ? 3 : 0);
+        far_offset[axis] = axis + (negative ? 0 : 3);
+    }
+    r4.t_min = float4(r.t_min);
+
+    float t_max = r.t_max;
+    bool found = false;
+
+    stack_entry stack[stack_size];
+    int size = 0;
+    std::uint32_t current = 0;
+
+    while (true)
+    {
+        if (current & leaf_bit)
+        {
+            leaf const & l = leaves_[current & ~leaf_bit];
+
+            float4 v0[3], e1[3], e2[3];
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                v0[axis] = float4::load(l.v0[axis]);
+                e1[axis] = float4::load(l.e1[axis]);
+                e2[axis] = float4::load(l.e2[axis]);
+            }
+
+            float4 t, u, v;
+            int mask = bits(intersect_triangle(r4, float4(t_max), v0, e1, e2, t, u, v));
+            if (mask != 0)
+            {
+                if constexpr (any_hit)
+                    return true;
+
+                found = true;
+                for (; mask != 0; mask &= mask - 1)
+                {
+                    int const i = std::countr_zero(unsigned(mask));
+                    float const ti = lane(t, i);
+                    if (ti < t_max)
+                    {
+                        t_max = ti;
+                        hit->triangle = l.triangles[i];
+                        hit->t = ti;
+                        hit->u = lane(u, i);
+                        hit->v = lane(v, i);
+                    }
+                }
+            }
+        }
+        else
+        {
+            node const & n = nodes_[current];
+            float const * planes = n.min_x;
+
+            float4 near[3], far[3];
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                near[axis] = float4::load(planes + 4 * near_offset[axis]);
+                far[axis] = float4::load(planes + 4 * far_offset[axis]);
+            }
+
+            float4 t_near;
+            int mask = bits(intersect_box(r4, float4(t_max), near, far, t_near));
+
+            stack_entry hits[width];
+            int hit_count = 0;
+            for (; mask != 0; mask &= mask - 1)
+            {
+                int const i = std::countr_zero(unsigned(mask));
+                hits[hit_count++] = {n.children[i], lane(t_near, i)};
+            }
+            push_sorted(stack, size, hits, hit_count);
+        }
+
+        // Children farther than the closest hit found since they were pushed are skipped
+        do
+        {
+            if (size == 0)
+                return found;
+            --size;
+        }
+        while (stack[size].t > t_max);
+
+        current = stack[size].child;
+    }
+}
+
+template <bool any_hit>
+void bvh::trace(std::span<ray const, 4> rays, ray_hit * hits, bool * occluded) const
+{
+    ray4 r4;
+    alignas(16) float values[4];
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        for (int i = 0; i < 4; ++i)
+            values[i] = rays[i].origin[axis];
+        r4.origin[axis] = float4::load(values);
+
+        for (int i = 0; i < 4; ++i)
+            values[i] = rays[i].direction[axis];
+        r4.direction[axis] = float4::load(values);
+
+        for (int i = 0; i < 4; ++i)
+            values[i] = safe_inverse(rays[i].direction[axis]);
+        r4.inv_direction[axis] = float4::load(values);
+    }
+
+    for (int i = 0; i < 4; ++i)
+        values[i] = rays[i].t_min;
+    r4.t_min = float4::load(values);
+
+    // Inner nodes are tested one ray at a time against all four children, like in the single ray
+    // kernel, and the nearest entry distance of every child is kept over the rays that hit it
+    ray4 single[4];
+    int near_offset[4][3];
+    int far_offset[4][3];
+    for (int i = 0; i < 4; ++i)
+    {
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            single[i].origin[axis] = float4(rays[i].origin[axis]);
+            single[i].direction[axis] = float4(rays[i].direction[axis]);
+            single[i].inv_direction[axis] = float4(safe_inverse(rays[i].direction[axis]));
+            bool const negative = rays[i].direction[axis] < 0.f;
+            near_offset[i][axis] = axis + (negative ? 3 : 0);
+            far_offset[i][axis] = axis + (negative ? 0 : 3);
+        }
+        single[i].t_min = float4(rays[i].t_min);
+    }
+
+    // Rays that are done (occluded for any hit) get t_max = -inf and stop hitting anything
+    for (int i = 0; i < 4; ++i)
+        values[i] = rays[i].t_max;
+    float4 t_max = float4::load(values);
+
+    std::uint32_t triangle[4] = {ray_hit::none, ray_hit::none, ray_hit::none, ray_hit::none};
+    float4 hit_u(0.f), hit_v(0.f);
+    int done = 0;
+
+    auto largest_t_max = [&]{
+        return std::max(std::max(lane(t_max, 0), lane(t_max, 1)), std::max(lane(t_max, 2), lane(t_max, 3)));
+    };
+
+    stack_entry stack[stack_size];
+    int size = 0;
+    std::uint32_t current = 0;
+
+    while (true)
+    {
+        if (current & leaf_bit)
+        {
+            leaf const & l = leaves_[current & ~leaf_bit];
+
+            for (int j = 0; j < leaf_size && l.triangles[j] != ray_hit::none; ++j)
+            {
+                float4 v0[3], e1[3], e2[3];
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    v0[axis] = float4(l.v0[axis][j]);
+                    e1[axis] = float4(l.e1[axis][j]);
+                    e2[axis] = float4(l.e2[axis][j]);
+                }
+
+                float4 t, u, v;
+                mask4 const hit = intersect_triangle(r4, t_max, v0, e1, e2, t, u, v);
+                int mask = bits(hit);
+                if (mask == 0)
+                    continue;
+
+                if constexpr (any_hit)
+                {
+                    t_max = select(hit, float4(-infinity), t_max);
+                    done |= mask;
+                    if (done == 0xf)
+                        break;
+                }
+                else
+                {
+                    t_max = select(hit, t, t_max);
+                    hit_u = select(hit, u, hit_u);
+                    hit_v = select(hit, v, hit_v);
+                    for (; mask != 0; mask &= mask - 1)
+                        triangle[std::countr_zero(unsigned(mask))] = l.triangles[j];
+                }
+            }
+
+            if (any_hit && done == 0xf)
+                break;
+        }
+        else
+        {
+            node const & n = nodes_[current];
+            float const * planes = n.min_x;
+
+            alignas(16) float ray_t_max[4];
+            t_max.store(ray_t_max);
+
+            float4 child_t(infinity);
+            for (int r = 0; r < 4; ++r)
+            {
+                float4 near[3], far[3];
+                for (int axis = 0; axis < 3; ++axis)
+                {
+                    near[axis] = float4::load(planes + 4 * near_offset[r][axis]);
+                    far[axis] = float4::load(planes + 4 * far_offset[r][axis]);
+                }
+
+                // Finished rays have t_max = -inf and miss every box
+                float4 t_near;
+                mask4 const hit = intersect_box(single[r], float4(ray_t_max[r]), near, far, t_near);
+                child_t = select(hit, min(child_t, t_near), child_t);
+            }
+
+            // Empty children have empty boxes, so no ray hits them
+            alignas(16) float t[4];
+            child_t.store(t);
+            int mask = bits(child_t < float4(infinity));
+
+            stack_entry hits[width];
+            int hit_count = 0;
+            for (; mask != 0; mask &= mask - 1)
+            {
+                int const i = std::countr_zero(unsigned(mask));
+                hits[hit_count++] = {n.children[i], t[i]};
+            }
+            push_sorted(stack, size, hits, hit_count);
+        }
+
+        float const cull = largest_t_max();
+        while (size > 0 && stack[size - 1].t > cull)
+            --size;
+
+        if (size == 0)
+            break;
+
+        current = stack[--size].child;
+    }
+
+    if constexpr (any_hit)
+    {
+        for (int i = 0; i < 4; ++i)
+            occluded[i] = (done >> i) & 1;
+    }
+    else
+    {
+        for (int i = 0; i < 4; ++i)
+        {
+            if (triangle[i] == ray_hit::none)
+                continue;
+            hits[i].triangle = triangle[i];
+            hits[i].t = lane(t_max, i);
+            hits[i].u = lane(hit_u, i);
+            hits[i].v = lane(hit_v, i);
+        }
+    }
+}
@@ -27,6 +27,7 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "obj_parser.hpp"
+#include "ambient_occlusion.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -52,15 +53,18 @@ uniform mat4 projection;
 
 layout (location = 0) in vec3 in_position;
 layout (location = 1) in vec3 in_normal;
+layout (location = 2) in vec4 in_ambient_occlusion;
 
 out vec3 normal;
 out vec3 position;
+out float ambient_occlusion;
 
 void main()
 {
     gl_Position = projection * view * model * vec4(in_position, 1.0);
     position = (model * vec4(in_position, 1.0)).xyz;
     normal = normalize(mat3(model) * in_normal);
+    ambient_occlusion = in_ambient_occlusion.w;
 }
 )";
 
@@ -71,6 +75,7 @@ uniform vec3 camera_position;
 
 in vec3 normal;
 in vec3 position;
+in float ambient_occlusion;
 
 layout (location = 0) out vec4 out_color;
 
@@ -85,7 +90,7 @@ void main()
 
     vec3 albedo = vec3(1.0, 1.0, 1.0);
 
-    vec3 light = ambient_light + light_color * (max(0.0, dot(normal, light_direction)) + pow(max(0.0, dot(camera_direction, reflected)), 64.0));
+    vec3 light = ambient_light * ambient_occlusion + light_color * (max(0.0, dot(normal, light_direction)) + pow(max(0.0, dot(camera_direction, reflected)), 64.0));
     vec3 color = albedo * light;
     out_color = vec4(color, 1.0);
 }
@@ -294,6 +299,17 @@ int main() try
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(obj_data::vertex), (void*)(12));
 
+    // Baked on the first run, then read from the cache in the working directory
+    auto dragon_ambient_occlusion = load_ambient_occlusion(dragon, "dragon.ao");
+
+    GLuint dragon_ambient_occlusion_vbo;
+    glGenBuffers(1, &dragon_ambient_occlusion_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, dragon_ambient_occlusion_vbo);
+    glBufferData(GL_ARRAY_BUFFER, dragon_ambient_occlusion.size() * sizeof(dragon_ambient_occlusion[0]), dragon_ambient_occlusion.data(), GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 4, GL_BYTE, GL_TRUE, sizeof(ambient_occlusion_vertex), (void*)(0));
+
     auto rectangle_vertex_shader = create_shader(GL_VERTEX_SHADER, rectangle_vertex_shader_source);
     auto rectangle_fragment_shader = create_shader(GL_FRAGMENT_SHADER, rectangle_fragment_shader_source);
     auto rectangle_program = create_program(rectangle_vertex_shader, rectangle_fragment_shader);
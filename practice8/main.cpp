@@ -30,6 +30,7 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "obj_parser.hpp"
+#include "ambient_occlusion.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -55,15 +56,18 @@ uniform mat4 projection;
 
 layout (location = 0) in vec3 in_position;
 layout (location = 1) in vec3 in_normal;
+layout (location = 2) in vec4 in_ambient_occlusion;
 
 out vec3 position;
 out vec3 normal;
+out float ambient_occlusion;
 
 void main()
 {
     position = (model * vec4(in_position, 1.0)).xyz;
     gl_Position = projection * view * vec4(position, 1.0);
     normal = normalize(mat3(model) * in_normal);
+    ambient_occlusion = in_ambient_occlusion.w;
 }
 )";
 
@@ -82,6 +86,7 @@ uniform mat4 shadow_projection;
 
 in vec3 position;
 in vec3 normal;
+in float ambient_occlusion;
 
 layout (location = 0) out vec4 out_color;
 
@@ -133,7 +138,7 @@ void main()
     }
 
     float ambient_light = 0.2;
-    vec3 color = albedo * ambient_light + sun_color * phong(sun_direction) * shadow;
+    vec3 color = albedo * ambient_light * ambient_occlusion + sun_color * phong(sun_direction) * shadow;
     out_color = vec4(color, 1.0);
 }
 )";
@@ -338,6 +343,17 @@ try
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(obj_data::vertex), (void *)(12));
 
+    // Baked on the first run, then read from the cache in the working directory
+    auto scene_ambient_occlusion = load_ambient_occlusion(scene, "buddha.ao");
+
+    GLuint scene_ambient_occlusion_vbo;
+    glGenBuffers(1, &scene_ambient_occlusion_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, scene_ambient_occlusion_vbo);
+    glBufferData(GL_ARRAY_BUFFER, scene_ambient_occlusion.size() * sizeof(scene_ambient_occlusion[0]), scene_ambient_occlusion.data(), GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 4, GL_BYTE, GL_TRUE, sizeof(ambient_occlusion_vertex), (void *)(0));
+
     GLuint debug_vao;
     glGenVertexArrays(1, &debug_vao);
 
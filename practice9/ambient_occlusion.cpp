@@ -0,0 +1,187 @@
+#include "ambient_occlusion.hpp"
+#include "bvh.hpp"
+#include "parallel.hpp"
+
+#include <glm/geometric.hpp>
+#include <glm/ext/scalar_constants.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+
+namespace
+{
+
+    // Bumped whenever the baked values change meaning, so that old caches are rebaked
+    constexpr std::uint32_t cache_version = 1;
+    constexpr char cache_magic[4] = {'A', 'O', 'V', 'B'};
+
+    struct cache_header
+    {
+        char magic[4];
+        std::uint32_t version;
+        std::uint64_t key;
+        std::uint64_t vertex_count;
+    };
+
+    // FNV-1a
+    std::uint64_t hash(void const * data, std::size_t size, std::uint64_t h = 14695981039346656037ull)
+    {
+        auto bytes = static_cast<unsigned char const *>(data);
+        for (std::size_t i = 0; i < size; ++i)
+            h = (h ^ bytes[i]) * 1099511628211ull;
+        return h;
+    }
+
+    std::uint64_t cache_key(obj_data const & mesh, ambient_occlusion_settings const & settings)
+    {
+        std::uint64_t h = hash(mesh.vertices.data(), mesh.vertices.size() * sizeof(mesh.vertices[0]));
+        h = hash(mesh.indices.data(), mesh.indices.size() * sizeof(mesh.indices[0]), h);
+        h = hash(&settings.samples, sizeof(settings.samples), h);
+        h = hash(&settings.max_distance, sizeof(settings.max_distance), h);
+        return h;
+    }
+
+    // Van der Corput sequence, the second coordinate of the Hammersley points
+    float radical_inverse(std::uint32_t i)
+    {
+        i = (i << 16) | (i >> 16);
+        i = ((i & 0x55555555u) << 1) | ((i & 0xaaaaaaaau) >> 1);
+        i = ((i & 0x33333333u) << 2) | ((i & 0xccccccccu) >> 2);
+        i = ((i & 0x0f0f0f0fu) << 4) | ((i & 0xf0f0f0f0u) >> 4);
+        i = ((i & 0x00ff00ffu) << 8) | ((i & 0xff00ff00u) >> 8);
+        return i * 0x1p-32f;
+    }
+
+    // Per-vertex offset of the sample pattern, so that neighbouring vertices don't share its artifacts
+    float scramble(std::uint32_t x)
+    {
+        x ^= x >> 16;
+        x *= 0x7feb352du;
+        x ^= x >> 15;
+        x *= 0x846ca68bu;
+        x ^= x >> 16;
+        return (x >> 8) * 0x1p-24f;
+    }
+
+    std::int8_t to_snorm8(float x)
+    {
+        return std::int8_t(std::lround(std::clamp(x, -1.f, 1.f) * 127.f));
+    }
+
+}
+
+std::vector<ambient_occlusion_vertex> bake_ambient_occlusion(obj_data const & mesh, ambient_occlusion_settings const & settings)
+{
+    std::vector<glm::vec3> positions;
+    positions.reserve(mesh.vertices.size());
+
+    glm::vec3 min(std::numeric_limits<float>::infinity());
+    glm::vec3 max(-std::numeric_limits<float>::infinity());
+    for (auto const & vertex : mesh.vertices)
+    {
+        positions.emplace_back(vertex.position[0], vertex.position[1], vertex.position[2]);
+        min = glm::min(min, positions.back());
+        max = glm::max(max, positions.back());
+    }
+
+    bvh const tree(positions, mesh.indices);
+
+    float const diagonal = mesh.vertices.empty() ? 0.f : glm::distance(min, max);
+    float const max_distance = settings.max_distance * diagonal;
+    // Keeps the rays from hitting the triangles around their own vertex
+    float const offset = 1e-4f * diagonal;
+
+    std::vector<ambient_occlusion_vertex> result(mesh.vertices.size());
+
+    parallel_for(mesh.vertices.size(), [&](std::size_t i){
+        auto const & n = mesh.vertices[i].normal;
+        glm::vec3 normal(n[0], n[1], n[2]);
+
+        if (glm::dot(normal, normal) == 0.f)
+        {
+            result[i] = {{0, 0, 0}, 127};
+            return;
+        }
+        normal = glm::normalize(normal);
+
+        // Orthonormal basis around the normal, Duff et al. 2017
+        float const sign = std::copysign(1.f, normal.z);
+        float const a = -1.f / (sign + normal.z);
+        float const b = normal.x * normal.y * a;
+        glm::vec3 const tangent(1.f + sign * normal.x * normal.x * a, sign * b, -sign * normal.x);
+        glm::vec3 const bitangent(b, sign + normal.y * normal.y * a, -normal.y);
+
+        float const rotation = scramble(i);
+
+        ray r;
+        r.origin = positions[i] + normal * offset;
+        r.t_max = max_distance;
+
+        glm::vec3 bent_normal(0.f);
+        int unoccluded = 0;
+
+        for (int s = 0; s < settings.samples; ++s)
+        {
+            // Hammersley points mapped to the hemisphere with a cosine-weighted density, so that
+            // the plain fraction of unoccluded rays is the cosine-weighted visibility
+            float const u = (s + 0.5f) / settings.samples;
+            float const v = std::fmod(radical_inverse(s) + rotation, 1.f);
+
+            float const radius = std::sqrt(u);
+            float const phi = 2.f * glm::pi<float>() * v;
+            glm::vec3 const local(radius * std::cos(phi), radius * std::sin(phi), std::sqrt(std::max(0.f, 1.f - u)));
+
+            r.direction = tangent * local.x + bitangent * local.y + normal * local.z;
+
+            if (!tree.occluded(r))
+            {
+                bent_normal += r.direction;
+                ++unoccluded;
+            }
+        }
+
+        bent_normal = unoccluded > 0 ? glm::normalize(bent_normal) : normal;
+        float const visibility = settings.samples > 0 ? float(unoccluded) / settings.samples : 1.f;
+
+        result[i] = {{to_snorm8(bent_normal.x), to_snorm8(bent_normal.y), to_snorm8(bent_normal.z)}, to_snorm8(visibility)};
+    });
+
+    return result;
+}
+
+std::vector<ambient_occlusion_vertex> load_ambient_occlusion(obj_data const & mesh, std::filesystem::path const & cache_path,
+    ambient_occlusion_settings const & settings)
+{
+    std::uint64_t const key = cache_key(mesh, settings);
+
+    if (std::ifstream in{cache_path, std::ios::binary})
+    {
+        cache_header header;
+        if (in.read(reinterpret_cast<char *>(&header), sizeof(header))
+            && std::memcmp(header.magic, cache_magic, sizeof(cache_magic)) == 0
+            && header.version == cache_version
+            && header.key == key
+            && header.vertex_count == mesh.vertices.size())
+        {
+            std::vector<ambient_occlusion_vertex> result(mesh.vertices.size());
+            if (in.read(reinterpret_cast<char *>(result.data()), result.size() * sizeof(result[0])))
+                return result;
+        }
+    }
+
+    auto result = bake_ambient_occlusion(mesh, settings);
+
+    cache_header header;
+    std::memcpy(header.magic, cache_magic, sizeof(cache_magic));
+    header.version = cache_version;
+    header.key = key;
+    header.vertex_count = result.size();
+
+    std::ofstream out{cache_path, std::ios::binary};
+    out.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    out.write(reinterpret_cast<char const *>(result.data()), result.size() * sizeof(result[0]));
+
+    return result;
+}
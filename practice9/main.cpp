@@ -27,6 +27,7 @@
 #include <glm/gtx/string_cast.hpp>
 
 #include "obj_parser.hpp"
+#include "ambient_occlusion.hpp"
 
 std::string to_string(std::string_view str)
 {
@@ -52,15 +53,18 @@ uniform mat4 projection;
 
 layout (location = 0) in vec3 in_position;
 layout (location = 1) in vec3 in_normal;
+layout (location = 2) in vec4 in_ambient_occlusion;
 
 out vec3 position;
 out vec3 normal;
+out float ambient_occlusion;
 
 void main()
 {
     gl_Position = projection * view * model * vec4(in_position, 1.0);
     position = (model * vec4(in_position, 1.0)).xyz;
     normal = normalize((model * vec4(in_normal, 0.0)).xyz);
+    ambient_occlusion = in_ambient_occlusion.w;
 }
 )";
 
@@ -78,6 +82,7 @@ uniform sampler2D shadow_map;
 
 in vec3 position;
 in vec3 normal;
+in float ambient_occlusion;
 
 layout (location = 0) out vec4 out_color;
 
@@ -125,7 +130,7 @@ void main()
 
     vec3 albedo = vec3(1.0, 1.0, 1.0);
 
-    vec3 light = ambient;
+    vec3 light = ambient * ambient_occlusion;
     light += light_color * max(0.0, dot(normal, light_direction)) * shadow_factor;
     vec3 color = albedo * light;
 
@@ -355,6 +360,17 @@ int main() try
     glEnableVertexAttribArray(1);
     glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(obj_data::vertex), (void*)(12));
 
+    // Baked on the first run, then read from the cache in the working directory
+    auto scene_ambient_occlusion = load_ambient_occlusion(scene, "bunny.ao");
+
+    GLuint ambient_occlusion_vbo;
+    glGenBuffers(1, &ambient_occlusion_vbo);
+    glBindBuffer(GL_ARRAY_BUFFER, ambient_occlusion_vbo);
+    glBufferData(GL_ARRAY_BUFFER, scene_ambient_occlusion.size() * sizeof(scene_ambient_occlusion[0]), scene_ambient_occlusion.data(), GL_STATIC_DRAW);
+
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 4, GL_BYTE, GL_TRUE, sizeof(ambient_occlusion_vertex), (void*)(0));
+
     GLuint debug_vao;
     glGenVertexArrays(1, &debug_vao);
 